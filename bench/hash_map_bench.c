@@ -0,0 +1,612 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <pthread.h>
+#include <time.h>
+#include <ceeds/concurrent_hash_map.h>
+#include <ceeds/flat_hash_map.h>
+#include <ceeds/hash_map.h>
+#include <ceeds/hash_utils.h>
+#include <ceeds/rcu_hash_map.h>
+
+/**
+ * Hash map benchmarks
+ *
+ * Measures insertions (growth included), successful lookups and failed lookups, for every capacity policy
+ * and for flat hash maps, over several sizes of maps, as well as batched insertions and lookups, and the same
+ * for the interleaved (HASH_MAP_AOS) layout. Then compares both layouts on lookups reading the values they
+ * find, with mostly hits and with mostly misses. Then measures how lookups fare in maps going through a
+ * lot of churn (as many erasures as insertions), with tombstones and with backward-shift deletion, and how
+ * long the slowest insertion takes, with and without incremental resizing. Finally, compares iterating over
+ * all the slots by hand with hash_map_for_each, over a full map and over one with only a 16th of its elements
+ * left. Last, compares a hash map behind a global mutex with a concurrent hash map, with threads upserting and
+ * looking up keys in parallel, and compares that concurrent hash map with an RCU hash map for threads only
+ * looking up keys, while another thread keeps updating the map in the background. Every figure is the best
+ * of a few runs, in nanoseconds per operation (per element, for iterations; of wall-clock time over all
+ * threads, for concurrent maps).
+ *
+ * Usage: ceeds-hash-map-bench [size]...
+ */
+
+#define BENCH_RUNS                  3
+#define BENCH_MIN_OPS               ((size_t)1024 * 1024)
+#define BENCH_CHURN_FACTOR          8
+#define BENCH_MAX_THREADS           8
+#define BENCH_SHARDS                64
+#define BENCH_WRITER_PAUSE_NS       10000000
+
+#define bench_hash_u64(k)           fnv_one64((const char *)&(k), sizeof(k))
+
+MAKE_HASH_MAP_TYPE_WITH_POLICY(bench_pow2, uint64_t, uint64_t, bench_hash_u64, CMP, HASH_MAP_POW2);
+MAKE_HASH_MAP_TYPE_WITH_POLICY(bench_fastrange, uint64_t, uint64_t, bench_hash_u64, CMP, HASH_MAP_FASTRANGE);
+MAKE_HASH_MAP_TYPE_WITH_POLICY(bench_modulo, uint64_t, uint64_t, bench_hash_u64, CMP, HASH_MAP_MODULO);
+MAKE_HASH_MAP_TYPE_WITH_LAYOUT(bench_aos, uint64_t, uint64_t, bench_hash_u64, CMP, HASH_MAP_POW2, HASH_MAP_AOS);
+MAKE_FLAT_HASH_MAP_TYPE(bench_flat, uint64_t, uint64_t, bench_hash_u64, CMP);
+MAKE_CONCURRENT_HASH_MAP_TYPE(bench_chm, uint64_t, uint64_t, bench_hash_u64, CMP);
+MAKE_RCU_HASH_MAP_TYPE(bench_rcu, uint64_t, uint64_t, bench_hash_u64, CMP);
+
+struct bench_result
+{
+    double insert_ns;
+    double hit_ns;
+    double miss_ns;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/* The result is accumulated into a volatile sink, so that lookups are not optimized out */
+static volatile size_t bench_sink;
+
+/**
+ * Define a function running the benchmark for a given map type, @p m being the prefix of its functions
+ */
+#define MAKE_BENCH(m, n)                                                            \
+    static void bench_##n(                                                          \
+        const uint64_t *keys,                                                       \
+        const uint64_t *missing,                                                    \
+        size_t count,                                                               \
+        struct bench_result *res                                                    \
+    )                                                                               \
+    {                                                                               \
+        size_t rounds = MAX((size_t)1, BENCH_MIN_OPS / count);                      \
+        double ops = (double)(rounds * count);                                      \
+                                                                                    \
+        *res = (struct bench_result){1e30, 1e30, 1e30};                             \
+        for (size_t run = 0; run < BENCH_RUNS; ++run) {                             \
+            uint64_t insert_time = 0;                                               \
+            uint64_t hit_time = 0;                                                  \
+            uint64_t miss_time = 0;                                                 \
+            size_t sink = 0;                                                        \
+                                                                                    \
+            for (size_t r = 0; r < rounds; ++r) {                                   \
+                m##_t(n) hm = m##_empty(heap_allocator_handle());                   \
+                uint64_t start = now_ns();                                          \
+                                                                                    \
+                for (size_t i = 0; i < count; ++i) {                                \
+                    m##_insert(n, &hm, keys[i], i);                                 \
+                }                                                                   \
+                insert_time += now_ns() - start;                                    \
+                start = now_ns();                                                   \
+                for (size_t i = 0; i < count; ++i) {                                \
+                    sink += m##_find(n, &hm, keys[i]);                              \
+                }                                                                   \
+                hit_time += now_ns() - start;                                       \
+                start = now_ns();                                                   \
+                for (size_t i = 0; i < count; ++i) {                                \
+                    sink += m##_find(n, &hm, missing[i]);                           \
+                }                                                                   \
+                miss_time += now_ns() - start;                                      \
+                m##_destroy(n, &hm);                                                \
+            }                                                                       \
+            bench_sink += sink;                                                     \
+            res->insert_ns = MIN(res->insert_ns, (double)insert_time / ops);        \
+            res->hit_ns = MIN(res->hit_ns, (double)hit_time / ops);                 \
+            res->miss_ns = MIN(res->miss_ns, (double)miss_time / ops);              \
+        }                                                                           \
+    }
+
+MAKE_BENCH(hash_map, bench_pow2)
+MAKE_BENCH(hash_map, bench_fastrange)
+MAKE_BENCH(hash_map, bench_modulo)
+MAKE_BENCH(flat_hash_map, bench_flat)
+MAKE_BENCH(hash_map, bench_aos)
+
+/**
+ * Define a function timing lookups which read the value they find, @p queries mixing hits and misses
+ */
+#define MAKE_LAYOUT_BENCH(n)                                                        \
+    static double bench_layout_##n(                                                 \
+        const uint64_t *keys,                                                       \
+        const uint64_t *queries,                                                    \
+        size_t count                                                                \
+    )                                                                               \
+    {                                                                               \
+        hash_map_t(n) hm = hash_map_empty(heap_allocator_handle());                 \
+        size_t rounds = MAX((size_t)1, BENCH_MIN_OPS / count);                      \
+        double ops = (double)(rounds * count);                                      \
+        double best = 1e30;                                                         \
+                                                                                    \
+        for (size_t i = 0; i < count; ++i) {                                        \
+            hash_map_insert(n, &hm, keys[i], i);                                    \
+        }                                                                           \
+        for (size_t run = 0; run < BENCH_RUNS; ++run) {                             \
+            uint64_t start = now_ns();                                              \
+            size_t sink = 0;                                                        \
+                                                                                    \
+            for (size_t r = 0; r < rounds; ++r) {                                   \
+                for (size_t i = 0; i < count; ++i) {                                \
+                    size_t pos = hash_map_find(n, &hm, queries[i]);                 \
+                                                                                    \
+                    if (pos != hash_map_npos) {                                     \
+                        sink += hash_map_value_at(&hm, pos);                        \
+                    }                                                               \
+                }                                                                   \
+            }                                                                       \
+            best = MIN(best, (double)(now_ns() - start) / ops);                     \
+            bench_sink += sink;                                                     \
+        }                                                                           \
+        hash_map_destroy(n, &hm);                                                   \
+        return best;                                                                \
+    }
+
+MAKE_LAYOUT_BENCH(bench_pow2)
+MAKE_LAYOUT_BENCH(bench_aos)
+
+/**
+ * Compare both layouts on lookups hitting a given percentage of the time
+ */
+static void bench_layouts(
+    const uint64_t *keys,
+    const uint64_t *missing,
+    size_t count,
+    unsigned int hit_percent,
+    struct bench_result *res
+)
+{
+    uint64_t *queries = allocator_new_array(heap_allocator_handle(), uint64_t, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        queries[i] = i % 100 < hit_percent ? keys[(i * 7) % count] : missing[i];
+    }
+    *res = (struct bench_result){1e30, 1e30, 1e30};
+    res->insert_ns = bench_layout_bench_pow2(keys, queries, count);
+    res->hit_ns = bench_layout_bench_aos(keys, queries, count);
+    allocator_delete_array(heap_allocator_handle(), queries, uint64_t, count);
+}
+
+/**
+ * Insert and look up all the keys in batches, using the default policy
+ */
+static void bench_batch(const uint64_t *keys, const uint64_t *missing, size_t count, struct bench_result *res)
+{
+    size_t rounds = MAX((size_t)1, BENCH_MIN_OPS / count);
+    double ops = (double)(rounds * count);
+    uint64_t *values = allocator_new_array(heap_allocator_handle(), uint64_t, count);
+    size_t *positions = allocator_new_array(heap_allocator_handle(), size_t, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = i;
+    }
+    *res = (struct bench_result){1e30, 1e30, 1e30};
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        uint64_t insert_time = 0;
+        uint64_t hit_time = 0;
+        uint64_t miss_time = 0;
+        size_t sink = 0;
+
+        for (size_t r = 0; r < rounds; ++r) {
+            hash_map_t(bench_pow2) hm = hash_map_empty(heap_allocator_handle());
+            uint64_t start = now_ns();
+
+            hash_map_insert_batch(bench_pow2, &hm, keys, values, count);
+            insert_time += now_ns() - start;
+            start = now_ns();
+            hash_map_find_batch(bench_pow2, &hm, keys, count, positions);
+            hit_time += now_ns() - start;
+            sink += positions[count - 1];
+            start = now_ns();
+            hash_map_find_batch(bench_pow2, &hm, missing, count, positions);
+            miss_time += now_ns() - start;
+            sink += positions[count - 1];
+            hash_map_destroy(bench_pow2, &hm);
+        }
+        bench_sink += sink;
+        res->insert_ns = MIN(res->insert_ns, (double)insert_time / ops);
+        res->hit_ns = MIN(res->hit_ns, (double)hit_time / ops);
+        res->miss_ns = MIN(res->miss_ns, (double)miss_time / ops);
+    }
+    allocator_delete_array(heap_allocator_handle(), values, uint64_t, count);
+    allocator_delete_array(heap_allocator_handle(), positions, size_t, count);
+}
+
+/**
+ * Churn through a sliding window of keys, then look all the live ones up
+ */
+static void bench_churn(uint64_t *keys, size_t count, bool backward_shift, struct bench_result *res)
+{
+    *res = (struct bench_result){1e30, 1e30, 1e30};
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        hash_map_t(bench_pow2) hm = hash_map_empty(heap_allocator_handle());
+        uint64_t state = count;
+        size_t churn = BENCH_CHURN_FACTOR * count;
+        size_t sink = 0;
+        uint64_t start;
+
+        hash_map_set_backward_shift(&hm, backward_shift);
+        for (size_t i = 0; i < count; ++i) {
+            hash_map_insert(bench_pow2, &hm, keys[i], i);
+        }
+        start = now_ns();
+        for (size_t i = 0; i < churn; ++i) {
+            uint64_t key = splitmix64(&state) | 1;
+
+            hash_map_erase(bench_pow2, &hm, keys[i % count]);
+            hash_map_insert(bench_pow2, &hm, key, i);
+            /* The window of live keys is kept in the key array itself */
+            keys[i % count] = key;
+        }
+        res->insert_ns = MIN(res->insert_ns, (double)(now_ns() - start) / (double)churn);
+        start = now_ns();
+        for (size_t i = 0; i < count; ++i) {
+            sink += hash_map_find(bench_pow2, &hm, keys[i]);
+        }
+        res->hit_ns = MIN(res->hit_ns, (double)(now_ns() - start) / (double)count);
+        bench_sink += sink;
+        hash_map_destroy(bench_pow2, &hm);
+    }
+}
+
+/**
+ * Time every insertion into a growing map, keeping the average and the worst one
+ */
+static void bench_resizing(const uint64_t *keys, size_t count, bool incremental, struct bench_result *res)
+{
+    *res = (struct bench_result){1e30, 1e30, 1e30};
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        hash_map_t(bench_pow2) hm = hash_map_empty(heap_allocator_handle());
+        uint64_t total = 0;
+        uint64_t worst = 0;
+
+        hash_map_set_incremental_resize(&hm, incremental);
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t start = now_ns();
+            uint64_t elapsed;
+
+            hash_map_insert(bench_pow2, &hm, keys[i], i);
+            elapsed = now_ns() - start;
+            total += elapsed;
+            worst = MAX(worst, elapsed);
+        }
+        res->insert_ns = MIN(res->insert_ns, (double)total / (double)count);
+        res->hit_ns = MIN(res->hit_ns, (double)worst);
+        hash_map_destroy(bench_pow2, &hm);
+    }
+}
+
+/**
+ * Time a full iteration over a map, testing every slot or using hash_map_for_each
+ */
+static void bench_iteration_once(const hash_map_t(bench_pow2) *hm, struct bench_result *res)
+{
+    double elements = (double)MAX((size_t)1, hash_map_size(hm));
+    size_t sink = 0;
+    uint64_t start;
+
+    start = now_ns();
+    for (size_t i = 0; i < hash_map_capacity(hm); ++i) {
+        if (!_hash_map_is_empty_slot(hm->hashes[i]) && !_hash_map_is_tombstone(hm->hashes[i])) {
+            sink += hm->values[i];
+        }
+    }
+    res->insert_ns = MIN(res->insert_ns, (double)(now_ns() - start) / elements);
+    start = now_ns();
+    hash_map_for_each(hm, pos) {
+        sink += hash_map_value_at(hm, pos);
+    }
+    res->hit_ns = MIN(res->hit_ns, (double)(now_ns() - start) / elements);
+    bench_sink += sink;
+}
+
+static void bench_iteration(const uint64_t *keys, size_t count, struct bench_result *res)
+{
+    hash_map_t(bench_pow2) hm = hash_map_empty(heap_allocator_handle());
+
+    res[0] = (struct bench_result){1e30, 1e30, 1e30};
+    res[1] = (struct bench_result){1e30, 1e30, 1e30};
+    hash_map_set_backward_shift(&hm, true);
+    for (size_t i = 0; i < count; ++i) {
+        hash_map_insert(bench_pow2, &hm, keys[i], i);
+    }
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        bench_iteration_once(&hm, &res[0]);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 16 != 0) {
+            hash_map_erase(bench_pow2, &hm, keys[i]);
+        }
+    }
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        bench_iteration_once(&hm, &res[1]);
+    }
+    hash_map_destroy(bench_pow2, &hm);
+}
+
+struct bench_thread
+{
+    pthread_t thread;
+    const uint64_t *keys;
+    size_t count;
+    size_t first;
+    size_t step;
+    pthread_mutex_t *lock;
+    hash_map_t(bench_pow2) *hm;
+    concurrent_hash_map_t(bench_chm) *chm;
+    rcu_hash_map_t(bench_rcu) *rcu;
+    atomic_bool *done;
+    size_t sink;
+};
+
+/* Every thread upserts its share of the keys, looking up another key after each upsert */
+static void *bench_locked_main(void *data)
+{
+    struct bench_thread *bt = data;
+    size_t sink = 0;
+
+    for (size_t i = bt->first; i < bt->count; i += bt->step) {
+        pthread_mutex_lock(bt->lock);
+        *hash_map_try_emplace(bench_pow2, bt->hm, bt->keys[i], NULL) = i;
+        pthread_mutex_unlock(bt->lock);
+        pthread_mutex_lock(bt->lock);
+        sink += hash_map_find(bench_pow2, bt->hm, bt->keys[(i * 7) % bt->count]);
+        pthread_mutex_unlock(bt->lock);
+    }
+    /* Written once, not to share the cache line of the other threads all along */
+    bt->sink = sink;
+    return NULL;
+}
+
+static void *bench_sharded_main(void *data)
+{
+    struct bench_thread *bt = data;
+    size_t sink = 0;
+    uint64_t value;
+
+    for (size_t i = bt->first; i < bt->count; i += bt->step) {
+        concurrent_hash_map_upsert(bench_chm, bt->chm, bt->keys[i], i);
+        sink += concurrent_hash_map_find(bench_chm, bt->chm, bt->keys[(i * 7) % bt->count], &value);
+    }
+    /* Written once, not to share the cache line of the other threads all along */
+    bt->sink = sink;
+    return NULL;
+}
+
+/* Every thread looks up its share of the keys */
+static void *bench_sharded_reader_main(void *data)
+{
+    struct bench_thread *bt = data;
+    size_t sink = 0;
+    uint64_t value;
+
+    for (size_t i = bt->first; i < bt->count; i += bt->step) {
+        sink += concurrent_hash_map_find(bench_chm, bt->chm, bt->keys[i], &value);
+    }
+    /* Written once, not to share the cache line of the other threads all along */
+    bt->sink = sink;
+    return NULL;
+}
+
+static void *bench_rcu_reader_main(void *data)
+{
+    struct bench_thread *bt = data;
+    size_t sink = 0;
+    uint64_t value;
+
+    for (size_t i = bt->first; i < bt->count; i += bt->step) {
+        sink += rcu_hash_map_find(bench_rcu, bt->rcu, bt->keys[i], &value);
+    }
+    /* Written once, not to share the cache line of the other threads all along */
+    bt->sink = sink;
+    return NULL;
+}
+
+/* Update a key of both maps, pausing in between, until the readers are done */
+static void *bench_writer_main(void *data)
+{
+    struct bench_thread *bt = data;
+    struct timespec pause = {0, BENCH_WRITER_PAUSE_NS};
+
+    for (size_t i = 0; !atomic_load(bt->done); ++i) {
+        concurrent_hash_map_upsert(bench_chm, bt->chm, bt->keys[i % bt->count], i);
+        rcu_hash_map_upsert(bench_rcu, bt->rcu, bt->keys[i % bt->count], i);
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+static double bench_threads_run(
+    struct bench_thread *threads,
+    size_t thread_count,
+    void *(*fn)(void *),
+    size_t ops_per_key
+)
+{
+    uint64_t start = now_ns();
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        pthread_create(&threads[i].thread, NULL, fn, &threads[i]);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        bench_sink += threads[i].sink;
+    }
+    return (double)(now_ns() - start) / (double)(ops_per_key * threads[0].count);
+}
+
+/**
+ * Compare a hash map behind a global mutex with a concurrent hash map, using a given amount of threads
+ */
+static void bench_threads(const uint64_t *keys, size_t count, size_t thread_count, struct bench_result *res)
+{
+    struct bench_thread threads[BENCH_MAX_THREADS];
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+    *res = (struct bench_result){1e30, 1e30, 1e30};
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        hash_map_t(bench_pow2) hm = hash_map_empty(heap_allocator_handle());
+        concurrent_hash_map_t(bench_chm) chm;
+
+        concurrent_hash_map_init(bench_chm, &chm, heap_allocator_handle(), BENCH_SHARDS);
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads[i] = (struct bench_thread){
+                0, keys, count, i, thread_count, &lock, &hm, &chm, NULL, NULL, 0
+            };
+        }
+        res->insert_ns = MIN(res->insert_ns, bench_threads_run(threads, thread_count, &bench_locked_main, 2));
+        res->hit_ns = MIN(res->hit_ns, bench_threads_run(threads, thread_count, &bench_sharded_main, 2));
+        hash_map_destroy(bench_pow2, &hm);
+        concurrent_hash_map_destroy(bench_chm, &chm);
+    }
+}
+
+/**
+ * Compare a concurrent hash map with an RCU hash map, with a given amount of threads looking up all the keys
+ * while another one updates them
+ */
+static void bench_readers(const uint64_t *keys, size_t count, size_t thread_count, struct bench_result *res)
+{
+    struct bench_thread threads[BENCH_MAX_THREADS];
+    struct bench_thread writer;
+    concurrent_hash_map_t(bench_chm) chm;
+    rcu_hash_map_t(bench_rcu) rcu;
+    hash_map_t(rcu_bench_rcu) *draft;
+    atomic_bool done;
+
+    concurrent_hash_map_init(bench_chm, &chm, heap_allocator_handle(), BENCH_SHARDS);
+    rcu_hash_map_init(bench_rcu, &rcu, heap_allocator_handle());
+    draft = rcu_hash_map_update_begin(bench_rcu, &rcu);
+    for (size_t i = 0; i < count; ++i) {
+        concurrent_hash_map_upsert(bench_chm, &chm, keys[i], i);
+        hash_map_insert(rcu_bench_rcu, draft, keys[i], i);
+    }
+    rcu_hash_map_update_commit(bench_rcu, &rcu);
+
+    *res = (struct bench_result){1e30, 1e30, 1e30};
+    writer = (struct bench_thread){0, keys, count, 0, 1, NULL, NULL, &chm, &rcu, &done, 0};
+    atomic_init(&done, false);
+    pthread_create(&writer.thread, NULL, &bench_writer_main, &writer);
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads[i] = (struct bench_thread){
+                0, keys, count, i, thread_count, NULL, NULL, &chm, &rcu, NULL, 0
+            };
+        }
+        res->insert_ns = MIN(res->insert_ns,
+                             bench_threads_run(threads, thread_count, &bench_sharded_reader_main, 1));
+        res->hit_ns = MIN(res->hit_ns, bench_threads_run(threads, thread_count, &bench_rcu_reader_main, 1));
+    }
+    atomic_store(&done, true);
+    pthread_join(writer.thread, NULL);
+    concurrent_hash_map_destroy(bench_chm, &chm);
+    rcu_hash_map_destroy(bench_rcu, &rcu);
+}
+
+static void bench_size(size_t count)
+{
+    uint64_t *keys = allocator_new_array(heap_allocator_handle(), uint64_t, count);
+    uint64_t *missing = allocator_new_array(heap_allocator_handle(), uint64_t, count);
+    uint64_t state = count;
+    struct bench_result results[6];
+    static const char *names[] = {"pow2", "fastrange", "modulo", "flat", "batch", "aos"};
+
+    /* Keys have their low bit set and missing keys have it cleared, so that they never collide */
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = splitmix64(&state) | 1;
+        missing[i] = splitmix64(&state) & ~(uint64_t)1;
+    }
+    bench_bench_pow2(keys, missing, count, &results[0]);
+    bench_bench_fastrange(keys, missing, count, &results[1]);
+    bench_bench_modulo(keys, missing, count, &results[2]);
+    bench_bench_flat(keys, missing, count, &results[3]);
+    bench_batch(keys, missing, count, &results[4]);
+    bench_bench_aos(keys, missing, count, &results[5]);
+
+    for (size_t i = 0; i < array_length(results); ++i) {
+        printf("%10zu  %-10s  %10.2f  %10.2f  %10.2f\n", count, names[i],
+               results[i].insert_ns, results[i].hit_ns, results[i].miss_ns);
+    }
+
+    bench_resizing(keys, count, false, &results[0]);
+    bench_resizing(keys, count, true, &results[1]);
+    printf("%10zu  %-10s  %10.2f  %10.0f\n", count, "rehash", results[0].insert_ns, results[0].hit_ns);
+    printf("%10zu  %-10s  %10.2f  %10.0f\n", count, "amortized", results[1].insert_ns, results[1].hit_ns);
+
+    bench_layouts(keys, missing, count, 90, &results[0]);
+    bench_layouts(keys, missing, count, 10, &results[1]);
+    printf("%10zu  %-10s  %10.2f  %10.2f\n", count, "hit-heavy", results[0].insert_ns, results[0].hit_ns);
+    printf("%10zu  %-10s  %10.2f  %10.2f\n", count, "miss-heavy", results[1].insert_ns, results[1].hit_ns);
+
+    bench_iteration(keys, count, results);
+    printf("%10zu  %-10s  %10.2f  %10.2f\n", count, "full", results[0].insert_ns, results[0].hit_ns);
+    printf("%10zu  %-10s  %10.2f  %10.2f\n", count, "sparse", results[1].insert_ns, results[1].hit_ns);
+
+    bench_churn(keys, count, false, &results[0]);
+    bench_churn(keys, count, true, &results[1]);
+    printf("%10zu  %-10s  %10.2f  %10.2f\n", count, "tombstone", results[0].insert_ns, results[0].hit_ns);
+    printf("%10zu  %-10s  %10.2f  %10.2f\n", count, "shift", results[1].insert_ns, results[1].hit_ns);
+
+    for (size_t threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        char name[16];
+
+        bench_threads(keys, count, threads, &results[0]);
+        snprintf(name, sizeof(name), "%zu thr", threads);
+        printf("%10zu  %-10s  %10.2f  %10.2f\n", count, name, results[0].insert_ns, results[0].hit_ns);
+    }
+    for (size_t threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        char name[16];
+
+        bench_readers(keys, count, threads, &results[0]);
+        snprintf(name, sizeof(name), "%zu rdr", threads);
+        printf("%10zu  %-10s  %10.2f  %10.2f\n", count, name, results[0].insert_ns, results[0].hit_ns);
+    }
+    allocator_delete_array(heap_allocator_handle(), keys, uint64_t, count);
+    allocator_delete_array(heap_allocator_handle(), missing, uint64_t, count);
+}
+
+int main(int ac, char **av)
+{
+    static const size_t default_sizes[] = {1000, 100000, 1000000};
+
+    printf("%10s  %-10s  %10s  %10s  %10s\n", "size", "policy", "insert", "hit", "miss");
+    printf("%10s  %-10s  %10s  %10s\n", "", "(resizing)", "insert", "worst");
+    printf("%10s  %-10s  %10s  %10s\n", "", "(layout)", "soa", "aos");
+    printf("%10s  %-10s  %10s  %10s\n", "", "(iteration)", "by hand", "for_each");
+    printf("%10s  %-10s  %10s  %10s\n", "", "(erasure)", "churn", "hit");
+    printf("%10s  %-10s  %10s  %10s\n", "", "(threads)", "mutex", "sharded");
+    printf("%10s  %-10s  %10s  %10s\n", "", "(readers)", "sharded", "rcu");
+    if (ac > 1) {
+        for (int i = 1; i < ac; ++i) {
+            bench_size(strtoul(av[i], NULL, 10));
+        }
+    } else {
+        for (size_t i = 0; i < array_length(default_sizes); ++i) {
+            bench_size(default_sizes[i]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <pthread.h>
+#include <time.h>
+#include <ceeds/concurrent_pool_allocator.h>
+#include <ceeds/pool_allocator.h>
+
+/**
+ * Pool allocator benchmarks
+ *
+ * Compares the throughput of a pool allocator behind a global mutex with a concurrent pool allocator, with
+ * threads each keeping a few objects alive and replacing them in turn (one deallocation and one allocation
+ * per operation). Every figure is the best of a few runs, in millions of operations per second of wall-clock
+ * time over all threads.
+ *
+ * Usage: ceeds-pool-allocator-bench [operations per thread]
+ */
+
+#define BENCH_RUNS                  3
+#define BENCH_DEFAULT_OPS           ((size_t)4 * 1024 * 1024)
+#define BENCH_MAX_THREADS           8
+#define BENCH_LIVE_OBJECTS          16
+#define BENCH_OBJECT_SIZE           64
+
+struct bench_object
+{
+    char data[BENCH_OBJECT_SIZE];
+};
+
+struct bench_thread
+{
+    pthread_t thread;
+    memory_allocator_handle_t handle;
+    pthread_mutex_t *lock;
+    size_t ops;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void *bench_locked_main(void *data)
+{
+    struct bench_thread *bt = data;
+    void *live[BENCH_LIVE_OBJECTS] = {NULL};
+
+    for (size_t i = 0; i < bt->ops; ++i) {
+        size_t slot = i % array_length(live);
+
+        pthread_mutex_lock(bt->lock);
+        allocator_delete(bt->handle, live[slot]);
+        live[slot] = allocator_new(bt->handle, struct bench_object);
+        pthread_mutex_unlock(bt->lock);
+    }
+    pthread_mutex_lock(bt->lock);
+    for (size_t i = 0; i < array_length(live); ++i) {
+        allocator_delete(bt->handle, live[i]);
+    }
+    pthread_mutex_unlock(bt->lock);
+    return NULL;
+}
+
+static void *bench_concurrent_main(void *data)
+{
+    struct bench_thread *bt = data;
+    void *live[BENCH_LIVE_OBJECTS] = {NULL};
+
+    for (size_t i = 0; i < bt->ops; ++i) {
+        size_t slot = i % array_length(live);
+
+        allocator_delete(bt->handle, live[slot]);
+        live[slot] = allocator_new(bt->handle, struct bench_object);
+    }
+    for (size_t i = 0; i < array_length(live); ++i) {
+        allocator_delete(bt->handle, live[i]);
+    }
+    return NULL;
+}
+
+static double bench_run(struct bench_thread *threads, size_t thread_count, void *(*fn)(void *))
+{
+    uint64_t start = now_ns();
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        pthread_create(&threads[i].thread, NULL, fn, &threads[i]);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    return (double)(thread_count * threads[0].ops) * 1000.0 / (double)(now_ns() - start);
+}
+
+static void bench_threads(size_t ops, size_t thread_count)
+{
+    struct bench_thread threads[BENCH_MAX_THREADS];
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    double locked = 0;
+    double concurrent = 0;
+
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        pool_allocator_t pool;
+        concurrent_pool_allocator_t cpool;
+
+        pool_allocator_init(&pool, heap_allocator_handle(), sizeof(struct bench_object),
+                            alignof(struct bench_object));
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads[i] = (struct bench_thread){0, pool_allocator_handle(&pool), &lock, ops};
+        }
+        locked = MAX(locked, bench_run(threads, thread_count, &bench_locked_main));
+        pool_allocator_destroy(&pool);
+
+        if (concurrent_pool_allocator_init(&cpool, heap_allocator_handle(), sizeof(struct bench_object),
+                                           alignof(struct bench_object)) != 0) {
+            fprintf(stderr, "could not initialize the concurrent pool\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads[i] = (struct bench_thread){0, concurrent_pool_allocator_handle(&cpool), NULL, ops};
+        }
+        concurrent = MAX(concurrent, bench_run(threads, thread_count, &bench_concurrent_main));
+        concurrent_pool_allocator_destroy(&cpool);
+    }
+    printf("%10zu  %10.2f  %10.2f\n", thread_count, locked, concurrent);
+}
+
+int main(int ac, char **av)
+{
+    size_t ops = ac > 1 ? strtoul(av[1], NULL, 10) : BENCH_DEFAULT_OPS;
+
+    printf("%10s  %10s  %10s\n", "threads", "mutex", "concurrent");
+    for (size_t threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        bench_threads(ops, threads);
+    }
+    return 0;
+}
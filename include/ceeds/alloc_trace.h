@@ -0,0 +1,57 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_ALLOC_TRACE_H
+#define CEEDS_ALLOC_TRACE_H
+
+#include <ceeds/core.h>
+
+/**
+ * Allocation traces
+ *
+ * A trace is a stream of fixed-size, native-endian records, following an ALLOC_TRACE_MAGIC header. Records are
+ * written per thread in batches, so they are ordered within a thread but interleaved between threads: their
+ * sequence numbers give the order of calls across threads.
+ */
+
+#define ALLOC_TRACE_MAGIC           "CEEDSAT2"
+#define ALLOC_TRACE_MAGIC_SIZE      8
+
+enum alloc_trace_op
+{
+    ALLOC_TRACE_ALLOCATE,
+    ALLOC_TRACE_ZERO_ALLOCATE,
+    ALLOC_TRACE_DEALLOCATE,
+    ALLOC_TRACE_REALLOCATE,
+    ALLOC_TRACE_OP_COUNT,
+};
+
+/**
+ * A traced allocator call
+ *
+ * For deallocations, @c ptr is the freed pointer and @c size its size. For reallocations, @c old_ptr and
+ * @c old_size describe the block that was resized into @c ptr.
+ *
+ * Sequence numbers are taken once a block is obtained and before it is given back, so that a pointer is always
+ * freed before it can be handed out again. A reallocation both gives a block back and obtains one: @c old_seq
+ * is taken before the call, and @c seq after it.
+ */
+struct alloc_trace_record
+{
+    uint64_t seq;
+    uint64_t old_seq;
+    uint64_t timestamp_ns;
+    uint64_t ptr;
+    uint64_t old_ptr;
+    uint64_t size;
+    uint64_t old_size;
+    uint32_t thread;
+    uint8_t op;
+    uint8_t align_log2;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(struct alloc_trace_record) == 64, "trace records must have a stable layout");
+
+#endif /* !CEEDS_ALLOC_TRACE_H */
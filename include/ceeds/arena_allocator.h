@@ -0,0 +1,117 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_ARENA_ALLOCATOR_H
+#define CEEDS_ARENA_ALLOCATOR_H
+
+#include <ceeds/memory.h>
+
+/**
+ * Arena (bump) allocators
+ *
+ * Memory is carved out of chained blocks by bumping a pointer. Individual deallocations are no-ops (except
+ * for the most recent allocation, which can be rolled back), and memory is reclaimed all at once by rewinding
+ * the arena to a previously taken mark, or by resetting it.
+ */
+
+struct arena_block
+{
+    struct arena_block *prev;
+    size_t size;
+    alignas(max_align_t) char data[];
+};
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t backing;
+    size_t block_size;
+    struct arena_block *block;
+    struct arena_block *spare;
+    char *cur;
+    char *end;
+    char *last;
+} arena_allocator_t;
+
+/**
+ * A position in an arena, which can later be rewound to
+ */
+typedef struct
+{
+    struct arena_block *block;
+    char *cur;
+} arena_mark_t;
+
+/**
+ * Initialize an arena allocator
+ *
+ * @param[out]      arena           the arena to initialize
+ * @param[in]       backing         the allocator handle used to allocate the blocks of the arena
+ * @param[in]       block_size      the usable size of the blocks of the arena
+ */
+void arena_allocator_init(arena_allocator_t *arena, memory_allocator_handle_t backing, size_t block_size);
+
+/**
+ * Initialize an arena allocator over a fixed buffer
+ *
+ * The arena never allocates any block: allocations fail (returning NULL) once the buffer is exhausted.
+ *
+ * @param[out]      arena           the arena to initialize
+ * @param[in]       buffer          the buffer to carve allocations out of
+ * @param[in]       size            the size of @p buffer
+ *
+ * @pre                             @p buffer must outlive the arena
+ */
+void arena_allocator_init_with_buffer(arena_allocator_t *arena, void *buffer, size_t size);
+
+/**
+ * Destroy an arena allocator, releasing all its blocks
+ *
+ * @param[in,out]   arena           the arena to destroy
+ */
+void arena_allocator_destroy(arena_allocator_t *arena);
+
+/**
+ * Get a handle to an arena allocator
+ *
+ * @param[in]       arena_ptr       a pointer to the arena
+ */
+#define arena_allocator_handle(arena_ptr)   (&(arena_ptr)->base)
+
+/**
+ * Get the current position of an arena, to be used with arena_allocator_rewind
+ *
+ * @param[in]       arena           the arena
+ * @return                          a mark representing the current position of the arena
+ */
+static inline arena_mark_t arena_allocator_mark(const arena_allocator_t *arena)
+{
+    return (arena_mark_t){arena->block, arena->cur};
+}
+
+/**
+ * Rewind an arena to a given mark, releasing everything allocated since that mark was taken
+ *
+ * @param[in,out]   arena           the arena to rewind
+ * @param[in]       mark            the mark to rewind to
+ *
+ * @pre                             @p mark must have been obtained from @p arena, and no earlier mark must have
+ *                                  been rewound to since then
+ */
+void arena_allocator_rewind(arena_allocator_t *arena, arena_mark_t mark);
+
+/**
+ * Reset an arena, releasing everything allocated from it
+ *
+ * Blocks of the default size are kept for reuse, so that a reset arena does not need to go through its
+ * backing allocator again.
+ *
+ * @param[in,out]   arena           the arena to reset
+ */
+static inline void arena_allocator_reset(arena_allocator_t *arena)
+{
+    arena_allocator_rewind(arena, (arena_mark_t){NULL, NULL});
+}
+
+#endif /* !CEEDS_ARENA_ALLOCATOR_H */
@@ -128,8 +128,9 @@
     do {                                                                    \
         typeof(heap_ptr) __heap_ptr = (heap_ptr);                           \
                                                                             \
-        vector_push_back(__heap_ptr, e);                                    \
-        _bheap_push_up(__heap_ptr, __heap_ptr->size - 1, cmp);              \
+        if likely(vector_push_back(__heap_ptr, e) == 0) {                   \
+            _bheap_push_up(__heap_ptr, __heap_ptr->size - 1, cmp);          \
+        }                                                                   \
     } while (0)
 
 /**
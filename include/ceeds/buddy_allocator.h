@@ -0,0 +1,103 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_BUDDY_ALLOCATOR_H
+#define CEEDS_BUDDY_ALLOCATOR_H
+
+#include <ceeds/list.h>
+#include <ceeds/memory.h>
+
+/**
+ * Buddy allocators
+ *
+ * A buddy allocator manages a fixed region, obtained once from a backing allocator, by recursively splitting
+ * it in halves: every block has a power-of-two size, from the minimal block size up to the whole region.
+ * A freed block is merged with its buddy (the other half of the block they were split from) whenever the
+ * latter is free too, so that free memory does not stay fragmented. Splitting and merging both take
+ * O(log n) steps, where n is the number of minimal blocks in the region.
+ *
+ * Blocks grow in place as long as the blocks following them are free buddies, and shrink in place by giving
+ * their upper halves back, which suits container buffers that keep growing and shrinking.
+ *
+ * Blocks are aligned on their size, up to BUDDY_MAX_ALIGN bytes. No header is stored next to them: the order
+ * of each block is kept in a separate table, with one byte per minimal block.
+ */
+
+#define BUDDY_MAX_ORDERS            48
+#define BUDDY_MAX_ALIGN             ((size_t)4096)
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t backing;
+    char *region;
+    size_t region_size;
+    unsigned int min_block_shift;
+    unsigned int max_order;
+    uint8_t *block_orders;
+    size_t allocated_bytes;
+    size_t free_counts[BUDDY_MAX_ORDERS];
+    list_t free_lists[BUDDY_MAX_ORDERS];
+} buddy_allocator_t;
+
+/**
+ * Statistics about the state of a buddy allocator
+ */
+struct buddy_stats
+{
+    /** The size of the region */
+    size_t total_bytes;
+    /** The amount of bytes in allocated blocks (which may be more than what was requested) */
+    size_t allocated_bytes;
+    /** The amount of bytes in free blocks */
+    size_t free_bytes;
+    /** The size of the biggest free block, i.e. of the biggest allocation that can currently succeed */
+    size_t largest_free_block;
+    /** The number of free blocks */
+    size_t free_blocks;
+    /** The external fragmentation, as the share of free memory which is not in the biggest free block */
+    double fragmentation;
+};
+
+/**
+ * Initialize a buddy allocator
+ *
+ * @param[out]      ba              the allocator to initialize
+ * @param[in]       backing         the allocator handle used to allocate the region and its bookkeeping
+ * @param[in]       region_size     the size of the region to manage, rounded up to a power of 2
+ * @param[in]       min_block_size  the size of the smallest blocks, rounded up to a power of 2
+ * @return                          0 on success, -1 if the region could not be allocated
+ *
+ * @pre                             @p min_block_size must not be greater than @p region_size
+ */
+int buddy_allocator_init(
+    buddy_allocator_t *ba,
+    memory_allocator_handle_t backing,
+    size_t region_size,
+    size_t min_block_size
+);
+
+/**
+ * Destroy a buddy allocator, releasing its region
+ *
+ * @param[in,out]   ba              the allocator to destroy
+ */
+void buddy_allocator_destroy(buddy_allocator_t *ba);
+
+/**
+ * Get statistics about the state of a buddy allocator
+ *
+ * @param[in]       ba              the allocator
+ * @param[out]      stats           the statistics
+ */
+void buddy_allocator_stats(const buddy_allocator_t *ba, struct buddy_stats *stats);
+
+/**
+ * Get a handle to a buddy allocator
+ *
+ * @param[in]       ba_ptr          a pointer to the allocator
+ */
+#define buddy_allocator_handle(ba_ptr)      (&(ba_ptr)->base)
+
+#endif /* !CEEDS_BUDDY_ALLOCATOR_H */
@@ -0,0 +1,74 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_BUDGET_ALLOCATOR_H
+#define CEEDS_BUDGET_ALLOCATOR_H
+
+#include <ceeds/memory.h>
+
+/**
+ * Budget allocators
+ *
+ * A budget allocator caps the amount of bytes handed out through it, and serves requests from a chain of
+ * tiers: each allocation is attempted on every tier in order, until one of them succeeds. A typical chain is
+ * a fixed buffer (see arena_allocator_init_with_buffer), then an arena, then the heap: hot paths stay on the
+ * first tiers, and only the overflow reaches the last one.
+ *
+ * Requests which would exceed the budget fail, returning NULL, instead of reaching the tiers. Since the heap
+ * allocator never fails, it only makes sense as the last tier.
+ *
+ * Each block carries a small header recording its size and tier. The budget only accounts for the bytes
+ * given to the user, not for headers nor for the overhead of the tiers.
+ */
+
+#define BUDGET_ALLOCATOR_MAX_TIERS  4
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t tiers[BUDGET_ALLOCATOR_MAX_TIERS];
+    size_t tier_count;
+    size_t budget;
+    size_t used;
+} budget_allocator_t;
+
+/**
+ * Initialize a budget allocator
+ *
+ * @param[out]      ba              the allocator to initialize
+ * @param[in]       budget          the maximum amount of bytes that can be allocated at once
+ * @param[in]       tiers           the allocator handles to try, in order
+ * @param[in]       tier_count      the number of handles in @p tiers
+ *
+ * @pre                             @p tier_count must be between 1 and BUDGET_ALLOCATOR_MAX_TIERS
+ */
+void budget_allocator_init(
+    budget_allocator_t *ba,
+    size_t budget,
+    const memory_allocator_handle_t *tiers,
+    size_t tier_count
+);
+
+/**
+ * Get a handle to a budget allocator
+ *
+ * @param[in]       ba_ptr          a pointer to the allocator
+ */
+#define budget_allocator_handle(ba_ptr)     (&(ba_ptr)->base)
+
+/**
+ * Get the amount of bytes currently allocated from a budget allocator
+ *
+ * @param[in]       ba_ptr          a pointer to the allocator
+ */
+#define budget_allocator_used(ba_ptr)       ((ba_ptr)->used)
+
+/**
+ * Get the amount of bytes that can still be allocated from a budget allocator
+ *
+ * @param[in]       ba_ptr          a pointer to the allocator
+ */
+#define budget_allocator_remaining(ba_ptr)  ((ba_ptr)->budget - (ba_ptr)->used)
+
+#endif /* !CEEDS_BUDGET_ALLOCATOR_H */
@@ -0,0 +1,366 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_CONCURRENT_HASH_MAP_H
+#define CEEDS_CONCURRENT_HASH_MAP_H
+
+#include <pthread.h>
+#include <ceeds/hash_map.h>
+
+/**
+ * Concurrent hash maps
+ *
+ * A concurrent hash map splits its elements between a power-of-2 amount of shards, each of which is a regular
+ * hash map guarded by its own reader-writer lock. The shard of a key is selected by the upper bits of its hash,
+ * which the hash maps themselves barely use to pick slots, so that every shard stays evenly loaded. Threads
+ * working on keys of different shards never wait for each other, and lookups only ever wait for writers.
+ * Shards are aligned to CONCURRENT_HASH_MAP_SHARD_ALIGN bytes, so that the locks of different shards never
+ * share a cache line.
+ *
+ * Positions are meaningless outside of the lock of their shard, so lookups copy values out, and updates are
+ * made either by replacing a value or through a callback run under the lock.
+ *
+ * Unlike hash_map_insert, inserting a key which is already in the map replaces its value.
+ */
+
+#define CONCURRENT_HASH_MAP_SHARD_ALIGN     64
+
+#define concurrent_hash_map_t(n)    concurrent_hash_map_##n##_t
+
+/**
+ * Initialize a concurrent hash map
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[out]      chm_ptr         a pointer to the concurrent hash map to initialize
+ * @param[in]       alloc_handle    the allocator handle used for the shards and their tables
+ * @param[in]       shard_count     the minimum amount of shards, rounded up to a power of 2
+ * @return                          0 on success, -1 if the shards or their locks could not be created
+ *
+ * @note                            A few shards per thread expected to use the map keep contention low.
+ *                                  The allocator must be usable from every thread using the map.
+ */
+#define concurrent_hash_map_init(n, chm_ptr, alloc_handle, shard_count)             \
+    _concurrent_hash_map_init_##n(chm_ptr, alloc_handle, shard_count)
+
+/**
+ * Destroy a concurrent hash map
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in,out]   chm_ptr         a pointer to the concurrent hash map to destroy
+ *
+ * @pre                             no other thread must be using @p chm_ptr anymore
+ */
+#define concurrent_hash_map_destroy(n, chm_ptr)                                     \
+    _concurrent_hash_map_destroy_##n(chm_ptr)
+
+/**
+ * Get the amount of shards of a concurrent hash map
+ *
+ * @param[in]       chm_ptr         a pointer to the concurrent hash map
+ */
+#define concurrent_hash_map_shard_count(chm_ptr)                                    \
+    ((size_t)1 << (chm_ptr)->shard_bits)
+
+/**
+ * Get the size of a concurrent hash map (i.e. the number of elements in the map)
+ *
+ * Every shard is counted under its lock, but not all at the same time: while other threads modify the map,
+ * the result may not match any state the map was actually in.
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in]       chm_ptr         a pointer to the concurrent hash map
+ */
+#define concurrent_hash_map_size(n, chm_ptr)                                        \
+    _concurrent_hash_map_size_##n(chm_ptr)
+
+/**
+ * Look up a key in a concurrent hash map, copying its value out
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in]       chm_ptr         a pointer to the concurrent hash map
+ * @param[in]       key             the key to search for
+ * @param[out]      value_ptr       where to copy the value of the key if found, or NULL
+ * @return                          true if the key was found, false otherwise
+ */
+#define concurrent_hash_map_find(n, chm_ptr, key, value_ptr)                        \
+    _concurrent_hash_map_find_##n(chm_ptr, key, value_ptr)
+
+/**
+ * Insert an element into a concurrent hash map, or replace the value of its key if it is already there
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in,out]   chm_ptr         a pointer to the concurrent hash map
+ * @param[in]       key             the key of the element
+ * @param[in]       value           the value of the element
+ * @return                          true if the key was inserted, false if its value was replaced
+ */
+#define concurrent_hash_map_upsert(n, chm_ptr, key, value)                          \
+    _concurrent_hash_map_upsert_##n(chm_ptr, key, value)
+
+/**
+ * Update the value of a key in a concurrent hash map, inserting it first if it is not there
+ *
+ * @p update_fn is called under the lock of the shard of the key, with a pointer to its value (zeroed if the
+ * key was just inserted), whether it was just inserted, and @p ctx. It must not use the map.
+ *
+ * Example (counting occurrences):
+ * @code
+ * static void increment(int *count, bool inserted, void *ctx)
+ * {
+ *     ++*count;
+ * }
+ *
+ * concurrent_hash_map_update(counts, &chm, word, &increment, NULL);
+ * @endcode
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in,out]   chm_ptr         a pointer to the concurrent hash map
+ * @param[in]       key             the key whose value to update
+ * @param[in]       update_fn       the function updating the value
+ * @param[in]       ctx             the last argument to give to @p update_fn
+ * @return                          true if the key was inserted, false if it was already there
+ */
+#define concurrent_hash_map_update(n, chm_ptr, key, update_fn, ctx)                 \
+    _concurrent_hash_map_update_##n(chm_ptr, key, update_fn, ctx)
+
+/**
+ * Erase the element with a given key in a concurrent hash map
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in,out]   chm_ptr         a pointer to the concurrent hash map
+ * @param[in]       key             the key to erase
+ * @return                          true if the key was erased, false if it was not there
+ */
+#define concurrent_hash_map_erase(n, chm_ptr, key)                                  \
+    _concurrent_hash_map_erase_##n(chm_ptr, key)
+
+/**
+ * Visit all the elements of a concurrent hash map, one shard at a time
+ *
+ * Each shard is visited under its read lock: the elements seen from a given shard are exactly the ones it held
+ * at some point, and no element moves from one shard to another, but shards are not all seen at the same time.
+ * @p visit_fn is called with pointers to the key and the value of every element, and @p ctx. It must not use
+ * the map.
+ *
+ * @param           n               the name of the concurrent hash map type
+ * @param[in]       chm_ptr         a pointer to the concurrent hash map
+ * @param[in]       visit_fn        the function to call on every element
+ * @param[in]       ctx             the last argument to give to @p visit_fn
+ */
+#define concurrent_hash_map_visit(n, chm_ptr, visit_fn, ctx)                        \
+    _concurrent_hash_map_visit_##n(chm_ptr, visit_fn, ctx)
+
+/**
+ * Create a concurrent hash map type, whose shards use the HASH_MAP_POW2 capacity policy
+ *
+ * @param           n               the name of the concurrent hash map type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           ValueT          the type of the values to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_CONCURRENT_HASH_MAP_TYPE(n, KeyT, ValueT, key_hash, key_cmp)           \
+    MAKE_HASH_MAP_TYPE(chm_##n, KeyT, ValueT, key_hash, key_cmp);                   \
+                                                                                    \
+    typedef struct {                                                                \
+        alignas(CONCURRENT_HASH_MAP_SHARD_ALIGN) pthread_rwlock_t lock;             \
+        hash_map_t(chm_##n) map;                                                    \
+    } _concurrent_hash_map_shard_##n##_t;                                           \
+                                                                                    \
+    typedef struct {                                                                \
+        memory_allocator_handle_t alloc;                                            \
+        _concurrent_hash_map_shard_##n##_t *shards;                                 \
+        unsigned int shard_bits;                                                    \
+    } concurrent_hash_map_t(n);                                                     \
+                                                                                    \
+    static inline int _concurrent_hash_map_init_##n(                                \
+        concurrent_hash_map_t(n) *chm_ptr,                                          \
+        memory_allocator_handle_t alloc,                                            \
+        size_t shard_count                                                          \
+    )                                                                               \
+    {                                                                               \
+        size_t count;                                                               \
+                                                                                    \
+        chm_ptr->alloc = alloc;                                                     \
+        chm_ptr->shard_bits = 0;                                                    \
+        while (((size_t)1 << chm_ptr->shard_bits) < shard_count) {                  \
+            ++chm_ptr->shard_bits;                                                  \
+        }                                                                           \
+        count = concurrent_hash_map_shard_count(chm_ptr);                           \
+        chm_ptr->shards = allocator_new_array(                                      \
+            alloc, _concurrent_hash_map_shard_##n##_t, count                        \
+        );                                                                          \
+        if (chm_ptr->shards == NULL) {                                              \
+            return -1;                                                              \
+        }                                                                           \
+        for (size_t i = 0; i < count; ++i) {                                        \
+            if (pthread_rwlock_init(&chm_ptr->shards[i].lock, NULL) != 0) {         \
+                while (i-- > 0) {                                                   \
+                    pthread_rwlock_destroy(&chm_ptr->shards[i].lock);               \
+                }                                                                   \
+                allocator_delete_array(                                             \
+                    alloc, chm_ptr->shards, _concurrent_hash_map_shard_##n##_t,     \
+                    count                                                           \
+                );                                                                  \
+                return -1;                                                          \
+            }                                                                       \
+            chm_ptr->shards[i].map =                                                \
+                (hash_map_t(chm_##n))hash_map_empty(alloc);                         \
+        }                                                                           \
+        return 0;                                                                   \
+    }                                                                               \
+                                                                                    \
+    static inline void _concurrent_hash_map_destroy_##n(                            \
+        concurrent_hash_map_t(n) *chm_ptr                                           \
+    )                                                                               \
+    {                                                                               \
+        size_t count = concurrent_hash_map_shard_count(chm_ptr);                    \
+                                                                                    \
+        for (size_t i = 0; i < count; ++i) {                                        \
+            hash_map_destroy(chm_##n, &chm_ptr->shards[i].map);                     \
+            pthread_rwlock_destroy(&chm_ptr->shards[i].lock);                       \
+        }                                                                           \
+        allocator_delete_array(                                                     \
+            chm_ptr->alloc, chm_ptr->shards, _concurrent_hash_map_shard_##n##_t,    \
+            count                                                                   \
+        );                                                                          \
+    }                                                                               \
+                                                                                    \
+    static inline _concurrent_hash_map_shard_##n##_t *                              \
+    _concurrent_hash_map_shard_##n(                                                 \
+        const concurrent_hash_map_t(n) *chm_ptr,                                    \
+        hash_value_t hash                                                           \
+    )                                                                               \
+    {                                                                               \
+        /* Shifted twice, not to shift by the width of a hash with one shard */     \
+        unsigned int shift = bitsizeof(hash_value_t) - 1 - chm_ptr->shard_bits;     \
+                                                                                    \
+        return &chm_ptr->shards[(size_t)((hash >> 1) >> shift)];                    \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _concurrent_hash_map_size_##n(                             \
+        const concurrent_hash_map_t(n) *chm_ptr                                     \
+    )                                                                               \
+    {                                                                               \
+        size_t count = concurrent_hash_map_shard_count(chm_ptr);                    \
+        size_t size = 0;                                                            \
+                                                                                    \
+        for (size_t i = 0; i < count; ++i) {                                        \
+            pthread_rwlock_rdlock(&chm_ptr->shards[i].lock);                        \
+            size += hash_map_size(&chm_ptr->shards[i].map);                         \
+            pthread_rwlock_unlock(&chm_ptr->shards[i].lock);                        \
+        }                                                                           \
+        return size;                                                                \
+    }                                                                               \
+                                                                                    \
+    static inline bool _concurrent_hash_map_find_##n(                               \
+        const concurrent_hash_map_t(n) *chm_ptr,                                    \
+        KeyT const key,                                                             \
+        ValueT *value_ptr                                                           \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+        _concurrent_hash_map_shard_##n##_t *shard =                                 \
+            _concurrent_hash_map_shard_##n(chm_ptr, hash);                          \
+        size_t pos;                                                                 \
+                                                                                    \
+        pthread_rwlock_rdlock(&shard->lock);                                        \
+        pos = _hash_map_find_with_hash_chm_##n(&shard->map, hash, key);             \
+        if (pos != hash_map_npos && value_ptr != NULL) {                            \
+            *value_ptr = hash_map_value_at(&shard->map, pos);                       \
+        }                                                                           \
+        pthread_rwlock_unlock(&shard->lock);                                        \
+        return pos != hash_map_npos;                                                \
+    }                                                                               \
+                                                                                    \
+    static inline bool _concurrent_hash_map_upsert_##n(                             \
+        concurrent_hash_map_t(n) *chm_ptr,                                          \
+        KeyT key,                                                                   \
+        ValueT value                                                                \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+        _concurrent_hash_map_shard_##n##_t *shard =                                 \
+            _concurrent_hash_map_shard_##n(chm_ptr, hash);                          \
+        bool inserted;                                                              \
+                                                                                    \
+        pthread_rwlock_wrlock(&shard->lock);                                        \
+        *hash_map_try_emplace_with_hash(                                            \
+            chm_##n, &shard->map, hash, key, &inserted                              \
+        ) = value;                                                                  \
+        pthread_rwlock_unlock(&shard->lock);                                        \
+        return inserted;                                                            \
+    }                                                                               \
+                                                                                    \
+    static inline bool _concurrent_hash_map_update_##n(                             \
+        concurrent_hash_map_t(n) *chm_ptr,                                          \
+        KeyT key,                                                                   \
+        void (*update_fn)(ValueT *value, bool inserted, void *ctx),                 \
+        void *ctx                                                                   \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+        _concurrent_hash_map_shard_##n##_t *shard =                                 \
+            _concurrent_hash_map_shard_##n(chm_ptr, hash);                          \
+        bool inserted;                                                              \
+        ValueT *value;                                                              \
+                                                                                    \
+        pthread_rwlock_wrlock(&shard->lock);                                        \
+        value = hash_map_try_emplace_with_hash(                                     \
+            chm_##n, &shard->map, hash, key, &inserted                              \
+        );                                                                          \
+        update_fn(value, inserted, ctx);                                            \
+        pthread_rwlock_unlock(&shard->lock);                                        \
+        return inserted;                                                            \
+    }                                                                               \
+                                                                                    \
+    static inline bool _concurrent_hash_map_erase_##n(                              \
+        concurrent_hash_map_t(n) *chm_ptr,                                          \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+        _concurrent_hash_map_shard_##n##_t *shard =                                 \
+            _concurrent_hash_map_shard_##n(chm_ptr, hash);                          \
+        size_t pos;                                                                 \
+                                                                                    \
+        pthread_rwlock_wrlock(&shard->lock);                                        \
+        pos = _hash_map_find_with_hash_chm_##n(&shard->map, hash, key);             \
+        if (pos != hash_map_npos) {                                                 \
+            hash_map_erase_pos(chm_##n, &shard->map, pos);                          \
+        }                                                                           \
+        pthread_rwlock_unlock(&shard->lock);                                        \
+        return pos != hash_map_npos;                                                \
+    }                                                                               \
+                                                                                    \
+    static inline void _concurrent_hash_map_visit_##n(                              \
+        const concurrent_hash_map_t(n) *chm_ptr,                                    \
+        void (*visit_fn)(KeyT const *key, ValueT const *value, void *ctx),          \
+        void *ctx                                                                   \
+    )                                                                               \
+    {                                                                               \
+        size_t count = concurrent_hash_map_shard_count(chm_ptr);                    \
+                                                                                    \
+        for (size_t i = 0; i < count; ++i) {                                        \
+            _concurrent_hash_map_shard_##n##_t *shard = &chm_ptr->shards[i];        \
+                                                                                    \
+            pthread_rwlock_rdlock(&shard->lock);                                    \
+            hash_map_for_each(&shard->map, pos) {                                   \
+                visit_fn(                                                           \
+                    &hash_map_key_at(&shard->map, pos),                             \
+                    &hash_map_value_at(&shard->map, pos),                           \
+                    ctx                                                             \
+                );                                                                  \
+            }                                                                       \
+            pthread_rwlock_unlock(&shard->lock);                                    \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    struct _allow_semi_colon_concurrent_hash_map_##n { int unused; }
+
+#endif /* !CEEDS_CONCURRENT_HASH_MAP_H */
@@ -0,0 +1,87 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_CONCURRENT_POOL_ALLOCATOR_H
+#define CEEDS_CONCURRENT_POOL_ALLOCATOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ceeds/list.h>
+#include <ceeds/pool_allocator.h>
+
+/**
+ * Concurrent pool allocators, for objects of a fixed size shared between threads
+ *
+ * Each thread holds two magazines (arrays of up to CONCURRENT_POOL_MAGAZINE_SIZE free slots), from which it
+ * allocates and into which it frees without any synchronization. Only when both magazines are empty (or full)
+ * does a thread trade one of them for a full (or empty) one from the depot, which is made of two lock-free
+ * stacks. Holding two magazines avoids going back and forth to the depot when a thread alternates between
+ * allocating and freeing around a magazine boundary.
+ *
+ * The stacks of the depot avoid the ABA problem by tagging their top pointer with a counter packed in the
+ * upper bits of the pointer (which are unused by user-space addresses on the supported platforms). Magazines
+ * are only released when the pool is destroyed, so a stale top pointer can always be dereferenced.
+ *
+ * Slots can be freed by any thread, not only by the one which allocated them. New slots are carved out of
+ * slabs from the backing allocator, under a lock, when the depot runs dry.
+ */
+
+#define CONCURRENT_POOL_MAGAZINE_SIZE   64
+#define CONCURRENT_POOL_SLAB_SIZE       ((size_t)64 * 1024)
+#define CONCURRENT_POOL_TAG_SHIFT       48
+
+struct concurrent_pool_magazine;
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t backing;
+    size_t slot_size;
+    size_t slot_align;
+    atomic_uint_least64_t full_magazines;
+    atomic_uint_least64_t empty_magazines;
+    pthread_key_t key;
+    pthread_mutex_t lock;
+    list_t caches;
+    struct concurrent_pool_magazine *magazines;
+    struct pool_slab *slabs;
+    char *cur;
+    char *end;
+} concurrent_pool_allocator_t;
+
+/**
+ * Initialize a concurrent pool allocator
+ *
+ * @param[out]      cpool           the pool to initialize
+ * @param[in]       backing         the allocator handle used to allocate the slabs of the pool
+ * @param[in]       slot_size       the size of the objects to allocate from the pool
+ * @param[in]       slot_align      the alignment of the objects to allocate from the pool
+ * @return                          0 on success, -1 if the thread-local storage could not be created
+ *
+ * @pre                             @p slot_align must be a power of 2
+ */
+int concurrent_pool_allocator_init(
+    concurrent_pool_allocator_t *cpool,
+    memory_allocator_handle_t backing,
+    size_t slot_size,
+    size_t slot_align
+);
+
+/**
+ * Destroy a concurrent pool allocator, releasing all its slabs
+ *
+ * @param[in,out]   cpool           the pool to destroy
+ *
+ * @pre                             no other thread must be using @p cpool anymore
+ */
+void concurrent_pool_allocator_destroy(concurrent_pool_allocator_t *cpool);
+
+/**
+ * Get a handle to a concurrent pool allocator
+ *
+ * @param[in]       cpool_ptr       a pointer to the pool
+ */
+#define concurrent_pool_allocator_handle(cpool_ptr)     (&(cpool_ptr)->base)
+
+#endif /* !CEEDS_CONCURRENT_POOL_ALLOCATOR_H */
@@ -19,6 +19,10 @@
 #define likely(x)                   (__builtin_expect(!!(x), 1))
 #define unlikely(x)                 (__builtin_expect((x), 0))
 
+/* Hint that some memory is about to be read from (resp. written to), to start fetching it into the cache */
+#define prefetch(addr)              __builtin_prefetch(addr, 0)
+#define prefetch_write(addr)        __builtin_prefetch(addr, 1)
+
 #define _always_inline_             __attribute__((always_inline)) inline
 #define _unused_                    __attribute__((unused))
 #define _pure_                      __attribute__((pure))
@@ -0,0 +1,149 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_EPOCH_H
+#define CEEDS_EPOCH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ceeds/memory.h>
+
+/**
+ * Epoch-based reclamation
+ *
+ * An epoch domain lets threads read shared objects without any lock, while other threads replace them and
+ * retire the old ones: retired objects are only reclaimed once every thread which could still be reading them
+ * has left its read-side critical section.
+ *
+ * The domain keeps a global epoch, which is advanced every time an object is retired. Each reading thread has
+ * its own record (registered the first time it enters the domain, and aligned to EPOCH_RECORD_ALIGN bytes so
+ * that readers never write to the same cache line), in which it publishes the epoch it entered its critical
+ * section at, and 0 when outside of one. An object retired at epoch E can be reclaimed once no record holds a
+ * non-zero epoch up to E: readers which entered later can only have seen its replacement.
+ *
+ * Entering and leaving a critical section only writes to the record of the calling thread, so that readers
+ * scale with the amount of cores. Critical sections can be nested. Retiring and reclaiming objects take the
+ * lock of the domain, and are meant for writers, which are expected to be rare.
+ *
+ * Records are reused by new threads once the thread owning them exits, and are only freed with the domain.
+ */
+
+#define EPOCH_RECORD_ALIGN          64
+
+struct epoch_record
+{
+    alignas(EPOCH_RECORD_ALIGN) atomic_uint_least64_t epoch;
+    /** The nesting depth of the critical sections of the owning thread */
+    size_t depth;
+    /** Cleared when the owning thread exits, so that the record can be reused by another one */
+    atomic_bool in_use;
+    struct epoch_record *next;
+};
+
+/**
+ * An object waiting for reclamation, to be embedded in the object itself
+ */
+struct epoch_node
+{
+    struct epoch_node *next;
+    uint_least64_t retired_epoch;
+    void (*reclaim)(struct epoch_node *node, void *ctx);
+    void *ctx;
+};
+
+typedef struct
+{
+    memory_allocator_handle_t alloc;
+    atomic_uint_least64_t epoch;
+    pthread_key_t key;
+    pthread_mutex_t lock;
+    struct epoch_record *records;
+    /** The retired objects, most recently retired first */
+    struct epoch_node *retired;
+    size_t retired_count;
+} epoch_domain_t;
+
+/**
+ * Initialize an epoch domain
+ *
+ * @param[out]      ed              the epoch domain to initialize
+ * @param[in]       alloc           the allocator handle used for the records of the reading threads
+ * @return                          0 on success, -1 if the thread-local storage could not be created
+ */
+int epoch_domain_init(epoch_domain_t *ed, memory_allocator_handle_t alloc);
+
+/**
+ * Destroy an epoch domain, reclaiming all the objects still waiting for it
+ *
+ * @param[in,out]   ed              the epoch domain to destroy
+ *
+ * @pre                             no other thread must be using @p ed anymore
+ */
+void epoch_domain_destroy(epoch_domain_t *ed);
+
+struct epoch_record *_epoch_register(epoch_domain_t *ed);
+
+/**
+ * Enter a read-side critical section: objects read from now on will not be reclaimed until epoch_exit
+ *
+ * @param[in,out]   ed              the epoch domain
+ * @return                          0 on success, -1 if the record of the calling thread could not be created
+ */
+static inline int epoch_enter(epoch_domain_t *ed)
+{
+    struct epoch_record *record = pthread_getspecific(ed->key);
+
+    if unlikely(record == NULL && (record = _epoch_register(ed)) == NULL) {
+        return -1;
+    }
+    if (record->depth++ == 0) {
+        /* Sequentially consistent, so that no shared pointer is loaded before the epoch is published */
+        atomic_store(&record->epoch, atomic_load(&ed->epoch));
+    }
+    return 0;
+}
+
+/**
+ * Leave a read-side critical section
+ *
+ * @param[in,out]   ed              the epoch domain
+ *
+ * @pre                             the calling thread must be in a critical section of @p ed
+ */
+static inline void epoch_exit(epoch_domain_t *ed)
+{
+    struct epoch_record *record = pthread_getspecific(ed->key);
+
+    if (--record->depth == 0) {
+        atomic_store_explicit(&record->epoch, 0, memory_order_release);
+    }
+}
+
+/**
+ * Retire an object which readers can no longer reach, reclaiming it (and any other retired object) as soon
+ * as no reader can still be using it
+ *
+ * @param[in,out]   ed              the epoch domain
+ * @param[out]      node            the node embedded in the object
+ * @param[in]       reclaim         the function called with @p node and @p ctx to reclaim the object
+ * @param[in]       ctx             the last argument to give to @p reclaim
+ *
+ * @pre                             the object must have been unpublished before being retired
+ */
+void epoch_retire(
+    epoch_domain_t *ed,
+    struct epoch_node *node,
+    void (*reclaim)(struct epoch_node *node, void *ctx),
+    void *ctx
+);
+
+/**
+ * Reclaim all the retired objects no reader can still be using
+ *
+ * @param[in,out]   ed              the epoch domain
+ * @return                          the amount of retired objects left waiting for readers
+ */
+size_t epoch_reclaim(epoch_domain_t *ed);
+
+#endif /* !CEEDS_EPOCH_H */
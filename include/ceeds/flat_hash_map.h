@@ -0,0 +1,506 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_FLAT_HASH_MAP_H
+#define CEEDS_FLAT_HASH_MAP_H
+
+#include <ceeds/core.h>
+#include <ceeds/memory.h>
+#include <ceeds/hash_utils.h>
+#include <ceeds/bitmanip.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Flat hash maps
+ *
+ * Flat hash maps use open addressing, with a separate array of one-byte control words instead of full hashes:
+ * each control byte tells whether its slot is empty, deleted, or full, in which case it holds 7 bits of the hash
+ * of the key (its fingerprint). Lookups probe groups of FLAT_HASH_MAP_GROUP_WIDTH slots at a time, comparing
+ * all their fingerprints at once (with SSE2 when available, and with a scalar loop otherwise), and only compare
+ * keys whose fingerprints match. The remaining bits of the hash select the first group to probe, and groups are
+ * probed in a triangular sequence.
+ *
+ * Capacities are powers of 2, and maps are kept at most 7/8 full. The control array is 8 times smaller than an
+ * array of full hashes, and a lookup usually touches a single cache line of it.
+ *
+ * Unlike hash_map_insert, inserting a key which is already in the map replaces its value.
+ */
+
+#define FLAT_HASH_MAP_GROUP_WIDTH   16
+
+#define flat_hash_map_t(n)          flat_hash_map_##n##_t
+
+#define flat_hash_map_empty(alloc_handle)                                           \
+    {alloc_handle, NULL, NULL, NULL, 0, 0, 0}
+
+#define flat_hash_map_npos          ((size_t)-1)
+
+/**
+ * Destroy a flat hash map
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in,out]   hm_ptr          a pointer to the flat hash map to destroy
+ */
+#define flat_hash_map_destroy(n, hm_ptr)                                            \
+    _flat_hash_map_destroy_##n(hm_ptr)
+
+/**
+ * Get the size of a flat hash map (i.e. the number of elements in the map)
+ *
+ * @param[in]       hm_ptr          a pointer to the flat hash map
+ */
+#define flat_hash_map_size(hm_ptr)  ((hm_ptr)->size)
+
+/**
+ * Get the capacity of a flat hash map (i.e. the number of slots it currently has memory allocated for)
+ *
+ * @param[in]       hm_ptr          a pointer to the flat hash map
+ */
+#define flat_hash_map_capacity(hm_ptr)                                              \
+    ((hm_ptr)->capacity)
+
+/**
+ * Check whether a given slot of a flat hash map holds an element, e.g. to iterate over the map
+ *
+ * @param[in]       hm_ptr          a pointer to the flat hash map
+ * @param[in]       pos             the position of the slot, less than the capacity of the map
+ */
+#define flat_hash_map_is_full(hm_ptr, pos)                                          \
+    ((hm_ptr)->ctrl[pos] >= 0)
+
+/**
+ * Make sure a flat hash map can hold a given amount of elements without growing
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in,out]   hm_ptr          the flat hash map whose capacity is to be increased
+ * @param[in]       new_size        the amount of elements
+ */
+#define flat_hash_map_reserve(n, hm_ptr, new_size)                                  \
+    _flat_hash_map_reserve_##n(hm_ptr, new_size)
+
+/**
+ * Insert an element into a flat hash map, replacing the value of the key if it is already in there
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in,out]   hm_ptr          a pointer to the flat hash map to insert into
+ * @param[in]       key             the key to insert
+ * @param[in]       value           the value to insert
+ * @return                          the position of the element
+ */
+#define flat_hash_map_insert(n, hm_ptr, key, value)                                 \
+    _flat_hash_map_insert_##n(hm_ptr, key, value)
+
+/**
+ * Insert an element into a flat hash map, when already knowing its hashed value
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in,out]   hm_ptr          a pointer to the flat hash map to insert into
+ * @param[in]       hash            the hash of the key to insert
+ * @param[in]       key             the key to insert
+ * @param[in]       value           the value to insert
+ * @return                          the position of the element
+ */
+#define flat_hash_map_insert_with_hash(n, hm_ptr, hash, key, value)                 \
+    _flat_hash_map_insert_with_hash_##n(hm_ptr, hash, key, value)
+
+/**
+ * Find the position of an element in a flat hash map
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in]       hm_ptr          a pointer to the flat hash map to search into
+ * @param[in]       key             the key to search for
+ * @return                          the position of the element if found, flat_hash_map_npos otherwise
+ */
+#define flat_hash_map_find(n, hm_ptr, key)                                          \
+    _flat_hash_map_find_##n(hm_ptr, key)
+
+/**
+ * Find the position of an element in a flat hash map, when already knowing its hashed value
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in]       hm_ptr          a pointer to the flat hash map to search into
+ * @param[in]       hash            the hash of the key to search for
+ * @param[in]       key             the key to search for
+ * @return                          the position of the element if found, flat_hash_map_npos otherwise
+ */
+#define flat_hash_map_find_with_hash(n, hm_ptr, hash, key)                          \
+    _flat_hash_map_find_with_hash_##n(hm_ptr, hash, key)
+
+/**
+ * Erase the element at a given position in a flat hash map
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in,out]   hm_ptr          a pointer to the flat hash map to erase from
+ * @param[in]       pos             the position of the element to remove
+ *
+ * @pre                             @p pos must be the position of an element of the map
+ */
+#define flat_hash_map_erase_pos(n, hm_ptr, pos)                                     \
+    _flat_hash_map_erase_pos_##n(hm_ptr, pos)
+
+/**
+ * Erase the element with a given key in a flat hash map
+ *
+ * @param           n               the name of the flat hash map type
+ * @param[in,out]   hm_ptr          a pointer to the flat hash map to erase from
+ * @param[in]       key             the key to search for
+ */
+#define flat_hash_map_erase(n, hm_ptr, key)                                         \
+    _flat_hash_map_erase_##n(hm_ptr, key)
+
+/**
+ * Create a flat hash map type
+ *
+ * @param           n               the name of the flat hash map type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           ValueT          the type of the values to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_FLAT_HASH_MAP_TYPE(n, KeyT, ValueT, key_hash, key_cmp)                 \
+    typedef struct {                                                                \
+        memory_allocator_handle_t alloc;                                            \
+        int8_t *ctrl;                                                               \
+        KeyT *keys;                                                                 \
+        ValueT *values;                                                             \
+        size_t size;                                                                \
+        size_t capacity;                                                            \
+        size_t growth_left;                                                         \
+    } flat_hash_map_t(n);                                                           \
+                                                                                    \
+    static inline void _flat_hash_map_destroy_##n(flat_hash_map_t(n) *hm_ptr)       \
+    {                                                                               \
+        size_t cap = hm_ptr->capacity;                                              \
+                                                                                    \
+        if (cap > 0) {                                                              \
+            allocator_delete_array(                                                 \
+                hm_ptr->alloc, hm_ptr->ctrl, int8_t, _flat_hash_map_ctrl_size(cap)  \
+            );                                                                      \
+        }                                                                           \
+        allocator_delete_array(hm_ptr->alloc, hm_ptr->keys, KeyT, cap);             \
+        allocator_delete_array(hm_ptr->alloc, hm_ptr->values, ValueT, cap);         \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _flat_hash_map_find_ll_##n(                                \
+        const flat_hash_map_t(n) *hm_ptr,                                           \
+        hash_value_t hash,                                                          \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        size_t mask = hm_ptr->capacity - 1;                                         \
+        size_t pos = _flat_hash_map_h1(hash) & mask;                                \
+        size_t step = 0;                                                            \
+        int8_t h2 = _flat_hash_map_h2(hash);                                        \
+                                                                                    \
+        for (;;) {                                                                  \
+            const int8_t *group = hm_ptr->ctrl + pos;                               \
+            uint32_t match = _flat_hash_map_match(group, h2);                       \
+                                                                                    \
+            while (match != 0) {                                                    \
+                size_t slot = (pos + (size_t)__builtin_ctz(match)) & mask;          \
+                                                                                    \
+                if (likely(key_cmp(key, hm_ptr->keys[slot]) == 0)) {                \
+                    return slot;                                                    \
+                }                                                                   \
+                match &= match - 1;                                                 \
+            }                                                                       \
+            if (likely(_flat_hash_map_match_empty(group) != 0)) {                   \
+                return flat_hash_map_npos;                                          \
+            }                                                                       \
+            step += FLAT_HASH_MAP_GROUP_WIDTH;                                      \
+            pos = (pos + step) & mask;                                              \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _flat_hash_map_find_with_hash_##n(                         \
+        const flat_hash_map_t(n) *hm_ptr,                                           \
+        hash_value_t hash,                                                          \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        if (unlikely(hm_ptr->size == 0)) {                                          \
+            return flat_hash_map_npos;                                              \
+        }                                                                           \
+        return _flat_hash_map_find_ll_##n(hm_ptr, hash, key);                       \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _flat_hash_map_find_##n(                                   \
+        const flat_hash_map_t(n) *hm_ptr,                                           \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+                                                                                    \
+        return _flat_hash_map_find_with_hash_##n(hm_ptr, hash, key);                \
+    }                                                                               \
+                                                                                    \
+    /* Find the first slot which is not full along the probe sequence of a hash */  \
+    static inline size_t _flat_hash_map_find_non_full_##n(                          \
+        const flat_hash_map_t(n) *hm_ptr,                                           \
+        hash_value_t hash                                                           \
+    )                                                                               \
+    {                                                                               \
+        size_t mask = hm_ptr->capacity - 1;                                         \
+        size_t pos = _flat_hash_map_h1(hash) & mask;                                \
+        size_t step = 0;                                                            \
+                                                                                    \
+        for (;;) {                                                                  \
+            uint32_t match = _flat_hash_map_match_non_full(hm_ptr->ctrl + pos);     \
+                                                                                    \
+            if (likely(match != 0)) {                                               \
+                return (pos + (size_t)__builtin_ctz(match)) & mask;                 \
+            }                                                                       \
+            step += FLAT_HASH_MAP_GROUP_WIDTH;                                      \
+            pos = (pos + step) & mask;                                              \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline void _flat_hash_map_resize_##n(                                   \
+        flat_hash_map_t(n) *hm_ptr,                                                 \
+        size_t new_cap                                                              \
+    )                                                                               \
+    {                                                                               \
+        int8_t *old_ctrl = hm_ptr->ctrl;                                            \
+        KeyT *old_keys = hm_ptr->keys;                                              \
+        ValueT *old_values = hm_ptr->values;                                        \
+        size_t old_capacity = hm_ptr->capacity;                                     \
+                                                                                    \
+        hm_ptr->ctrl = allocator_new_array(                                         \
+            hm_ptr->alloc, int8_t, _flat_hash_map_ctrl_size(new_cap)                \
+        );                                                                          \
+        hm_ptr->keys = allocator_new_array(hm_ptr->alloc, KeyT, new_cap);           \
+        hm_ptr->values = allocator_new_array(hm_ptr->alloc, ValueT, new_cap);       \
+        memset(                                                                     \
+            hm_ptr->ctrl, _FLAT_HASH_MAP_EMPTY, _flat_hash_map_ctrl_size(new_cap)   \
+        );                                                                          \
+        hm_ptr->capacity = new_cap;                                                 \
+        hm_ptr->growth_left = _flat_hash_map_max_size(new_cap) - hm_ptr->size;      \
+        for (size_t i = 0; i < old_capacity; ++i) {                                 \
+            if (old_ctrl[i] >= 0) {                                                 \
+                hash_value_t hash = key_hash(old_keys[i]);                          \
+                size_t slot = _flat_hash_map_find_non_full_##n(hm_ptr, hash);       \
+                                                                                    \
+                _flat_hash_map_set_ctrl(hm_ptr, slot, _flat_hash_map_h2(hash));     \
+                hm_ptr->keys[slot] = old_keys[i];                                   \
+                hm_ptr->values[slot] = old_values[i];                               \
+            }                                                                       \
+        }                                                                           \
+        if (old_capacity > 0) {                                                     \
+            allocator_delete_array(                                                 \
+                hm_ptr->alloc, old_ctrl, int8_t,                                    \
+                _flat_hash_map_ctrl_size(old_capacity)                              \
+            );                                                                      \
+        }                                                                           \
+        allocator_delete_array(hm_ptr->alloc, old_keys, KeyT, old_capacity);        \
+        allocator_delete_array(hm_ptr->alloc, old_values, ValueT, old_capacity);    \
+    }                                                                               \
+                                                                                    \
+    static inline void _flat_hash_map_reserve_##n(                                  \
+        flat_hash_map_t(n) *hm_ptr,                                                 \
+        size_t new_size                                                             \
+    )                                                                               \
+    {                                                                               \
+        if (new_size > _flat_hash_map_max_size(hm_ptr->capacity)) {                 \
+            size_t new_cap = _flat_hash_map_capacity_for(new_size);                 \
+                                                                                    \
+            _flat_hash_map_resize_##n(hm_ptr, new_cap);                             \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    /* Make room for one more element, without growing if enough was deleted */     \
+    static inline void _flat_hash_map_make_room_##n(flat_hash_map_t(n) *hm_ptr)     \
+    {                                                                               \
+        size_t cap = hm_ptr->capacity;                                              \
+                                                                                    \
+        if (cap > 0 && (hm_ptr->size + 1) * 32 <= cap * 25) {                       \
+            _flat_hash_map_resize_##n(hm_ptr, cap);                                 \
+        } else {                                                                    \
+            _flat_hash_map_resize_##n(                                              \
+                hm_ptr, MAX(2 * cap, (size_t)FLAT_HASH_MAP_GROUP_WIDTH)             \
+            );                                                                      \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _flat_hash_map_insert_with_hash_##n(                       \
+        flat_hash_map_t(n) *hm_ptr,                                                 \
+        hash_value_t hash,                                                          \
+        KeyT key,                                                                   \
+        ValueT value                                                                \
+    )                                                                               \
+    {                                                                               \
+        size_t slot = _flat_hash_map_find_with_hash_##n(hm_ptr, hash, key);         \
+                                                                                    \
+        if (slot != flat_hash_map_npos) {                                           \
+            hm_ptr->values[slot] = value;                                           \
+            return slot;                                                            \
+        }                                                                           \
+        if (unlikely(hm_ptr->growth_left == 0)) {                                   \
+            _flat_hash_map_make_room_##n(hm_ptr);                                   \
+        }                                                                           \
+        slot = _flat_hash_map_find_non_full_##n(hm_ptr, hash);                      \
+        hm_ptr->growth_left -= hm_ptr->ctrl[slot] == _FLAT_HASH_MAP_EMPTY;          \
+        _flat_hash_map_set_ctrl(hm_ptr, slot, _flat_hash_map_h2(hash));             \
+        hm_ptr->keys[slot] = key;                                                   \
+        hm_ptr->values[slot] = value;                                               \
+        hm_ptr->size += 1;                                                          \
+        return slot;                                                                \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _flat_hash_map_insert_##n(                                 \
+        flat_hash_map_t(n) *hm_ptr,                                                 \
+        KeyT key,                                                                   \
+        ValueT value                                                                \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+                                                                                    \
+        return _flat_hash_map_insert_with_hash_##n(hm_ptr, hash, key, value);       \
+    }                                                                               \
+                                                                                    \
+    static inline void _flat_hash_map_erase_pos_##n(                                \
+        flat_hash_map_t(n) *hm_ptr,                                                 \
+        size_t pos                                                                  \
+    )                                                                               \
+    {                                                                               \
+        if (_flat_hash_map_can_empty(hm_ptr->ctrl, hm_ptr->capacity, pos)) {        \
+            _flat_hash_map_set_ctrl(hm_ptr, pos, _FLAT_HASH_MAP_EMPTY);             \
+            hm_ptr->growth_left += 1;                                               \
+        } else {                                                                    \
+            _flat_hash_map_set_ctrl(hm_ptr, pos, _FLAT_HASH_MAP_DELETED);           \
+        }                                                                           \
+        hm_ptr->size -= 1;                                                          \
+    }                                                                               \
+                                                                                    \
+    static inline void _flat_hash_map_erase_##n(                                    \
+        flat_hash_map_t(n) *hm_ptr,                                                 \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        size_t slot = flat_hash_map_find(n, hm_ptr, key);                           \
+                                                                                    \
+        if (slot != flat_hash_map_npos) {                                           \
+            flat_hash_map_erase_pos(n, hm_ptr, slot);                               \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    struct _allow_semi_colon_flat_##n { int unused; }
+
+#define _FLAT_HASH_MAP_EMPTY        ((int8_t)-128)
+#define _FLAT_HASH_MAP_DELETED      ((int8_t)-2)
+
+/* The low 7 bits of a hash make the fingerprint of its key, and the other bits select the first group */
+#define _flat_hash_map_h1(hash)     ((size_t)((hash) >> 7))
+#define _flat_hash_map_h2(hash)     ((int8_t)((hash) & 0x7f))
+
+/* Maps are kept at most 7/8 full, so that probing always ends on an empty slot quickly */
+#define _flat_hash_map_max_size(cap)                                                \
+    ((cap) - (cap) / 8)
+
+static _always_inline_ size_t _flat_hash_map_capacity_for(size_t size)
+{
+    size_t cap = FLAT_HASH_MAP_GROUP_WIDTH;
+
+    while (_flat_hash_map_max_size(cap) < size) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+/*
+ * The first FLAT_HASH_MAP_GROUP_WIDTH control bytes are mirrored after the last one, so that a group can be
+ * loaded from any position without wrapping around.
+ */
+#define _flat_hash_map_ctrl_size(cap)                                               \
+    ((cap) + FLAT_HASH_MAP_GROUP_WIDTH)
+
+#define _flat_hash_map_set_ctrl(hm_ptr, pos, h)                                     \
+    do {                                                                            \
+        (hm_ptr)->ctrl[pos] = (h);                                                  \
+        (hm_ptr)->ctrl[                                                             \
+            (((pos) - FLAT_HASH_MAP_GROUP_WIDTH) & ((hm_ptr)->capacity - 1)) +      \
+            FLAT_HASH_MAP_GROUP_WIDTH                                               \
+        ] = (h);                                                                    \
+    } while (0)
+
+#ifdef __SSE2__
+
+static _always_inline_ uint32_t _flat_hash_map_match(const int8_t *group, int8_t h2)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+}
+
+static _always_inline_ uint32_t _flat_hash_map_match_empty(const int8_t *group)
+{
+    return _flat_hash_map_match(group, _FLAT_HASH_MAP_EMPTY);
+}
+
+/* Empty and deleted slots are the only ones with the sign bit set */
+static _always_inline_ uint32_t _flat_hash_map_match_non_full(const int8_t *group)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#else
+
+static _always_inline_ uint32_t _flat_hash_map_match(const int8_t *group, int8_t h2)
+{
+    uint32_t match = 0;
+
+    for (unsigned int i = 0; i < FLAT_HASH_MAP_GROUP_WIDTH; ++i) {
+        match |= (uint32_t)(group[i] == h2) << i;
+    }
+    return match;
+}
+
+static _always_inline_ uint32_t _flat_hash_map_match_empty(const int8_t *group)
+{
+    return _flat_hash_map_match(group, _FLAT_HASH_MAP_EMPTY);
+}
+
+static _always_inline_ uint32_t _flat_hash_map_match_non_full(const int8_t *group)
+{
+    uint32_t match = 0;
+
+    for (unsigned int i = 0; i < FLAT_HASH_MAP_GROUP_WIDTH; ++i) {
+        match |= (uint32_t)(group[i] < 0) << i;
+    }
+    return match;
+}
+
+#endif
+
+/**
+ * Check whether an erased slot can be marked empty rather than deleted
+ *
+ * It can if no group containing it has ever been full, as probing would otherwise have gone past it: this is
+ * the case when the empty slots right before and right after it are less than a group apart.
+ */
+static _always_inline_ bool _flat_hash_map_can_empty(const int8_t *ctrl, size_t capacity, size_t pos)
+{
+    size_t before = (pos - FLAT_HASH_MAP_GROUP_WIDTH) & (capacity - 1);
+    uint32_t empty_before = _flat_hash_map_match_empty(ctrl + before);
+    uint32_t empty_after = _flat_hash_map_match_empty(ctrl + pos);
+    unsigned int lead = FLAT_HASH_MAP_GROUP_WIDTH;
+    unsigned int trail = FLAT_HASH_MAP_GROUP_WIDTH;
+
+    if (empty_before != 0) {
+        lead = (unsigned int)__builtin_clz(empty_before) - (bitsizeof(uint32_t) - FLAT_HASH_MAP_GROUP_WIDTH);
+    }
+    if (empty_after != 0) {
+        trail = (unsigned int)__builtin_ctz(empty_after);
+    }
+
+    return lead + trail < FLAT_HASH_MAP_GROUP_WIDTH;
+}
+
+#endif /* !CEEDS_FLAT_HASH_MAP_H */
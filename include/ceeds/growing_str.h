@@ -52,7 +52,7 @@ extern char _gs_empty_marker[1];
 static inline void gs_destroy(growing_str_t *str)
 {
     if (str->str != _gs_empty_marker) {
-        allocator_delete(str->allocator_handle, str->str);
+        allocator_delete_array(str->allocator_handle, str->str, char, str->capacity);
     }
 }
 
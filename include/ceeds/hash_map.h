@@ -9,21 +9,99 @@
 #include <ceeds/memory.h>
 #include <ceeds/hash_utils.h>
 #include <ceeds/bitmanip.h>
+#include <ceeds/vector.h>
 
 /**
  * Hash maps
+ *
+ * Hash maps use open addressing with linear probing and Robin Hood hashing. How a hash is reduced to a slot
+ * depends on the capacity policy of the hash map type, chosen through MAKE_HASH_MAP_TYPE_WITH_POLICY:
+ *
+ * - HASH_MAP_POW2 (the default) keeps capacities to powers of two, and reduces hashes by masking their low
+ *   bits, after folding their high bits into them
+ * - HASH_MAP_FASTRANGE keeps any capacity (using all the memory the allocator gives), and reduces hashes with
+ *   a multiplication and a shift, which uses their high bits: it needs a hash function whose high bits are
+ *   well distributed
+ * - HASH_MAP_MODULO keeps any capacity, and reduces hashes with a modulo, at the cost of a 64-bit division
+ *   every time a slot is probed
+ *
+ * By default, a hash map reinserts all its elements at once when it grows. With incremental resizing, it
+ * keeps its old table around instead, and moves a bounded amount of its slots to the new table on every
+ * insertion and erasure, so that no single operation has to pay for a whole rehash. Lookups consult both
+ * tables in the meantime.
+ *
+ * Elements are stored in one of two layouts, chosen through MAKE_HASH_MAP_TYPE_WITH_LAYOUT:
+ *
+ * - HASH_MAP_SOA (the default) keeps keys, values and hashes in three separate arrays: probing only reads
+ *   hashes, 8 of them per cache line, so that misses and long probe sequences stay cheap, but a hit touches
+ *   three cache lines
+ * - HASH_MAP_AOS interleaves them in a single array of buckets: a hit usually touches a single cache line,
+ *   but every probed slot costs a whole bucket. The keys, values and hashes pointers then point into the
+ *   buckets, and must not be indexed directly: elements are accessed through hash_map_key_at and
+ *   hash_map_value_at
+ *
+ * Hash sets (see hash_set.h) are generated from the same code, without the values array.
  */
 
 #define hash_map_t(n)               hash_map_##n##_t
 
-#define hash_map_empty_with_buffers(alloc_handle, keys, values, hashes, capacity)   \
-    {alloc_handle, keys, values, memset(hashes, 0, capacity), 0, capacity}
+/**
+ * Get an empty hash map using given buffers, which it will give back to its allocator when growing
+ *
+ * Only as many slots as the capacity policy of the hash map type can use are used: with HASH_MAP_POW2, that
+ * is the largest power of 2 up to @p capacity. Only the HASH_MAP_SOA layout is supported.
+ *
+ * @param           n               the name of the hash map type
+ * @param[in]       alloc_handle    the allocator handle the buffers come from
+ * @param[in]       keys            a buffer of at least @p capacity keys
+ * @param[in]       values          a buffer of at least @p capacity values
+ * @param[in]       hashes          a buffer of at least @p capacity hashes, which is zeroed
+ * @param[in]       capacity        the capacity of the buffers, in elements
+ */
+#define hash_map_empty_with_buffers(n, alloc_handle, keys, values, hashes, capacity) \
+    _hash_map_empty_with_buffers_##n(alloc_handle, keys, values, hashes, capacity)
 
 #define hash_map_empty(alloc_handle)                                                \
-    {alloc_handle, NULL, NULL, NULL, 0, 0}
+    {                                                                               \
+        alloc_handle, NULL, NULL, NULL, 0, 0,                                       \
+        false, HASH_MAP_DEFAULT_MAX_LOAD, HASH_MAP_DEFAULT_GROWTH,                  \
+        false, {NULL, NULL, NULL, 0, 0}                                             \
+    }
 
 #define hash_map_npos               ((size_t)-1)
 
+/**
+ * The amount of slots of its old table an incrementally resizing hash map moves on every insertion or erasure
+ *
+ * Even with the lowest load and growth factors, a hash map then always has moved all its old table before it
+ * has to grow again.
+ */
+#define HASH_MAP_MIGRATION_SLOTS    32
+
+/**
+ * The amount of keys whose slots batched operations prefetch at once
+ *
+ * It should be enough to keep plenty of cache misses in flight, but not so many that the first prefetched
+ * lines get evicted before being used.
+ */
+#define HASH_MAP_BATCH_SIZE         16
+
+/*
+ * Load and growth factors, in percents
+ *
+ * A hash map grows as soon as it would be filled past its maximum load factor: lower ones make for shorter
+ * probe sequences (especially for lookups of missing keys) at the cost of memory. Its capacity is then
+ * multiplied by its growth factor (and rounded up to a power of 2 with the HASH_MAP_POW2 policy).
+ */
+
+#define HASH_MAP_DEFAULT_MAX_LOAD   90
+#define HASH_MAP_MIN_MAX_LOAD       25
+#define HASH_MAP_MAX_MAX_LOAD       95
+
+#define HASH_MAP_DEFAULT_GROWTH     200
+#define HASH_MAP_MIN_GROWTH         125
+#define HASH_MAP_MAX_GROWTH         400
+
 /**
  * Destroy a hash map
  *
@@ -48,14 +126,51 @@
 #define hash_map_capacity(hm_ptr)   ((hm_ptr)->capacity)
 
 /**
- * Increase the capacity of a hash map to be at least equal to a given amount
+ * Increase the capacity of a hash map so that it can hold a given amount of elements without growing
  *
  * @param           n               the name of the hash map type
  * @param[in,out]   hm_ptr          the hash map whose capacity is to be increased
- * @param[in]       new_capacity    the new capacity
+ * @param[in]       new_size        the amount of elements
+ */
+#define hash_map_reserve(n, hm_ptr, new_size)                                       \
+    _hash_map_reserve_##n(hm_ptr, new_size)
+
+/**
+ * Reduce the capacity of a hash map to the smallest one holding its elements within its maximum load factor
+ *
+ * The hash map is rehashed even if its capacity does not change, which gets rid of all its tombstones.
+ *
+ * @param           n               the name of the hash map type
+ * @param[in,out]   hm_ptr          the hash map to shrink
+ */
+#define hash_map_shrink_to_fit(n, hm_ptr)                                           \
+    _hash_map_shrink_to_fit_##n(hm_ptr)
+
+/**
+ * Set the maximum load factor of a hash map, which applies from its next insertion on
+ *
+ * @param[in,out]   hm_ptr          a pointer to the hash map
+ * @param[in]       percent         the maximum load factor, in percents
+ * @return                          0 on success, -1 if @p percent is not between HASH_MAP_MIN_MAX_LOAD and
+ *                                  HASH_MAP_MAX_MAX_LOAD
  */
-#define hash_map_reserve(n, hm_ptr, new_capacity)                                   \
-    _hash_map_reserve_##n(hm_ptr, new_capacity)
+#define hash_map_set_max_load(hm_ptr, percent)                                      \
+    _hash_map_set_factor(                                                           \
+        &(hm_ptr)->max_load, percent, HASH_MAP_MIN_MAX_LOAD, HASH_MAP_MAX_MAX_LOAD  \
+    )
+
+/**
+ * Set the growth factor of a hash map
+ *
+ * @param[in,out]   hm_ptr          a pointer to the hash map
+ * @param[in]       percent         the growth factor, in percents
+ * @return                          0 on success, -1 if @p percent is not between HASH_MAP_MIN_GROWTH and
+ *                                  HASH_MAP_MAX_GROWTH
+ */
+#define hash_map_set_growth(hm_ptr, percent)                                        \
+    _hash_map_set_factor(                                                           \
+        &(hm_ptr)->growth, percent, HASH_MAP_MIN_GROWTH, HASH_MAP_MAX_GROWTH        \
+    )
 
 /**
  * Insert an element into a hash map
@@ -80,6 +195,36 @@
 #define hash_map_insert_with_hash(n, hm_ptr, hash, key, value)                      \
     _hash_map_insert_with_hash_##n(hm_ptr, hash, key, value)
 
+/**
+ * Find an element in a hash map, inserting it if it is not there yet
+ *
+ * The key is hashed once and probed for once: the probe stops where the key would be inserted if it is
+ * missing, and it is inserted right there. This makes it the building block of counting and aggregation loops,
+ * e.g. `++*hash_map_try_emplace(n, &counts, key, &inserted);`.
+ *
+ * @param           n               the name of the hash map type
+ * @param[in,out]   hm_ptr          a pointer to the hash map
+ * @param[in]       key             the key to search for
+ * @param[out]      inserted_ptr    a pointer set to whether the key was inserted (or NULL)
+ * @return                          a pointer to the value of the element, which is zeroed if it was inserted,
+ *                                  and which stays valid until the next insertion or erasure
+ */
+#define hash_map_try_emplace(n, hm_ptr, key, inserted_ptr)                          \
+    _hash_map_try_emplace_##n(hm_ptr, key, inserted_ptr)
+
+/**
+ * Find an element in a hash map, inserting it if it is not there yet, when already knowing its hashed value
+ *
+ * @param           n               the name of the hash map type
+ * @param[in,out]   hm_ptr          a pointer to the hash map
+ * @param[in]       hash            the hash of the key
+ * @param[in]       key             the key to search for
+ * @param[out]      inserted_ptr    a pointer set to whether the key was inserted (or NULL)
+ * @return                          a pointer to the value of the element (see hash_map_try_emplace)
+ */
+#define hash_map_try_emplace_with_hash(n, hm_ptr, hash, key, inserted_ptr)          \
+    _hash_map_try_emplace_with_hash_##n(hm_ptr, hash, key, inserted_ptr)
+
 /**
  * Find the position of an element in a hash map
  *
@@ -91,6 +236,66 @@
 #define hash_map_find(n, hm_ptr, key)                                               \
     _hash_map_find_##n(hm_ptr, key)
 
+/**
+ * Find the positions of several elements in a hash map
+ *
+ * This is equivalent to calling hash_map_find for every key, but it hashes a batch of keys first and
+ * prefetches all their ideal slots before probing any of them, so that the cache misses of the lookups
+ * overlap instead of being paid one after the other. This pays off once the hash map does not fit in cache.
+ *
+ * @param           n               the name of the hash map type
+ * @param[in]       hm_ptr          a pointer to the hash map to search into
+ * @param[in]       keys            the keys to search for
+ * @param[in]       count           the amount of keys
+ * @param[out]      positions       the position of every element if found, hash_map_npos otherwise
+ */
+#define hash_map_find_batch(n, hm_ptr, keys, count, positions)                      \
+    _hash_map_find_batch_##n(hm_ptr, keys, count, positions)
+
+/**
+ * Insert several elements into a hash map
+ *
+ * This is equivalent to calling hash_map_insert for every element, but it makes room for all of them at
+ * once, and prefetches the ideal slots of a batch of keys before inserting any of them (see
+ * hash_map_find_batch).
+ *
+ * @param           n               the name of the hash map type
+ * @param[in,out]   hm_ptr          a pointer to the hash map to insert into
+ * @param[in]       keys            the keys to insert
+ * @param[in]       values          the values to insert
+ * @param[in]       count           the amount of elements
+ */
+#define hash_map_insert_batch(n, hm_ptr, keys, values, count)                       \
+    _hash_map_insert_batch_##n(hm_ptr, keys, values, count)
+
+/**
+ * Access the key of the element at a given position in a hash map
+ *
+ * With the HASH_MAP_SOA layout, and unless incremental resizing is enabled, this is the same as
+ * `hm_ptr->keys[pos]`.
+ *
+ * @param[in]       hm_ptr          a pointer to the hash map
+ * @param[in]       pos             the position of the element, as returned by hash_map_find
+ */
+#define hash_map_key_at(hm_ptr, pos)                                                \
+    (*((pos) < (hm_ptr)->capacity ?                                                 \
+        &_hash_map_at(hm_ptr, (hm_ptr)->keys, pos) :                                \
+        &_hash_map_at(hm_ptr, (hm_ptr)->old.keys, (pos) - (hm_ptr)->capacity)))
+
+/**
+ * Access the value of the element at a given position in a hash map
+ *
+ * With the HASH_MAP_SOA layout, and unless incremental resizing is enabled, this is the same as
+ * `hm_ptr->values[pos]`.
+ *
+ * @param[in]       hm_ptr          a pointer to the hash map
+ * @param[in]       pos             the position of the element, as returned by hash_map_find
+ */
+#define hash_map_value_at(hm_ptr, pos)                                              \
+    (*((pos) < (hm_ptr)->capacity ?                                                 \
+        &_hash_map_at(hm_ptr, (hm_ptr)->values, pos) :                              \
+        &_hash_map_at(hm_ptr, (hm_ptr)->old.values, (pos) - (hm_ptr)->capacity)))
+
 /**
  * Erase the element at a given position in a hash map
  *
@@ -103,6 +308,36 @@
 #define hash_map_erase_pos(n, hm_ptr, pos)                                          \
     _hash_map_erase_pos_##n(hm_ptr, pos)
 
+/**
+ * Choose how elements are erased from a hash map
+ *
+ * By default, erased elements leave tombstones behind, which only later insertions can reuse: the positions of
+ * the other elements stay valid, but lookups get longer as tombstones build up, until the next growth.
+ * With backward-shift deletion, the elements following an erased one in its probe sequence are shifted back
+ * instead, so that no tombstone is left and lookups stay as short as if the element had never been inserted.
+ * The positions of the other elements may then change on every erasure.
+ *
+ * @param[in,out]   hm_ptr          a pointer to the hash map
+ * @param[in]       enable          whether to use backward-shift deletion
+ */
+#define hash_map_set_backward_shift(hm_ptr, enable)                                 \
+    ((hm_ptr)->backward_shift = (enable))
+
+/**
+ * Choose how a hash map grows
+ *
+ * With incremental resizing, growing only allocates the new table: the elements are then moved from the old
+ * table HASH_MAP_MIGRATION_SLOTS slots at a time, by the following insertions and erasures. The positions
+ * found in the meantime may refer to the old table, and must be accessed with hash_map_key_at and
+ * hash_map_value_at; like with backward-shift deletion, they may change on every insertion and erasure.
+ * Growing again or shrinking a hash map first finishes any resizing in progress.
+ *
+ * @param[in,out]   hm_ptr          a pointer to the hash map
+ * @param[in]       enable          whether to resize incrementally
+ */
+#define hash_map_set_incremental_resize(hm_ptr, enable)                             \
+    ((hm_ptr)->incremental_resize = (enable))
+
 /**
  * Erase the element with a given key in a hash map
  *
@@ -114,7 +349,58 @@
     _hash_map_erase_##n(hm_ptr, key)
 
 /**
- * Create a hash map type
+ * Iterate over the elements of a hash map
+ *
+ * Runs of empty slots are skipped several slots at a time, so that iterating over sparse hash maps stays
+ * cheap. While resizing incrementally, the elements not moved yet are visited last, at positions past the
+ * capacity. The hash map must not be modified during the iteration, except for the values of its elements.
+ *
+ * @param[in]       hm_ptr          a pointer to the hash map
+ * @param           pos             the name of the variable holding the position of the current element
+ *
+ * Example:
+ * @code
+ * hash_map_for_each(&hm, pos) {
+ *     printf("%d -> %d\n", hash_map_key_at(&hm, pos), hash_map_value_at(&hm, pos));
+ * }
+ * @endcode
+ */
+#define hash_map_for_each(hm_ptr, pos)                                              \
+    for (                                                                           \
+        size_t pos = _hash_map_next_pos(hm_ptr, 0);                                 \
+        pos != hash_map_npos;                                                       \
+        pos = _hash_map_next_pos(hm_ptr, pos + 1)                                   \
+    )
+
+/**
+ * Append all the keys and values of a hash map to vectors, in iteration order
+ *
+ * Nothing is appended if either vector can't grow to hold every element.
+ *
+ * @param[in]       hm_ptr          a pointer to the hash map
+ * @param[in,out]   keys_vec_ptr    a pointer to the vector of keys to append to
+ * @param[in,out]   values_vec_ptr  a pointer to the vector of values to append to
+ */
+#define hash_map_to_vectors(hm_ptr, keys_vec_ptr, values_vec_ptr)                   \
+    do {                                                                            \
+        typeof(hm_ptr) __hm_ptr = (hm_ptr);                                         \
+        typeof(keys_vec_ptr) __keys_ptr = (keys_vec_ptr);                           \
+        typeof(values_vec_ptr) __values_ptr = (values_vec_ptr);                     \
+        size_t __count = __hm_ptr->size;                                            \
+                                                                                    \
+        if (vector_reserve(__keys_ptr, __keys_ptr->size + __count) == 0 &&          \
+            vector_reserve(__values_ptr, __values_ptr->size + __count) == 0) {      \
+            hash_map_for_each(__hm_ptr, __pos) {                                    \
+                __keys_ptr->data[__keys_ptr->size++] =                              \
+                    hash_map_key_at(__hm_ptr, __pos);                               \
+                __values_ptr->data[__values_ptr->size++] =                          \
+                    hash_map_value_at(__hm_ptr, __pos);                             \
+            }                                                                       \
+        }                                                                           \
+    } while (0)
+
+/**
+ * Create a hash map type, using the HASH_MAP_POW2 capacity policy
  *
  * @param           n               the name of the hash map type to create
  * @param           KeyT            the type of the keys to store
@@ -127,6 +413,56 @@
  *                                  R != 0 if A != B
  */
 #define MAKE_HASH_MAP_TYPE(n, KeyT, ValueT, key_hash, key_cmp)                      \
+    MAKE_HASH_MAP_TYPE_WITH_POLICY(n, KeyT, ValueT, key_hash, key_cmp, HASH_MAP_POW2)
+
+/**
+ * Create a hash map type, using a given capacity policy
+ *
+ * @param           n               the name of the hash map type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           ValueT          the type of the values to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ * @param           policy          the capacity policy: HASH_MAP_POW2, HASH_MAP_FASTRANGE or HASH_MAP_MODULO
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_HASH_MAP_TYPE_WITH_POLICY(n, KeyT, ValueT, key_hash, key_cmp, policy)  \
+    MAKE_HASH_MAP_TYPE_WITH_LAYOUT(                                                 \
+        n, KeyT, ValueT, key_hash, key_cmp, policy, HASH_MAP_SOA                    \
+    )
+
+/**
+ * Create a hash map type, using a given capacity policy and storage layout
+ *
+ * @param           n               the name of the hash map type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           ValueT          the type of the values to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ * @param           policy          the capacity policy: HASH_MAP_POW2, HASH_MAP_FASTRANGE or HASH_MAP_MODULO
+ * @param           layout          the storage layout: HASH_MAP_SOA or HASH_MAP_AOS
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_HASH_MAP_TYPE_WITH_LAYOUT(n, KeyT, ValueT, key_hash, key_cmp, policy, layout) \
+    _MAKE_HASH_TABLE_TYPE(n, KeyT, ValueT, key_hash, key_cmp, policy, layout, 1)
+
+/*
+ * Generate the code shared by hash maps and hash sets, the latter having no values array (has_values being 0)
+ */
+#define _MAKE_HASH_TABLE_TYPE(n, KeyT, ValueT, key_hash, key_cmp, policy, layout, has_values) \
+    /* The bucket of the HASH_MAP_AOS layout, whose hash must come first */         \
+    typedef struct {                                                                \
+        hash_value_t hash;                                                          \
+        KeyT key;                                                                   \
+        _hash_map_if_values(has_values, ValueT value;, )                            \
+    } _hash_map_bucket_##n##_t;                                                     \
+                                                                                    \
     typedef struct {                                                                \
         memory_allocator_handle_t alloc;                                            \
         KeyT *keys;                                                                 \
@@ -134,42 +470,177 @@
         hash_value_t *hashes;                                                       \
         size_t size;                                                                \
         size_t capacity;                                                            \
+        bool backward_shift;                                                        \
+        unsigned int max_load;                                                      \
+        unsigned int growth;                                                        \
+        bool incremental_resize;                                                    \
+        /* The table being moved away from when resizing incrementally */           \
+        struct {                                                                    \
+            KeyT *keys;                                                             \
+            ValueT *values;                                                         \
+            hash_value_t *hashes;                                                   \
+            size_t capacity;                                                        \
+            size_t migrated;                                                        \
+        } old;                                                                      \
+        /* Takes no room: its element size is the stride of the layout */           \
+        char _stride[0][                                                            \
+            _hash_map_stride_##layout(sizeof(_hash_map_bucket_##n##_t))             \
+        ];                                                                          \
     } hash_map_t(n);                                                                \
                                                                                     \
+    static inline void _hash_map_free_table_##n(                                    \
+        hash_map_t(n) *hm_ptr,                                                      \
+        KeyT *keys,                                                                 \
+        ValueT *values,                                                             \
+        hash_value_t *hashes,                                                       \
+        size_t cap                                                                  \
+    )                                                                               \
+    {                                                                               \
+        if (_hash_map_is_interleaved(hm_ptr)) {                                     \
+            allocator_delete_array(                                                 \
+                hm_ptr->alloc, (_hash_map_bucket_##n##_t *)hashes,                  \
+                _hash_map_bucket_##n##_t, cap                                       \
+            );                                                                      \
+            return;                                                                 \
+        }                                                                           \
+        allocator_delete_array(hm_ptr->alloc, keys, KeyT, cap);                     \
+        _hash_map_if_values(                                                        \
+            has_values, allocator_delete_array(hm_ptr->alloc, values, ValueT, cap), \
+            (void)values                                                            \
+        );                                                                          \
+        allocator_delete_array(hm_ptr->alloc, hashes, hash_value_t, cap);           \
+    }                                                                               \
+                                                                                    \
+    /* Allocate a table of at least new_cap slots, giving its actual capacity */    \
+    static inline size_t _hash_map_alloc_table_##n(                                 \
+        hash_map_t(n) *hm_ptr,                                                      \
+        size_t new_cap                                                              \
+    )                                                                               \
+    {                                                                               \
+        size_t keys_cap;                                                            \
+        size_t values_cap = SIZE_MAX;                                               \
+                                                                                    \
+        if (_hash_map_is_interleaved(hm_ptr)) {                                     \
+            _hash_map_bucket_##n##_t *buckets = allocator_new_array_at_least(       \
+                hm_ptr->alloc, _hash_map_bucket_##n##_t, new_cap, &keys_cap         \
+            );                                                                      \
+                                                                                    \
+            new_cap = _hash_map_usable_capacity(policy, keys_cap);                  \
+            for (size_t i = 0; i < new_cap; ++i) {                                  \
+                buckets[i].hash = 0;                                                \
+            }                                                                       \
+            hm_ptr->hashes = &buckets->hash;                                        \
+            hm_ptr->keys = &buckets->key;                                           \
+            _hash_map_if_values(has_values, hm_ptr->values = &buckets->value, );    \
+            return new_cap;                                                         \
+        }                                                                           \
+        hm_ptr->keys = allocator_new_array_at_least(                                \
+            hm_ptr->alloc, KeyT, new_cap, &keys_cap                                 \
+        );                                                                          \
+        _hash_map_if_values(                                                        \
+            has_values,                                                             \
+            hm_ptr->values = allocator_new_array_at_least(                          \
+                hm_ptr->alloc, ValueT, new_cap, &values_cap                         \
+            ),                                                                      \
+        );                                                                          \
+        /* Use every slot the allocator gave us room for in both arrays */          \
+        new_cap = _hash_map_usable_capacity(policy, MIN(keys_cap, values_cap));     \
+        /* Let the allocator zero the hashes, as it can often do so for free */     \
+        hm_ptr->hashes = allocator_znew_array(                                      \
+            hm_ptr->alloc, hash_value_t, new_cap                                    \
+        );                                                                          \
+        return new_cap;                                                             \
+    }                                                                               \
+                                                                                    \
+    static inline hash_map_t(n) _hash_map_empty_with_buffers_##n(                   \
+        memory_allocator_handle_t alloc,                                            \
+        KeyT *keys,                                                                 \
+        ValueT *values,                                                             \
+        hash_value_t *hashes,                                                       \
+        size_t capacity                                                             \
+    )                                                                               \
+    {                                                                               \
+        hash_map_t(n) hm = hash_map_empty(alloc);                                   \
+                                                                                    \
+        assert(!_hash_map_is_interleaved(&hm));                                     \
+        if (capacity == 0) {                                                        \
+            return hm;                                                              \
+        }                                                                           \
+        capacity = _hash_map_usable_capacity(policy, capacity);                     \
+        hm.keys = keys;                                                             \
+        hm.values = values;                                                         \
+        hm.hashes = memset(hashes, 0, capacity * sizeof(*hashes));                  \
+        hm.capacity = capacity;                                                     \
+        return hm;                                                                  \
+    }                                                                               \
+                                                                                    \
     static inline void _hash_map_destroy_##n(hash_map_t(n) *hm_ptr)                 \
     {                                                                               \
-        allocator_delete(hm_ptr->alloc, hm_ptr->keys);                              \
-        allocator_delete(hm_ptr->alloc, hm_ptr->values);                            \
-        allocator_delete(hm_ptr->alloc, hm_ptr->hashes);                            \
+        _hash_map_free_table_##n(                                                   \
+            hm_ptr, hm_ptr->keys, hm_ptr->values, hm_ptr->hashes, hm_ptr->capacity  \
+        );                                                                          \
+        _hash_map_free_table_##n(                                                   \
+            hm_ptr, hm_ptr->old.keys, hm_ptr->old.values, hm_ptr->old.hashes,       \
+            hm_ptr->old.capacity                                                    \
+        );                                                                          \
     }                                                                               \
                                                                                     \
     static inline size_t _hash_map_find_ll_##n(                                     \
         const hash_map_t(n) *hm_ptr,                                                \
+        const hash_value_t *hashes,                                                 \
+        KeyT const *keys,                                                           \
+        size_t capacity,                                                            \
         hash_value_t hash,                                                          \
         KeyT const key                                                              \
     )                                                                               \
     {                                                                               \
+        size_t cur_slot = _hash_map_ideal_slot(policy, hash, capacity);             \
+        size_t cur_dist = 0;                                                        \
+                                                                                    \
+        for (;;) {                                                                  \
+            hash_value_t other_hash = _hash_map_at(hm_ptr, hashes, cur_slot);       \
+                                                                                    \
+            if (                                                                    \
+                _hash_map_is_empty_slot(other_hash) ||                              \
+                cur_dist >                                                          \
+                _hash_map_distance_to_ideal(policy, other_hash, cur_slot, capacity) \
+            ) {                                                                     \
+                return hash_map_npos;                                               \
+            } else if (                                                             \
+                other_hash == hash &&                                               \
+                key_cmp(key, _hash_map_at(hm_ptr, keys, cur_slot)) == 0             \
+            ) {                                                                     \
+                return cur_slot;                                                    \
+            }                                                                       \
+            cur_slot = _hash_map_next_slot(policy, cur_slot, capacity);             \
+            cur_dist += 1;                                                          \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _hash_map_find_prepared_##n(                               \
+        const hash_map_t(n) *hm_ptr,                                                \
+        hash_value_t hash,                                                          \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        size_t slot = hash_map_npos;                                                \
+                                                                                    \
         if (likely(hm_ptr->size)) {                                                 \
-            size_t cur_slot = hash % hm_ptr->capacity;                              \
-            size_t cur_dist = 0;                                                    \
-                                                                                    \
-            for (;;) {                                                              \
-                if (                                                                \
-                    _hash_map_is_empty_slot(hm_ptr->hashes[cur_slot]) ||            \
-                    cur_dist > _hash_map_distance_to_ideal(hm_ptr, cur_slot)        \
-                ) {                                                                 \
-                    return hash_map_npos;                                           \
-                } else if (                                                         \
-                    hm_ptr->hashes[cur_slot] == hash &&                             \
-                    key_cmp(key, hm_ptr->keys[cur_slot]) == 0                       \
-                ) {                                                                 \
-                    return cur_slot;                                                \
+            slot = _hash_map_find_ll_##n(                                           \
+                hm_ptr, hm_ptr->hashes, hm_ptr->keys, hm_ptr->capacity, hash, key   \
+            );                                                                      \
+            /* Elements not moved yet are found past the end of the new table */    \
+            if (unlikely(slot == hash_map_npos && hm_ptr->old.hashes != NULL)) {    \
+                slot = _hash_map_find_ll_##n(                                       \
+                    hm_ptr, hm_ptr->old.hashes, hm_ptr->old.keys,                   \
+                    hm_ptr->old.capacity, hash, key                                 \
+                );                                                                  \
+                if (slot != hash_map_npos) {                                        \
+                    slot += hm_ptr->capacity;                                       \
                 }                                                                   \
-                cur_slot = (cur_slot + 1) % hm_ptr->capacity;                       \
-                cur_dist += 1;                                                      \
             }                                                                       \
         }                                                                           \
-        return hash_map_npos;                                                       \
+        return slot;                                                                \
     }                                                                               \
                                                                                     \
     static inline size_t _hash_map_find_with_hash_##n(                              \
@@ -178,10 +649,41 @@
         KeyT const key                                                              \
     )                                                                               \
     {                                                                               \
-        return _hash_map_find_ll_##n(hm_ptr, _hash_map_fix_hash(hash), key);        \
+        hash = _hash_map_prepare_hash(policy, hash);                                \
+        return _hash_map_find_prepared_##n(hm_ptr, hash, key);                      \
     }                                                                               \
                                                                                     \
-    static inline size_t _hash_map_find_##n(const hash_map_t(n) *hm_ptr, KeyT const key)  \
+    static inline void _hash_map_find_batch_##n(                                    \
+        const hash_map_t(n) *hm_ptr,                                                \
+        KeyT const *keys,                                                           \
+        size_t count,                                                               \
+        size_t *positions                                                           \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hashes[HASH_MAP_BATCH_SIZE];                                   \
+                                                                                    \
+        for (size_t i = 0; i < count; i += HASH_MAP_BATCH_SIZE) {                   \
+            size_t batch = MIN(count - i, (size_t)HASH_MAP_BATCH_SIZE);             \
+                                                                                    \
+            for (size_t j = 0; j < batch; ++j) {                                    \
+                hashes[j] = _hash_map_prepare_hash(policy, key_hash(keys[i + j]));  \
+                if (likely(hm_ptr->capacity)) {                                     \
+                    size_t slot = _hash_map_ideal_slot(                             \
+                        policy, hashes[j], hm_ptr->capacity                         \
+                    );                                                              \
+                                                                                    \
+                    _hash_map_prefetch_slot(has_values, prefetch, hm_ptr, slot);    \
+                }                                                                   \
+            }                                                                       \
+            for (size_t j = 0; j < batch; ++j) {                                    \
+                positions[i + j] = _hash_map_find_prepared_##n(                     \
+                    hm_ptr, hashes[j], keys[i + j]                                  \
+                );                                                                  \
+            }                                                                       \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _hash_map_find_##n(const hash_map_t(n) *hm_ptr, KeyT const key) \
     {                                                                               \
         hash_value_t hash = key_hash(key);                                          \
         size_t slot = _hash_map_find_with_hash_##n(hm_ptr, hash, key);              \
@@ -189,84 +691,162 @@
         return slot;                                                                \
     }                                                                               \
                                                                                     \
-    static inline size_t _hash_map_insert_ll_##n(                                   \
+    /* Insert an element from a slot of its probe sequence, giving its position */  \
+    static inline size_t _hash_map_insert_from_##n(                                 \
         hash_map_t(n) *hm_ptr,                                                      \
+        size_t cur_slot,                                                            \
+        size_t cur_dist,                                                            \
         hash_value_t hash,                                                          \
         KeyT key,                                                                   \
         ValueT value                                                                \
     )                                                                               \
     {                                                                               \
-        size_t cur_slot = hash % hm_ptr->capacity;                                  \
-        size_t cur_dist = 0;                                                        \
+        size_t slot = hash_map_npos;                                                \
                                                                                     \
         for (;;) {                                                                  \
+            hash_value_t other_hash =                                               \
+                _hash_map_at(hm_ptr, hm_ptr->hashes, cur_slot);                     \
             size_t other_dist;                                                      \
                                                                                     \
-            if (_hash_map_is_empty_slot(hm_ptr->hashes[cur_slot])) {                \
-                _hash_map_put(hm_ptr, cur_slot, hash, key, value);                  \
-                return cur_slot;                                                    \
+            if (_hash_map_is_empty_slot(other_hash)) {                              \
+                _hash_map_put(has_values, hm_ptr, cur_slot, hash, key, value);      \
+                return slot == hash_map_npos ? cur_slot : slot;                     \
             }                                                                       \
-            other_dist = _hash_map_distance_to_ideal(hm_ptr, cur_slot);             \
+            other_dist = _hash_map_distance_to_ideal(                               \
+                policy, other_hash, cur_slot, hm_ptr->capacity                      \
+            );                                                                      \
             if (other_dist < cur_dist) {                                            \
-                if (_hash_map_is_tombstone(hm_ptr->hashes[cur_slot])) {             \
-                    _hash_map_put(hm_ptr, cur_slot, hash, key, value);              \
-                    return cur_slot;                                                \
+                if (_hash_map_is_tombstone(other_hash)) {                           \
+                    _hash_map_put(has_values, hm_ptr, cur_slot, hash, key, value);  \
+                    return slot == hash_map_npos ? cur_slot : slot;                 \
+                }                                                                   \
+                /* The element goes here, and the one it displaces is carried on */ \
+                if (slot == hash_map_npos) {                                        \
+                    slot = cur_slot;                                                \
                 }                                                                   \
-                SWAP(&hash, &hm_ptr->hashes[cur_slot]);                             \
-                SWAP(&key, &hm_ptr->keys[cur_slot]);                                \
-                SWAP(&value, &hm_ptr->values[cur_slot]);                            \
+                SWAP(&hash, &_hash_map_at(hm_ptr, hm_ptr->hashes, cur_slot));       \
+                SWAP(&key, &_hash_map_at(hm_ptr, hm_ptr->keys, cur_slot));          \
+                _hash_map_if_values(                                                \
+                    has_values,                                                     \
+                    SWAP(&value, &_hash_map_at(hm_ptr, hm_ptr->values, cur_slot)),  \
+                );                                                                  \
                 cur_dist = other_dist;                                              \
             }                                                                       \
-            cur_slot = (cur_slot + 1) % hm_ptr->capacity;                           \
+            cur_slot = _hash_map_next_slot(policy, cur_slot, hm_ptr->capacity);     \
             cur_dist += 1;                                                          \
         }                                                                           \
     }                                                                               \
                                                                                     \
-    static inline void _hash_map_grow_##n(                                          \
+    static inline size_t _hash_map_insert_ll_##n(                                   \
         hash_map_t(n) *hm_ptr,                                                      \
-        size_t new_cap                                                              \
+        hash_value_t hash,                                                          \
+        KeyT key,                                                                   \
+        ValueT value                                                                \
     )                                                                               \
     {                                                                               \
-        hash_value_t *old_hashes = hm_ptr->hashes;                                  \
-        KeyT *old_keys = hm_ptr->keys;                                              \
-        ValueT *old_values = hm_ptr->values;                                        \
-        size_t old_capacity = hm_ptr->capacity;                                     \
+        size_t slot = _hash_map_ideal_slot(policy, hash, hm_ptr->capacity);         \
                                                                                     \
-        hm_ptr->hashes = allocator_znew_array(                                      \
-            hm_ptr->alloc, hash_value_t, new_cap                                    \
-        );                                                                          \
-        hm_ptr->keys = allocator_new_array(hm_ptr->alloc, KeyT, new_cap);           \
-        hm_ptr->values = allocator_new_array(hm_ptr->alloc, ValueT, new_cap);       \
-        hm_ptr->capacity = new_cap;                                                 \
-        hm_ptr->size = 0;                                                           \
-        for (size_t i = 0; i < old_capacity; ++i) {                                 \
-            if (                                                                    \
-                !_hash_map_is_empty_slot(old_hashes[i]) &&                          \
-                !_hash_map_is_tombstone(old_hashes[i])                              \
-            ) {                                                                     \
+        return _hash_map_insert_from_##n(hm_ptr, slot, 0, hash, key, value);        \
+    }                                                                               \
+                                                                                    \
+    /* Move up to max_slots slots from the old table, freeing it when done */       \
+    static inline void _hash_map_migrate_##n(                                       \
+        hash_map_t(n) *hm_ptr,                                                      \
+        size_t max_slots                                                            \
+    )                                                                               \
+    {                                                                               \
+        size_t old_cap = hm_ptr->old.capacity;                                      \
+        size_t end;                                                                 \
+                                                                                    \
+        if (likely(hm_ptr->old.hashes == NULL)) {                                   \
+            return;                                                                 \
+        }                                                                           \
+        end = hm_ptr->old.migrated;                                                 \
+        end += MIN(max_slots, old_cap - end);                                       \
+        for (size_t i = hm_ptr->old.migrated; i < end; ++i) {                       \
+            hash_value_t *hash_ptr = &_hash_map_at(hm_ptr, hm_ptr->old.hashes, i);  \
+                                                                                    \
+            if (_hash_map_is_full(*hash_ptr)) {                                     \
                 _hash_map_insert_ll_##n(                                            \
-                    hm_ptr,                                                         \
-                    old_hashes[i],                                                  \
-                    old_keys[i],                                                    \
-                    old_values[i]                                                   \
+                    hm_ptr, *hash_ptr, _hash_map_at(hm_ptr, hm_ptr->old.keys, i),   \
+                    _hash_map_if_values(                                            \
+                        has_values,                                                 \
+                        _hash_map_at(hm_ptr, hm_ptr->old.values, i),                \
+                        (ValueT){0}                                                 \
+                    )                                                               \
                 );                                                                  \
+                /* Leave a tombstone, to keep the next elements reachable */        \
+                *hash_ptr |= _hash_map_tombstone_bit;                               \
             }                                                                       \
         }                                                                           \
-        allocator_delete(hm_ptr->alloc, old_hashes);                                \
-        allocator_delete(hm_ptr->alloc, old_keys);                                  \
-        allocator_delete(hm_ptr->alloc, old_values);                                \
+        hm_ptr->old.migrated = end;                                                 \
+        if (end == old_cap) {                                                       \
+            _hash_map_free_table_##n(                                               \
+                hm_ptr, hm_ptr->old.keys, hm_ptr->old.values, hm_ptr->old.hashes,   \
+                old_cap                                                             \
+            );                                                                      \
+            hm_ptr->old.hashes = NULL;                                              \
+            hm_ptr->old.keys = NULL;                                                \
+            hm_ptr->old.values = NULL;                                              \
+            hm_ptr->old.capacity = 0;                                               \
+            hm_ptr->old.migrated = 0;                                               \
+        }                                                                           \
     }                                                                               \
                                                                                     \
-    static inline void _hash_map_reserve_##n(                                       \
+    static inline void _hash_map_grow_##n(                                          \
         hash_map_t(n) *hm_ptr,                                                      \
         size_t new_cap                                                              \
     )                                                                               \
     {                                                                               \
-        if (hm_ptr->capacity * 90 / 100 < new_cap) {                                \
-            _hash_map_grow_##n(hm_ptr, MAX(new_cap, 2 * hm_ptr->capacity));         \
+        _hash_map_migrate_##n(hm_ptr, SIZE_MAX);                                    \
+        hm_ptr->old.hashes = hm_ptr->hashes;                                        \
+        hm_ptr->old.keys = hm_ptr->keys;                                            \
+        hm_ptr->old.values = hm_ptr->values;                                        \
+        hm_ptr->old.capacity = hm_ptr->capacity;                                    \
+        new_cap = _hash_map_round_capacity(policy, new_cap);                        \
+        hm_ptr->capacity = _hash_map_alloc_table_##n(hm_ptr, new_cap);              \
+        if (!hm_ptr->incremental_resize) {                                          \
+            _hash_map_migrate_##n(hm_ptr, SIZE_MAX);                                \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline void _hash_map_reserve_##n(                                       \
+        hash_map_t(n) *hm_ptr,                                                      \
+        size_t new_size                                                             \
+    )                                                                               \
+    {                                                                               \
+        if (hm_ptr->capacity * hm_ptr->max_load / 100 < new_size) {                 \
+            _hash_map_grow_##n(                                                     \
+                hm_ptr,                                                             \
+                MAX(                                                                \
+                    _hash_map_capacity_for(new_size, hm_ptr->max_load),             \
+                    hm_ptr->capacity * hm_ptr->growth / 100                         \
+                )                                                                   \
+            );                                                                      \
         }                                                                           \
     }                                                                               \
                                                                                     \
+    static inline void _hash_map_shrink_to_fit_##n(hash_map_t(n) *hm_ptr)           \
+    {                                                                               \
+        size_t new_cap;                                                             \
+                                                                                    \
+        if (hm_ptr->size == 0) {                                                    \
+            _hash_map_destroy_##n(hm_ptr);                                          \
+            hm_ptr->keys = NULL;                                                    \
+            hm_ptr->values = NULL;                                                  \
+            hm_ptr->hashes = NULL;                                                  \
+            hm_ptr->capacity = 0;                                                   \
+            hm_ptr->old.keys = NULL;                                                \
+            hm_ptr->old.values = NULL;                                              \
+            hm_ptr->old.hashes = NULL;                                              \
+            hm_ptr->old.capacity = 0;                                               \
+            hm_ptr->old.migrated = 0;                                               \
+            return;                                                                 \
+        }                                                                           \
+        new_cap = _hash_map_capacity_for(hm_ptr->size, hm_ptr->max_load);           \
+        _hash_map_grow_##n(hm_ptr, MIN(new_cap, hm_ptr->capacity));                 \
+        _hash_map_migrate_##n(hm_ptr, SIZE_MAX);                                    \
+    }                                                                               \
                                                                                     \
     static inline size_t _hash_map_insert_with_hash_##n(                            \
         hash_map_t(n) *hm_ptr,                                                      \
@@ -275,9 +855,46 @@
         ValueT value                                                                \
     )                                                                               \
     {                                                                               \
+        size_t slot;                                                                \
+                                                                                    \
         hash_map_reserve(n, hm_ptr, hm_ptr->size + 1);                              \
-        hash = _hash_map_fix_hash(hash);                                            \
-        return _hash_map_insert_ll_##n(hm_ptr, hash, key, value);                   \
+        _hash_map_migrate_##n(hm_ptr, HASH_MAP_MIGRATION_SLOTS);                    \
+        hash = _hash_map_prepare_hash(policy, hash);                                \
+        slot = _hash_map_insert_ll_##n(hm_ptr, hash, key, value);                   \
+        hm_ptr->size += 1;                                                          \
+        return slot;                                                                \
+    }                                                                               \
+                                                                                    \
+    static inline void _hash_map_insert_batch_##n(                                  \
+        hash_map_t(n) *hm_ptr,                                                      \
+        KeyT const *keys,                                                           \
+        ValueT const *values,                                                       \
+        size_t count                                                                \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hashes[HASH_MAP_BATCH_SIZE];                                   \
+                                                                                    \
+        (void)values;                                                               \
+        hash_map_reserve(n, hm_ptr, hm_ptr->size + count);                          \
+        for (size_t i = 0; i < count; i += HASH_MAP_BATCH_SIZE) {                   \
+            size_t batch = MIN(count - i, (size_t)HASH_MAP_BATCH_SIZE);             \
+                                                                                    \
+            for (size_t j = 0; j < batch; ++j) {                                    \
+                size_t slot;                                                        \
+                                                                                    \
+                hashes[j] = _hash_map_prepare_hash(policy, key_hash(keys[i + j]));  \
+                slot = _hash_map_ideal_slot(policy, hashes[j], hm_ptr->capacity);   \
+                _hash_map_prefetch_slot(has_values, prefetch_write, hm_ptr, slot);  \
+            }                                                                       \
+            for (size_t j = 0; j < batch; ++j) {                                    \
+                _hash_map_migrate_##n(hm_ptr, HASH_MAP_MIGRATION_SLOTS);            \
+                _hash_map_insert_ll_##n(                                            \
+                    hm_ptr, hashes[j], keys[i + j],                                 \
+                    _hash_map_if_values(has_values, values[i + j], (ValueT){0})     \
+                );                                                                  \
+                hm_ptr->size += 1;                                                  \
+            }                                                                       \
+        }                                                                           \
     }                                                                               \
                                                                                     \
     static inline size_t _hash_map_insert_##n(                                      \
@@ -291,13 +908,134 @@
         return hash_map_insert_with_hash(n, hm_ptr, hash, key, value);              \
     }                                                                               \
                                                                                     \
-    static inline void _hash_map_erase_pos_##n(hash_map_t(n) *hm_ptr, size_t pos)   \
+    static inline size_t _hash_map_find_or_insert_##n(                              \
+        hash_map_t(n) *hm_ptr,                                                      \
+        hash_value_t hash,                                                          \
+        KeyT key,                                                                   \
+        bool *inserted_ptr                                                          \
+    )                                                                               \
     {                                                                               \
-        hm_ptr->hashes[pos] |= bitmasknth_type(                                     \
-            bitsizeof(hash_value_t) - 1,                                            \
-            hash_value_t                                                            \
+        size_t cur_slot;                                                            \
+        size_t cur_dist = 0;                                                        \
+        bool dummy;                                                                 \
+                                                                                    \
+        if (inserted_ptr == NULL) {                                                 \
+            inserted_ptr = &dummy;                                                  \
+        }                                                                           \
+        *inserted_ptr = false;                                                      \
+        hash = _hash_map_prepare_hash(policy, hash);                                \
+        /* Probe twice when about to grow, not to grow for a key already there */   \
+        if (unlikely(hm_ptr->capacity * hm_ptr->max_load / 100 <= hm_ptr->size)) {  \
+            cur_slot = _hash_map_find_prepared_##n(hm_ptr, hash, key);              \
+            if (cur_slot != hash_map_npos) {                                        \
+                return cur_slot;                                                    \
+            }                                                                       \
+            hash_map_reserve(n, hm_ptr, hm_ptr->size + 1);                          \
+        }                                                                           \
+        _hash_map_migrate_##n(hm_ptr, HASH_MAP_MIGRATION_SLOTS);                    \
+        cur_slot = _hash_map_ideal_slot(policy, hash, hm_ptr->capacity);            \
+        for (;;) {                                                                  \
+            hash_value_t other_hash =                                               \
+                _hash_map_at(hm_ptr, hm_ptr->hashes, cur_slot);                     \
+                                                                                    \
+            if (                                                                    \
+                _hash_map_is_empty_slot(other_hash) ||                              \
+                cur_dist >                                                          \
+                _hash_map_distance_to_ideal(                                        \
+                    policy, other_hash, cur_slot, hm_ptr->capacity                  \
+                )                                                                   \
+            ) {                                                                     \
+                break;                                                              \
+            } else if (                                                             \
+                other_hash == hash &&                                               \
+                key_cmp(key, _hash_map_at(hm_ptr, hm_ptr->keys, cur_slot)) == 0     \
+            ) {                                                                     \
+                return cur_slot;                                                    \
+            }                                                                       \
+            cur_slot = _hash_map_next_slot(policy, cur_slot, hm_ptr->capacity);     \
+            cur_dist += 1;                                                          \
+        }                                                                           \
+        if (unlikely(hm_ptr->old.hashes != NULL)) {                                 \
+            size_t old_slot = _hash_map_find_ll_##n(                                \
+                hm_ptr, hm_ptr->old.hashes, hm_ptr->old.keys, hm_ptr->old.capacity, \
+                hash, key                                                           \
+            );                                                                      \
+                                                                                    \
+            if (old_slot != hash_map_npos) {                                        \
+                return hm_ptr->capacity + old_slot;                                 \
+            }                                                                       \
+        }                                                                           \
+        /* The probe stopped right where the key belongs */                         \
+        cur_slot = _hash_map_insert_from_##n(                                       \
+            hm_ptr, cur_slot, cur_dist, hash, key, (ValueT){0}                      \
         );                                                                          \
+        hm_ptr->size += 1;                                                          \
+        *inserted_ptr = true;                                                       \
+        return cur_slot;                                                            \
+    }                                                                               \
+                                                                                    \
+    static inline ValueT *_hash_map_try_emplace_with_hash_##n(                      \
+        hash_map_t(n) *hm_ptr,                                                      \
+        hash_value_t hash,                                                          \
+        KeyT key,                                                                   \
+        bool *inserted_ptr                                                          \
+    )                                                                               \
+    {                                                                               \
+        size_t pos = _hash_map_find_or_insert_##n(hm_ptr, hash, key, inserted_ptr); \
+                                                                                    \
+        return &hash_map_value_at(hm_ptr, pos);                                     \
+    }                                                                               \
+                                                                                    \
+    static inline ValueT *_hash_map_try_emplace_##n(                                \
+        hash_map_t(n) *hm_ptr,                                                      \
+        KeyT key,                                                                   \
+        bool *inserted_ptr                                                          \
+    )                                                                               \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+                                                                                    \
+        return hash_map_try_emplace_with_hash(n, hm_ptr, hash, key, inserted_ptr);  \
+    }                                                                               \
+                                                                                    \
+    static inline void _hash_map_shift_back_##n(hash_map_t(n) *hm_ptr, size_t pos)  \
+    {                                                                               \
+        size_t next = _hash_map_next_slot(policy, pos, hm_ptr->capacity);           \
+                                                                                    \
+        hash_value_t next_hash = _hash_map_at(hm_ptr, hm_ptr->hashes, next);        \
+                                                                                    \
+        while (                                                                     \
+            !_hash_map_is_empty_slot(next_hash) &&                                  \
+            _hash_map_distance_to_ideal(                                            \
+                policy, next_hash, next, hm_ptr->capacity                           \
+            ) != 0                                                                  \
+        ) {                                                                         \
+            _hash_map_put(                                                          \
+                has_values, hm_ptr, pos, next_hash,                                 \
+                _hash_map_at(hm_ptr, hm_ptr->keys, next),                           \
+                _hash_map_if_values(                                                \
+                    has_values, _hash_map_at(hm_ptr, hm_ptr->values, next), 0       \
+                )                                                                   \
+            );                                                                      \
+            pos = next;                                                             \
+            next = _hash_map_next_slot(policy, next, hm_ptr->capacity);             \
+            next_hash = _hash_map_at(hm_ptr, hm_ptr->hashes, next);                 \
+        }                                                                           \
+        _hash_map_at(hm_ptr, hm_ptr->hashes, pos) = 0;                              \
+    }                                                                               \
+                                                                                    \
+    static inline void _hash_map_erase_pos_##n(hash_map_t(n) *hm_ptr, size_t pos)   \
+    {                                                                               \
+        if (unlikely(pos >= hm_ptr->capacity)) {                                    \
+            /* Shifting could move elements behind the slots already moved */       \
+            _hash_map_at(hm_ptr, hm_ptr->old.hashes, pos - hm_ptr->capacity) |=     \
+                _hash_map_tombstone_bit;                                            \
+        } else if (hm_ptr->backward_shift) {                                        \
+            _hash_map_shift_back_##n(hm_ptr, pos);                                  \
+        } else {                                                                    \
+            _hash_map_at(hm_ptr, hm_ptr->hashes, pos) |= _hash_map_tombstone_bit;   \
+        }                                                                           \
         --hm_ptr->size;                                                             \
+        _hash_map_migrate_##n(hm_ptr, HASH_MAP_MIGRATION_SLOTS);                    \
     }                                                                               \
                                                                                     \
     static inline void _hash_map_erase_##n(hash_map_t(n) *hm_ptr, KeyT const key)   \
@@ -308,12 +1046,31 @@
             hash_map_erase_pos(n, hm_ptr, slot);                                    \
         }                                                                           \
     }                                                                               \
-                                                                                    \
     struct _allow_semi_colon_##n { int unused; }
 
+/**
+ * Get the smallest capacity holding a given amount of elements within a given load factor
+ */
+static _always_inline_ size_t _hash_map_capacity_for(size_t size, unsigned int max_load)
+{
+    return (size * 100 + max_load - 1) / max_load;
+}
+
+static inline int _hash_map_set_factor(unsigned int *factor, unsigned int percent, unsigned int min, unsigned int max)
+{
+    if (percent < min || percent > max) {
+        return -1;
+    }
+    *factor = percent;
+    return 0;
+}
+
+#define _hash_map_tombstone_bit                                                     \
+    bitmasknth_type(bitsizeof(hash_value_t) - 1, hash_value_t)
+
 static _always_inline_ hash_value_t _hash_map_fix_hash(hash_value_t hash)
 {
-    hash &= ~bitmasknth_type(bitsizeof(hash_value_t) - 1, hash_value_t);
+    hash &= ~_hash_map_tombstone_bit;
     hash |= hash == 0;
     return hash;
 }
@@ -324,15 +1081,220 @@ static _always_inline_ hash_value_t _hash_map_fix_hash(hash_value_t hash)
 #define _hash_map_is_tombstone(hash)                                                \
     (hash >> (bitsizeof(hash_value_t) - 1) != 0)
 
-#define _hash_map_distance_to_ideal(hm_ptr, slot)                                   \
-    (((hm_ptr)->capacity + slot - (hm_ptr)->hashes[slot] % (hm_ptr)->capacity) % (hm_ptr)->capacity)
+/* Elements have hashes in [1, 2^63) */
+#define _hash_map_is_full(hash)                                                     \
+    ((hash_value_t)(hash) - 1 < _hash_map_tombstone_bit - 1)
+
+/* The amount of slots checked at once when looking for runs of empty slots: a cache line of packed hashes */
+#define _HASH_MAP_SCAN_WIDTH        8
+
+#define _hash_map_hash_at(hashes, stride, slot)                                     \
+    (*(const hash_value_t *)((const char *)(hashes) + (slot) * (stride)))
+
+/**
+ * Find the first slot holding an element, starting from a given one, hashes being stride bytes apart
+ */
+static inline size_t _hash_map_next_full_slot(
+    const hash_value_t *hashes,
+    size_t stride,
+    size_t cap,
+    size_t slot
+)
+{
+    while (slot < cap) {
+        size_t group_end = MIN((slot | (_HASH_MAP_SCAN_WIDTH - 1)) + 1, cap);
+
+        for (; slot < group_end; ++slot) {
+            if (_hash_map_is_full(_hash_map_hash_at(hashes, stride, slot))) {
+                return slot;
+            }
+        }
+        /* Empty slots have null hashes, so that a whole group of them can be skipped with a single test */
+        while (slot + _HASH_MAP_SCAN_WIDTH <= cap) {
+            hash_value_t any = 0;
+
+            for (size_t i = 0; i < _HASH_MAP_SCAN_WIDTH; ++i) {
+                any |= _hash_map_hash_at(hashes, stride, slot + i);
+            }
+            if (any != 0) {
+                break;
+            }
+            slot += _HASH_MAP_SCAN_WIDTH;
+        }
+    }
+    return hash_map_npos;
+}
+
+/**
+ * Find the first position holding an element, starting from a given one, in the new table then in the old one
+ */
+static inline size_t _hash_map_next_full_pos(
+    size_t stride,
+    const hash_value_t *hashes,
+    size_t cap,
+    const hash_value_t *old_hashes,
+    size_t old_cap,
+    size_t pos
+)
+{
+    if (pos < cap) {
+        pos = _hash_map_next_full_slot(hashes, stride, cap, pos);
+        if (pos != hash_map_npos) {
+            return pos;
+        }
+        pos = cap;
+    }
+    if (old_hashes != NULL) {
+        pos = _hash_map_next_full_slot(old_hashes, stride, old_cap, pos - cap);
+        if (pos != hash_map_npos) {
+            return cap + pos;
+        }
+    }
+    return hash_map_npos;
+}
+
+#define _hash_map_next_pos(hm_ptr, pos)                                             \
+    _hash_map_next_full_pos(                                                        \
+        _hash_map_stride(hm_ptr, (hm_ptr)->hashes),                                 \
+        (hm_ptr)->hashes, (hm_ptr)->capacity,                                       \
+        (hm_ptr)->old.hashes, (hm_ptr)->old.capacity,                               \
+        pos                                                                         \
+    )
+
+static _always_inline_ size_t _hash_map_ceil_pow2(size_t n)
+{
+    return n <= 1 ? 1 : (size_t)1 << (bitsizeof(size_t) - (size_t)__builtin_clzl(n - 1));
+}
+
+static _always_inline_ size_t _hash_map_floor_pow2(size_t n)
+{
+    return (size_t)1 << (bitsizeof(size_t) - 1 - (size_t)__builtin_clzl(n));
+}
+
+/**
+ * Reduce a hash to [0, cap) using the high bits of the hash, without any division
+ *
+ * Stored hashes have their top bit cleared, so they are scaled as 63-bit numbers.
+ */
+static _always_inline_ size_t _hash_map_fastrange(hash_value_t hash, size_t cap)
+{
+#ifdef __SIZEOF_INT128__
+    return (size_t)(((unsigned __int128)hash * cap) >> (bitsizeof(hash_value_t) - 1));
+#else
+    return (size_t)(((hash >> 31) * cap) >> 32);
+#endif
+}
+
+/*
+ * Capacity policies
+ *
+ * Each policy tells how to round a requested capacity, how much of an allocated capacity to use, how to mix
+ * a hash before storing it, how to reduce it to its ideal slot, and how to walk to the next slot.
+ */
+
+#define _hash_map_round_capacity_HASH_MAP_POW2(cap)         _hash_map_ceil_pow2(cap)
+#define _hash_map_usable_capacity_HASH_MAP_POW2(cap)        _hash_map_floor_pow2(cap)
+#define _hash_map_mix_HASH_MAP_POW2(hash)                   ((hash) ^ ((hash) >> 32))
+#define _hash_map_ideal_slot_HASH_MAP_POW2(hash, cap)       ((size_t)(hash) & ((cap) - 1))
+#define _hash_map_next_slot_HASH_MAP_POW2(slot, cap)        (((slot) + 1) & ((cap) - 1))
+#define _hash_map_distance_HASH_MAP_POW2(ideal, slot, cap)  (((slot) - (ideal)) & ((cap) - 1))
+
+#define _hash_map_round_capacity_HASH_MAP_FASTRANGE(cap)    (cap)
+#define _hash_map_usable_capacity_HASH_MAP_FASTRANGE(cap)   (cap)
+#define _hash_map_mix_HASH_MAP_FASTRANGE(hash)              (hash)
+#define _hash_map_ideal_slot_HASH_MAP_FASTRANGE(hash, cap)  _hash_map_fastrange(hash, cap)
+#define _hash_map_next_slot_HASH_MAP_FASTRANGE(slot, cap)   ((slot) + 1 == (cap) ? 0 : (slot) + 1)
+#define _hash_map_distance_HASH_MAP_FASTRANGE(ideal, slot, cap)                     \
+    ((slot) >= (ideal) ? (slot) - (ideal) : (cap) + (slot) - (ideal))
+
+#define _hash_map_round_capacity_HASH_MAP_MODULO(cap)       (cap)
+#define _hash_map_usable_capacity_HASH_MAP_MODULO(cap)      (cap)
+#define _hash_map_mix_HASH_MAP_MODULO(hash)                 (hash)
+#define _hash_map_ideal_slot_HASH_MAP_MODULO(hash, cap)     ((size_t)((hash) % (cap)))
+#define _hash_map_next_slot_HASH_MAP_MODULO(slot, cap)      (((slot) + 1) % (cap))
+#define _hash_map_distance_HASH_MAP_MODULO(ideal, slot, cap)                        \
+    (((cap) + (slot) - (ideal)) % (cap))
 
-#define _hash_map_put(hm_ptr, slot, h, k, v)                                        \
+/*
+ * Values
+ *
+ * Hash sets are generated from the same code as hash maps, without a values array: every access to the values
+ * goes through _hash_map_if_values, which expands to its first argument for hash maps, and to its second one
+ * for hash sets.
+ */
+
+#define _hash_map_if_values_1(yes, no)                      yes
+#define _hash_map_if_values_0(yes, no)                      no
+
+#define _hash_map_if_values(has_values, yes, no)                                    \
+    _hash_map_if_values_##has_values(yes, no)
+
+#define _hash_map_round_capacity(policy, cap)                                       \
+    _hash_map_round_capacity_##policy(cap)
+
+#define _hash_map_usable_capacity(policy, cap)                                      \
+    _hash_map_usable_capacity_##policy(cap)
+
+#define _hash_map_prepare_hash(policy, hash)                                        \
+    _hash_map_fix_hash(_hash_map_mix_##policy(hash))
+
+#define _hash_map_ideal_slot(policy, hash, cap)                                     \
+    _hash_map_ideal_slot_##policy(hash, cap)
+
+#define _hash_map_next_slot(policy, slot, cap)                                      \
+    _hash_map_next_slot_##policy(slot, cap)
+
+/* The tombstone bit is not part of the hash, and must not move the ideal slot of an erased element */
+#define _hash_map_distance_to_ideal(policy, hash, slot, cap)                        \
+    _hash_map_distance_##policy(                                                    \
+        _hash_map_ideal_slot(                                                       \
+            policy, (hash) & ~_hash_map_tombstone_bit, cap                          \
+        ),                                                                          \
+        slot,                                                                       \
+        cap                                                                         \
+    )
+
+/*
+ * Layouts
+ *
+ * Every hash map type has a zero-sized _stride member, whose element size tells how far apart two slots of
+ * its arrays are: 0 with the HASH_MAP_SOA layout, where each array is packed and indexed normally, and the
+ * size of a bucket with the HASH_MAP_AOS layout, where keys, values and hashes point into the same array of
+ * buckets. Since it is known at compile time, slots are accessed with plain indexing in the former case.
+ */
+
+#define _hash_map_stride_HASH_MAP_SOA(bucket_size)          0
+#define _hash_map_stride_HASH_MAP_AOS(bucket_size)          (bucket_size)
+
+#define _hash_map_is_interleaved(hm_ptr)                                            \
+    (sizeof((hm_ptr)->_stride[0]) != 0)
+
+#define _hash_map_stride(hm_ptr, array)                                             \
+    (_hash_map_is_interleaved(hm_ptr) ? sizeof((hm_ptr)->_stride[0]) : sizeof(*(array)))
+
+/* Access a slot of one of the arrays of a hash map (or of its old table) */
+#define _hash_map_at(hm_ptr, array, slot)                                           \
+    (*(typeof(&*(array)))((char *)(array) + (slot) * _hash_map_stride(hm_ptr, array)))
+
+/* Bring the slot of an element into the cache, all of it being in the bucket of its hash when interleaved */
+#define _hash_map_prefetch_slot(has_values, prefetch_fn, hm_ptr, slot)              \
     do {                                                                            \
-        hm_ptr->hashes[slot] = h;                                                   \
-        hm_ptr->keys[slot] = k;                                                     \
-        hm_ptr->values[slot] = v;                                                   \
-        hm_ptr->size += 1;                                                          \
+        prefetch_fn(&_hash_map_at(hm_ptr, (hm_ptr)->hashes, slot));                 \
+        if (!_hash_map_is_interleaved(hm_ptr)) {                                    \
+            prefetch_fn(&(hm_ptr)->keys[slot]);                                     \
+            _hash_map_if_values(                                                    \
+                has_values, prefetch_fn(&(hm_ptr)->values[slot]),                   \
+            );                                                                      \
+        }                                                                           \
+    } while (0)
+
+#define _hash_map_put(has_values, hm_ptr, slot, h, k, v)                            \
+    do {                                                                            \
+        _hash_map_at(hm_ptr, hm_ptr->hashes, slot) = h;                             \
+        _hash_map_at(hm_ptr, hm_ptr->keys, slot) = k;                               \
+        _hash_map_if_values(                                                        \
+            has_values, _hash_map_at(hm_ptr, hm_ptr->values, slot) = v, (void)v     \
+        );                                                                          \
     } while (0)
 
 #endif /* !CEEDS_HASH_MAP_H */
@@ -0,0 +1,213 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_HASH_SET_H
+#define CEEDS_HASH_SET_H
+
+#include <ceeds/hash_map.h>
+
+/**
+ * Hash sets
+ *
+ * Hash sets are hash maps without values: they are generated from the same code, probe the same way and
+ * accept the same capacity policies, but never allocate, store or move anything but keys and hashes.
+ *
+ * Unlike hash_map_insert, inserting a key which is already in the set does nothing.
+ *
+ * The accessors and settings of hash maps which take no type name apply to hash sets as well (hash_map_size,
+ * hash_map_key_at, hash_map_for_each, hash_map_set_max_load, hash_map_set_incremental_resize...).
+ */
+
+#define hash_set_t(n)               hash_map_t(set_##n)
+
+#define hash_set_empty(alloc_handle)                                                \
+    hash_map_empty(alloc_handle)
+
+/**
+ * Destroy a hash set
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set to destroy
+ */
+#define hash_set_destroy(n, hs_ptr)                                                 \
+    _hash_map_destroy_set_##n(hs_ptr)
+
+/**
+ * Get the size of a hash set (i.e. the number of keys in the set)
+ *
+ * @param[in]       hs_ptr          a pointer to the hash set
+ */
+#define hash_set_size(hs_ptr)       hash_map_size(hs_ptr)
+
+/**
+ * Increase the capacity of a hash set so that it can hold a given amount of keys without growing
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set
+ * @param[in]       new_size        the amount of keys
+ */
+#define hash_set_reserve(n, hs_ptr, new_size)                                       \
+    _hash_map_reserve_set_##n(hs_ptr, new_size)
+
+/**
+ * Reduce the capacity of a hash set to the smallest one holding its keys within its maximum load factor
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set
+ */
+#define hash_set_shrink_to_fit(n, hs_ptr)                                           \
+    _hash_map_shrink_to_fit_set_##n(hs_ptr)
+
+/**
+ * Insert a key into a hash set, unless it is already there
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set
+ * @param[in]       key             the key to insert
+ * @return                          true if the key was inserted, false if it was already in the set
+ */
+#define hash_set_insert(n, hs_ptr, key)                                             \
+    _hash_set_insert_##n(hs_ptr, key)
+
+/**
+ * Insert a key into a hash set, unless it is already there, when already knowing its hashed value
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set
+ * @param[in]       hash            the hash of the key
+ * @param[in]       key             the key to insert
+ * @return                          true if the key was inserted, false if it was already in the set
+ */
+#define hash_set_insert_with_hash(n, hs_ptr, hash, key)                             \
+    _hash_set_insert_with_hash_##n(hs_ptr, hash, key)
+
+/**
+ * Find the position of a key in a hash set
+ *
+ * @param           n               the name of the hash set type
+ * @param[in]       hs_ptr          a pointer to the hash set
+ * @param[in]       key             the key to search for
+ * @return                          the position of the key if found, hash_map_npos otherwise
+ */
+#define hash_set_find(n, hs_ptr, key)                                               \
+    _hash_map_find_set_##n(hs_ptr, key)
+
+/**
+ * Check whether a hash set contains a key
+ *
+ * @param           n               the name of the hash set type
+ * @param[in]       hs_ptr          a pointer to the hash set
+ * @param[in]       key             the key to search for
+ */
+#define hash_set_contains(n, hs_ptr, key)                                           \
+    (hash_set_find(n, hs_ptr, key) != hash_map_npos)
+
+/**
+ * Find the positions of several keys in a hash set (see hash_map_find_batch)
+ *
+ * @param           n               the name of the hash set type
+ * @param[in]       hs_ptr          a pointer to the hash set
+ * @param[in]       keys            the keys to search for
+ * @param[in]       count           the amount of keys
+ * @param[out]      positions       the position of every key if found, hash_map_npos otherwise
+ */
+#define hash_set_find_batch(n, hs_ptr, keys, count, positions)                      \
+    _hash_map_find_batch_set_##n(hs_ptr, keys, count, positions)
+
+/**
+ * Erase the key at a given position in a hash set
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set
+ * @param[in]       pos             the position of the key, as returned by hash_set_find
+ */
+#define hash_set_erase_pos(n, hs_ptr, pos)                                          \
+    _hash_map_erase_pos_set_##n(hs_ptr, pos)
+
+/**
+ * Erase a key from a hash set, if it is there
+ *
+ * @param           n               the name of the hash set type
+ * @param[in,out]   hs_ptr          a pointer to the hash set
+ * @param[in]       key             the key to erase
+ */
+#define hash_set_erase(n, hs_ptr, key)                                              \
+    _hash_map_erase_set_##n(hs_ptr, key)
+
+/**
+ * Append all the keys of a hash set to a vector, in iteration order (see hash_map_for_each)
+ *
+ * Nothing is appended if the vector can't grow to hold every key.
+ *
+ * @param[in]       hs_ptr          a pointer to the hash set
+ * @param[in,out]   keys_vec_ptr    a pointer to the vector of keys to append to
+ */
+#define hash_set_to_vector(hs_ptr, keys_vec_ptr)                                    \
+    do {                                                                            \
+        typeof(hs_ptr) __hs_ptr = (hs_ptr);                                         \
+        typeof(keys_vec_ptr) __keys_ptr = (keys_vec_ptr);                           \
+                                                                                    \
+        if (vector_reserve(__keys_ptr, __keys_ptr->size + __hs_ptr->size) == 0) {   \
+            hash_map_for_each(__hs_ptr, __pos) {                                    \
+                __keys_ptr->data[__keys_ptr->size++] =                              \
+                    hash_map_key_at(__hs_ptr, __pos);                               \
+            }                                                                       \
+        }                                                                           \
+    } while (0)
+
+/**
+ * Create a hash set type, using the HASH_MAP_POW2 capacity policy
+ *
+ * @param           n               the name of the hash set type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_HASH_SET_TYPE(n, KeyT, key_hash, key_cmp)                              \
+    MAKE_HASH_SET_TYPE_WITH_POLICY(n, KeyT, key_hash, key_cmp, HASH_MAP_POW2)
+
+/**
+ * Create a hash set type, using a given capacity policy
+ *
+ * @param           n               the name of the hash set type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ * @param           policy          the capacity policy: HASH_MAP_POW2, HASH_MAP_FASTRANGE or HASH_MAP_MODULO
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_HASH_SET_TYPE_WITH_POLICY(n, KeyT, key_hash, key_cmp, policy)          \
+    _MAKE_HASH_TABLE_TYPE(                                                          \
+        set_##n, KeyT, char, key_hash, key_cmp, policy, HASH_MAP_SOA, 0             \
+    );                                                                              \
+                                                                                    \
+    static inline bool _hash_set_insert_with_hash_##n(                              \
+        hash_set_t(n) *hs_ptr,                                                      \
+        hash_value_t hash,                                                          \
+        KeyT key                                                                    \
+    )                                                                               \
+    {                                                                               \
+        bool inserted;                                                              \
+                                                                                    \
+        _hash_map_find_or_insert_set_##n(hs_ptr, hash, key, &inserted);             \
+        return inserted;                                                            \
+    }                                                                               \
+                                                                                    \
+    static inline bool _hash_set_insert_##n(hash_set_t(n) *hs_ptr, KeyT key)        \
+    {                                                                               \
+        hash_value_t hash = key_hash(key);                                          \
+                                                                                    \
+        return hash_set_insert_with_hash(n, hs_ptr, hash, key);                     \
+    }                                                                               \
+                                                                                    \
+    struct _allow_semi_colon_hash_set_##n { int unused; }
+
+#endif /* !CEEDS_HASH_SET_H */
@@ -76,8 +76,163 @@ struct memory_allocator
      * @pre                             @p new_align must be a power of 2
      */
     void *(*reallocate)(memory_allocator_handle_t alloc, void *ptr, size_t old_size, size_t new_size, size_t new_align);
+
+    /**
+     * Deallocate previously allocated memory, knowing its size
+     *
+     * This entry point is optional: if it is NULL, deallocate is used instead.
+     *
+     * @param[in]           alloc       a pointer to the allocator handle used for this allocation
+     * @param[in]           ptr         a pointer to the allocated memory
+     * @param[in]           size        the size of the memory block
+     *
+     * @pre                             @p size must be between the amount of bytes requested for @p ptr and the
+     *                                  usable size reported for it, if any
+     */
+    void (*sized_deallocate)(memory_allocator_handle_t alloc, void *ptr, size_t size);
+
+    /**
+     * Allocate at least a given amount of memory, reporting the amount actually usable
+     *
+     * This entry point is optional: if it is NULL, allocate is used instead, and the usable size is the
+     * requested one.
+     *
+     * @param[in]           alloc       a pointer to the allocator handle used for this allocation
+     * @param[in]           size        the minimum amount of bytes to allocate
+     * @param[in]           align       the minimum alignment required for the allocated memory
+     * @param[out]          usable_size the amount of bytes actually usable in the allocated memory
+     * @return                          a pointer to the beginning of the newly allocated memory
+     *
+     * @pre                             @p align must be a power of 2
+     */
+    void *(*allocate_at_least)(memory_allocator_handle_t alloc, size_t size, size_t align, size_t *usable_size);
+
+    /**
+     * Resize a previously allocated memory block to at least a given size, keeping the data and reporting
+     * the amount of memory actually usable
+     *
+     * This entry point is optional: if it is NULL, reallocate is used instead, and the usable size is the
+     * requested one. It follows the same rules as reallocate otherwise.
+     *
+     * @param[in]           alloc       a pointer to the allocator handle used for this allocation
+     * @param[in,out]       ptr         a pointer to the previously allocated memory
+     * @param[in]           old_size    the amount of bytes allocated for @p ptr
+     * @param[in]           new_size    the minimum new amount of bytes to allocate
+     * @param[in]           new_align   the new minimum alignment required for the allocated memory
+     * @param[out]          usable_size the amount of bytes actually usable in the allocated memory
+     * @return                          a pointer to the beginning of the newly allocated memory
+     *
+     * @pre                             @p ptr must be a pointer to memory previously allocated using @p alloc, or NULL
+     * @pre                             @p new_align must be a power of 2
+     */
+    void *(*reallocate_at_least)(
+        memory_allocator_handle_t alloc,
+        void *ptr,
+        size_t old_size,
+        size_t new_size,
+        size_t new_align,
+        size_t *usable_size
+    );
+
+    /**
+     * Give the memory the allocator keeps around without using it back to the system
+     *
+     * This entry point is optional: if it is NULL, trimming does nothing.
+     *
+     * @param[in]           alloc       a pointer to the allocator handle
+     * @return                          the amount of bytes given back, as far as the allocator knows
+     */
+    size_t (*trim)(memory_allocator_handle_t alloc);
 };
 
+/**
+ * Deallocate memory of a known size, using the allocator's sized entry point when it has one
+ *
+ * @param[in]               handle      a handle to the allocator to use
+ * @param[in]               ptr         a pointer to the memory to deallocate
+ * @param[in]               size        the size of the memory block
+ *
+ * @pre                                 @p size must be between the amount of bytes requested for @p ptr and the
+ *                                      usable size reported for it, if any
+ */
+static inline void allocator_sized_deallocate(memory_allocator_handle_t handle, void *ptr, size_t size)
+{
+    if (handle->sized_deallocate != NULL) {
+        handle->sized_deallocate(handle, ptr, size);
+    } else {
+        handle->deallocate(handle, ptr);
+    }
+}
+
+/**
+ * Allocate at least a given amount of memory, reporting the amount actually usable
+ *
+ * @param[in]               handle      a handle to the allocator to use
+ * @param[in]               size        the minimum amount of bytes to allocate
+ * @param[in]               align       the minimum alignment required for the allocated memory
+ * @param[out]              usable_size the amount of bytes actually usable in the allocated memory
+ * @return                              a pointer to the beginning of the newly allocated memory
+ *
+ * @pre                                 @p align must be a power of 2
+ */
+static inline void *allocator_allocate_at_least(
+    memory_allocator_handle_t handle,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    if (handle->allocate_at_least != NULL) {
+        return handle->allocate_at_least(handle, size, align, usable_size);
+    }
+    *usable_size = size;
+    return handle->allocate(handle, size, align);
+}
+
+/**
+ * Resize a previously allocated memory block to at least a given size, reporting the amount actually usable
+ *
+ * @param[in]               handle      a handle to the allocator
+ * @param[in,out]           ptr         a pointer to the previously allocated memory
+ * @param[in]               old_size    the amount of bytes allocated for @p ptr
+ * @param[in]               new_size    the minimum new amount of bytes to allocate
+ * @param[in]               new_align   the new minimum alignment required for the allocated memory
+ * @param[out]              usable_size the amount of bytes actually usable in the allocated memory
+ * @return                              a pointer to the beginning of the newly allocated memory
+ *
+ * @pre                                 @p ptr must be a pointer to memory previously allocated using @p handle, or NULL
+ * @pre                                 @p new_align must be a power of 2
+ */
+static inline void *allocator_reallocate_at_least(
+    memory_allocator_handle_t handle,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    if (handle->reallocate_at_least != NULL) {
+        return handle->reallocate_at_least(handle, ptr, old_size, new_size, new_align, usable_size);
+    }
+    *usable_size = new_size;
+    return handle->reallocate(handle, ptr, old_size, new_size, new_align);
+}
+
+/**
+ * Give the memory an allocator keeps around without using it back to the system
+ *
+ * Allocators which cache free memory only give it back on their own when some policy of theirs says so: this
+ * can be called once load drops, or periodically, so that the memory footprint follows the load back down.
+ *
+ * @param[in]               handle      a handle to the allocator to trim
+ * @return                              the amount of bytes given back, as far as the allocator knows
+ */
+static inline size_t allocator_trim(memory_allocator_handle_t handle)
+{
+    return handle->trim != NULL ? handle->trim(handle) : 0;
+}
+
 /**
  * Allocate memory from a given allocator to hold an object of a given type, with a given alignment
  *
@@ -216,4 +371,62 @@ struct memory_allocator
  */
 #define allocator_delete(handle, ptr)                       ((handle)->deallocate((handle), ptr))
 
+/**
+ * Allocate memory from a given allocator to hold at least a given number of objects of a given type,
+ * reporting how many objects actually fit in the allocated memory
+ *
+ * @param[in]               handle      a handle to the allocator to use
+ * @param                   T           the type of object to allocate memory for
+ * @param[in]               n           the minimum number of elements to allocate memory for
+ * @param[out]              actual_n    a pointer to a size_t receiving the number of elements that fit
+ * @return                              a pointer to the beginning of the newly allocated memory
+ */
+#define allocator_new_array_at_least(handle, T, n, actual_n)                            \
+    ({                                                                                  \
+        size_t __aal_usable;                                                            \
+        void *__aal_ptr = allocator_allocate_at_least(                                  \
+            handle, sizeof(T) * (n), alignof(T), &__aal_usable                          \
+        );                                                                              \
+                                                                                        \
+        *(actual_n) = __aal_usable / sizeof(T);                                         \
+        __aal_ptr;                                                                      \
+    })
+
+/**
+ * Change the size of the memory block allocated using a given allocator for a given array, so that it can hold
+ * at least a given number of elements, reporting how many elements actually fit in it.
+ * Data fitting in the new array will be kept.
+ *
+ * @param[in]               handle      a handle to the allocator
+ * @param[in,out]           ptr         a pointer to the allocated memory
+ * @param                   T           the type of object to allocate memory for
+ * @param[in]               old_n       the number of elements allocated in @p ptr
+ * @param[in]               new_n       the minimum number of elements to allocate
+ * @param[out]              actual_n    a pointer to a size_t receiving the number of elements that fit
+ * @return                              a pointer to the beginning of the newly allocated memory
+ *
+ * @pre                                 @p ptr must be a pointer to memory previously allocated using @p handle, or NULL
+ */
+#define allocator_resize_array_at_least(handle, ptr, T, old_n, new_n, actual_n)         \
+    ({                                                                                  \
+        size_t __aal_usable;                                                            \
+        void *__aal_ptr = allocator_reallocate_at_least(                                \
+            handle, ptr, sizeof(T) * (old_n), sizeof(T) * (new_n), alignof(T), &__aal_usable \
+        );                                                                              \
+                                                                                        \
+        *(actual_n) = __aal_usable / sizeof(T);                                         \
+        __aal_ptr;                                                                      \
+    })
+
+/**
+ * Deallocate an array previously allocated from a given allocator, passing its size along
+ *
+ * @param[in]               handle      a handle to the allocator to use
+ * @param[in]               ptr         a pointer to the memory to deallocate
+ * @param                   T           the type of the elements of the array
+ * @param[in]               n           the number of elements the array was allocated for
+ */
+#define allocator_delete_array(handle, ptr, T, n)                                       \
+    allocator_sized_deallocate(handle, ptr, sizeof(T) * (n))
+
 #endif /* !CEEDS_MEMORY_ALLOCATOR_H */
@@ -0,0 +1,27 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_MMAP_ALLOCATOR_H
+#define CEEDS_MMAP_ALLOCATOR_H
+
+#include <ceeds/memory.h>
+
+/**
+ * Large-block allocator
+ *
+ * The mmap allocator serves every request from its own anonymous mapping, and grows blocks with mremap, which
+ * moves page table entries around instead of copying bytes. Allocations are rounded up to whole pages (the
+ * rounded size is reported through allocate_at_least), so it is meant for very large arrays of trivially
+ * copyable objects rather than for small allocations.
+ *
+ * Blocks requiring an alignment stricter than the page size are supported, but are copied when they grow.
+ */
+extern struct memory_allocator mmap_allocator;
+
+/**
+ * Get a handle to the mmap allocator
+ */
+#define mmap_allocator_handle()     (&mmap_allocator)
+
+#endif /* !CEEDS_MMAP_ALLOCATOR_H */
@@ -0,0 +1,215 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_POOL_ALLOCATOR_H
+#define CEEDS_POOL_ALLOCATOR_H
+
+#include <ceeds/memory.h>
+
+/**
+ * Pool allocators, for objects of a fixed size
+ *
+ * Slots are carved out of page-sized slabs obtained from a backing allocator, and freed slots are kept in a
+ * free list threaded through the slots themselves, so that no per-object header is needed.
+ */
+
+#define POOL_SLAB_SIZE              4096
+#define POOL_MIN_SLOTS_PER_SLAB     8
+
+struct pool_slab
+{
+    struct pool_slab *next;
+};
+
+struct pool_free_slot
+{
+    struct pool_free_slot *next;
+};
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t backing;
+    size_t slot_size;
+    size_t slot_align;
+    size_t slab_size;
+    struct pool_slab *slabs;
+    struct pool_free_slot *free_list;
+    char *cur;
+    char *end;
+} pool_allocator_t;
+
+/**
+ * Initialize a pool allocator
+ *
+ * @param[out]      pool            the pool to initialize
+ * @param[in]       backing         the allocator handle used to allocate the slabs of the pool
+ * @param[in]       slot_size       the size of the objects to allocate from the pool
+ * @param[in]       slot_align      the alignment of the objects to allocate from the pool
+ *
+ * @pre                             @p slot_align must be a power of 2
+ */
+void pool_allocator_init(
+    pool_allocator_t *pool,
+    memory_allocator_handle_t backing,
+    size_t slot_size,
+    size_t slot_align
+);
+
+/**
+ * Destroy a pool allocator, releasing all its slabs
+ *
+ * @param[in,out]   pool            the pool to destroy
+ */
+void pool_allocator_destroy(pool_allocator_t *pool);
+
+/**
+ * Get a handle to a pool allocator
+ *
+ * Allocations made through the handle must not be bigger, nor require a stricter alignment, than the slots
+ * of the pool.
+ *
+ * @param[in]       pool_ptr        a pointer to the pool
+ */
+#define pool_allocator_handle(pool_ptr)     (&(pool_ptr)->base)
+
+bool _pool_allocator_add_slab(pool_allocator_t *pool);
+
+/**
+ * Allocate a slot from a pool allocator
+ *
+ * @param[in,out]   pool            the pool to allocate from
+ * @return                          a pointer to the slot, or NULL if the backing allocator failed
+ */
+static inline void *pool_allocator_allocate_slot(pool_allocator_t *pool)
+{
+    void *ptr;
+
+    if (pool->free_list != NULL) {
+        ptr = pool->free_list;
+        pool->free_list = pool->free_list->next;
+        return ptr;
+    }
+    if unlikely(pool->cur == pool->end && !_pool_allocator_add_slab(pool)) {
+        return NULL;
+    }
+    ptr = pool->cur;
+    pool->cur += pool->slot_size;
+    return ptr;
+}
+
+/**
+ * Give a slot back to a pool allocator
+ *
+ * @param[in,out]   pool            the pool the slot was allocated from
+ * @param[in]       ptr             a pointer to the slot
+ */
+static inline void pool_allocator_deallocate_slot(pool_allocator_t *pool, void *ptr)
+{
+    struct pool_free_slot *slot = ptr;
+
+    if (slot != NULL) {
+        slot->next = pool->free_list;
+        pool->free_list = slot;
+    }
+}
+
+/**
+ * Typed pools
+ */
+
+#define pool_t(n)                   pool_##n##_t
+
+/**
+ * Create a typed pool type
+ *
+ * @param           n               the name of the pool type to create
+ * @param           T               the type of the objects to allocate
+ */
+#define MAKE_POOL_TYPE(n, T)                                                \
+    typedef struct pool_t(n) {                                              \
+        pool_allocator_t allocator;                                         \
+    } pool_t(n);                                                            \
+                                                                            \
+    static inline void _pool_init_##n(                                      \
+        pool_t(n) *pool_ptr,                                                \
+        memory_allocator_handle_t backing                                   \
+    )                                                                       \
+    {                                                                       \
+        pool_allocator_init(&pool_ptr->allocator, backing, sizeof(T), alignof(T));  \
+    }                                                                       \
+                                                                            \
+    static inline T *_pool_new_##n(pool_t(n) *pool_ptr)                     \
+    {                                                                       \
+        return pool_allocator_allocate_slot(&pool_ptr->allocator);          \
+    }                                                                       \
+                                                                            \
+    static inline T *_pool_znew_##n(pool_t(n) *pool_ptr)                    \
+    {                                                                       \
+        T *ptr = pool_allocator_allocate_slot(&pool_ptr->allocator);        \
+                                                                            \
+        if likely(ptr != NULL) {                                            \
+            memset(ptr, 0, sizeof(T));                                      \
+        }                                                                   \
+        return ptr;                                                         \
+    }                                                                       \
+                                                                            \
+    static inline void _pool_delete_##n(pool_t(n) *pool_ptr, T *ptr)        \
+    {                                                                       \
+        pool_allocator_deallocate_slot(&pool_ptr->allocator, ptr);          \
+    }                                                                       \
+                                                                            \
+    struct _allow_semi_colon_pool_##n { int unused; }
+
+/**
+ * Initialize a typed pool
+ *
+ * @param           n               the name of the pool type
+ * @param[out]      pool_ptr        a pointer to the pool to initialize
+ * @param[in]       backing         the allocator handle used to allocate the slabs of the pool
+ */
+#define pool_init(n, pool_ptr, backing)     _pool_init_##n(pool_ptr, backing)
+
+/**
+ * Destroy a typed pool, releasing all the objects allocated from it
+ *
+ * @param[in,out]   pool_ptr        a pointer to the pool to destroy
+ */
+#define pool_destroy(pool_ptr)              pool_allocator_destroy(&(pool_ptr)->allocator)
+
+/**
+ * Get an allocator handle to a typed pool
+ *
+ * @param[in]       pool_ptr        a pointer to the pool
+ */
+#define pool_handle(pool_ptr)               pool_allocator_handle(&(pool_ptr)->allocator)
+
+/**
+ * Allocate an object from a typed pool
+ *
+ * @param           n               the name of the pool type
+ * @param[in,out]   pool_ptr        a pointer to the pool to allocate from
+ * @return                          a pointer to the newly allocated object
+ */
+#define pool_new(n, pool_ptr)               _pool_new_##n(pool_ptr)
+
+/**
+ * Allocate an object from a typed pool, zeroing it
+ *
+ * @param           n               the name of the pool type
+ * @param[in,out]   pool_ptr        a pointer to the pool to allocate from
+ * @return                          a pointer to the newly allocated object
+ */
+#define pool_znew(n, pool_ptr)              _pool_znew_##n(pool_ptr)
+
+/**
+ * Give an object back to a typed pool
+ *
+ * @param           n               the name of the pool type
+ * @param[in,out]   pool_ptr        a pointer to the pool the object was allocated from
+ * @param[in]       ptr             a pointer to the object
+ */
+#define pool_delete(n, pool_ptr, ptr)       _pool_delete_##n(pool_ptr, ptr)
+
+#endif /* !CEEDS_POOL_ALLOCATOR_H */
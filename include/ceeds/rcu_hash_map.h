@@ -0,0 +1,420 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_RCU_HASH_MAP_H
+#define CEEDS_RCU_HASH_MAP_H
+
+#include <ceeds/epoch.h>
+#include <ceeds/hash_map.h>
+
+/**
+ * RCU hash maps, for read-mostly workloads
+ *
+ * An RCU (read-copy-update) hash map is a pointer to an immutable hash map. Readers never take any lock: they
+ * enter a critical section of the epoch domain of the map (see epoch.h), load the current table, and read it
+ * as a regular hash map. Writers take a lock, copy the current table, modify the copy, and publish it
+ * atomically in place of the current one, which is retired and freed once no reader can still be reading it.
+ *
+ * Lookups only write to the epoch record of their own thread, so that they scale with the amount of cores and
+ * never wait, however often the map is updated. Readers see either the whole of an update or none of it, and
+ * keep seeing the same table until they leave their critical section. Every update copies the whole table
+ * though: several changes can be made at once with rcu_hash_map_update_begin and rcu_hash_map_update_commit.
+ *
+ * Tables use backward-shift deletion, so that erasures never leave tombstones behind to be copied over and
+ * over.
+ */
+
+#define rcu_hash_map_t(n)           rcu_hash_map_##n##_t
+
+/**
+ * Initialize an RCU hash map
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[out]      rhm_ptr         a pointer to the RCU hash map to initialize
+ * @param[in]       alloc_handle    the allocator handle used for the tables, usable from every writing thread
+ * @return                          0 on success, -1 if the table or the epoch domain could not be created
+ */
+#define rcu_hash_map_init(n, rhm_ptr, alloc_handle)                                 \
+    _rcu_hash_map_init_##n(rhm_ptr, alloc_handle)
+
+/**
+ * Destroy an RCU hash map, with all its tables
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map to destroy
+ *
+ * @pre                             no other thread must be using @p rhm_ptr anymore
+ */
+#define rcu_hash_map_destroy(n, rhm_ptr)                                            \
+    _rcu_hash_map_destroy_##n(rhm_ptr)
+
+/**
+ * Enter a read-side critical section, getting the current table of an RCU hash map
+ *
+ * The table can be read with the regular hash map functions (using rcu_##n as type name) until the matching
+ * call to rcu_hash_map_read_unlock, and does not change in the meantime. Critical sections can be nested, and
+ * updates can be made from inside of them (the table will not reflect them).
+ *
+ * Example:
+ * @code
+ * const hash_map_t(rcu_routes) *table = rcu_hash_map_read_lock(routes, &rhm);
+ * size_t pos = hash_map_find(rcu_routes, table, address);
+ *
+ * if (pos != hash_map_npos) {
+ *     forward(packet, hash_map_value_at(table, pos));
+ * }
+ * rcu_hash_map_read_unlock(routes, &rhm);
+ * @endcode
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in]       rhm_ptr         a pointer to the RCU hash map
+ * @return                          the current table, or NULL if the calling thread could not be registered
+ */
+#define rcu_hash_map_read_lock(n, rhm_ptr)                                          \
+    _rcu_hash_map_read_lock_##n(rhm_ptr)
+
+/**
+ * Leave a read-side critical section, after which the table it gave must not be used anymore
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in]       rhm_ptr         a pointer to the RCU hash map
+ */
+#define rcu_hash_map_read_unlock(n, rhm_ptr)                                        \
+    epoch_exit(&(rhm_ptr)->epochs)
+
+/**
+ * Look up a key in an RCU hash map, copying its value out
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in]       rhm_ptr         a pointer to the RCU hash map
+ * @param[in]       key             the key to search for
+ * @param[out]      value_ptr       where to copy the value of the key if found, or NULL
+ * @return                          true if the key was found, false otherwise
+ */
+#define rcu_hash_map_find(n, rhm_ptr, key, value_ptr)                               \
+    _rcu_hash_map_find_##n(rhm_ptr, key, value_ptr)
+
+/**
+ * Get the size of the current table of an RCU hash map
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in]       rhm_ptr         a pointer to the RCU hash map
+ */
+#define rcu_hash_map_size(n, rhm_ptr)                                               \
+    _rcu_hash_map_size_##n(rhm_ptr)
+
+/**
+ * Start updating an RCU hash map, getting a private copy of its current table
+ *
+ * The copy can be modified with the regular hash map functions (using rcu_##n as type name), until the matching
+ * call to rcu_hash_map_update_commit or rcu_hash_map_update_abort. Other writers wait in the meantime.
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map
+ * @return                          the copy of the current table, or NULL if it could not be allocated, in
+ *                                  which case the update is over and must be neither committed nor aborted
+ */
+#define rcu_hash_map_update_begin(n, rhm_ptr)                                       \
+    _rcu_hash_map_update_begin_##n(rhm_ptr)
+
+/**
+ * Publish the table being updated in an RCU hash map, retiring the previous one
+ *
+ * An incremental resize still in progress in the table is finished first: published tables are complete.
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map
+ */
+#define rcu_hash_map_update_commit(n, rhm_ptr)                                      \
+    _rcu_hash_map_update_commit_##n(rhm_ptr)
+
+/**
+ * Discard the table being updated in an RCU hash map, leaving the current one as is
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map
+ */
+#define rcu_hash_map_update_abort(n, rhm_ptr)                                       \
+    _rcu_hash_map_update_abort_##n(rhm_ptr)
+
+/**
+ * Insert an element into an RCU hash map, or replace the value of its key if it is already there
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map
+ * @param[in]       key             the key of the element
+ * @param[in]       value           the value of the element
+ * @return                          1 if the key was inserted, 0 if its value was replaced, -1 if the table
+ *                                  could not be copied
+ */
+#define rcu_hash_map_upsert(n, rhm_ptr, key, value)                                 \
+    _rcu_hash_map_upsert_##n(rhm_ptr, key, value)
+
+/**
+ * Erase the element with a given key in an RCU hash map, without copying anything if it is not there
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map
+ * @param[in]       key             the key to erase
+ * @return                          1 if the key was erased, 0 if it was not there, -1 if the table could not
+ *                                  be copied
+ */
+#define rcu_hash_map_erase(n, rhm_ptr, key)                                         \
+    _rcu_hash_map_erase_##n(rhm_ptr, key)
+
+/**
+ * Free the retired tables of an RCU hash map which no reader can still be reading
+ *
+ * Retired tables are also freed on every update: this is only needed to free them sooner.
+ *
+ * @param           n               the name of the RCU hash map type
+ * @param[in,out]   rhm_ptr         a pointer to the RCU hash map
+ * @return                          the amount of retired tables left waiting for readers
+ */
+#define rcu_hash_map_reclaim(n, rhm_ptr)                                            \
+    epoch_reclaim(&(rhm_ptr)->epochs)
+
+/**
+ * Create an RCU hash map type, whose tables use the HASH_MAP_POW2 capacity policy
+ *
+ * This also creates the hash map type of the tables, named rcu_##n.
+ *
+ * @param           n               the name of the RCU hash map type to create
+ * @param           KeyT            the type of the keys to store
+ * @param           ValueT          the type of the values to store
+ * @param           key_hash        a function or function-like macro to hash @p KeyT objects
+ * @param           key_cmp         a function or function-like macro to compare @p KeyT objects
+ *
+ * @pre                             @p cmp takes two parameters A and B, and returns a value R, with
+ *                                  R == 0 if A == B
+ *                                  R != 0 if A != B
+ */
+#define MAKE_RCU_HASH_MAP_TYPE(n, KeyT, ValueT, key_hash, key_cmp)                  \
+    MAKE_HASH_MAP_TYPE(rcu_##n, KeyT, ValueT, key_hash, key_cmp);                   \
+                                                                                    \
+    typedef struct {                                                                \
+        struct epoch_node node;                                                     \
+        hash_map_t(rcu_##n) map;                                                    \
+    } _rcu_hash_map_table_##n##_t;                                                  \
+                                                                                    \
+    typedef struct {                                                                \
+        memory_allocator_handle_t alloc;                                            \
+        _Atomic(_rcu_hash_map_table_##n##_t *) current;                             \
+        epoch_domain_t epochs;                                                      \
+        pthread_mutex_t write_lock;                                                 \
+        /* The copy being updated, only used under the write lock */                \
+        _rcu_hash_map_table_##n##_t *draft;                                         \
+    } rcu_hash_map_t(n);                                                            \
+                                                                                    \
+    static inline void _rcu_hash_map_free_table_##n(                                \
+        struct epoch_node *node,                                                    \
+        void *ctx                                                                   \
+    )                                                                               \
+    {                                                                               \
+        _rcu_hash_map_table_##n##_t *table =                                        \
+            container_of(node, _rcu_hash_map_table_##n##_t, node);                  \
+        memory_allocator_handle_t alloc = table->map.alloc;                         \
+                                                                                    \
+        (void)ctx;                                                                  \
+        hash_map_destroy(rcu_##n, &table->map);                                     \
+        allocator_delete(alloc, table);                                             \
+    }                                                                               \
+                                                                                    \
+    /* Copy the arrays of a table as they are, not to insert every element again */ \
+    static inline _rcu_hash_map_table_##n##_t *_rcu_hash_map_copy_table_##n(        \
+        memory_allocator_handle_t alloc,                                            \
+        const _rcu_hash_map_table_##n##_t *src                                      \
+    )                                                                               \
+    {                                                                               \
+        _rcu_hash_map_table_##n##_t *table =                                        \
+            allocator_new(alloc, _rcu_hash_map_table_##n##_t);                      \
+        size_t cap;                                                                 \
+                                                                                    \
+        if (table == NULL) {                                                        \
+            return NULL;                                                            \
+        }                                                                           \
+        table->map = (hash_map_t(rcu_##n))hash_map_empty(alloc);                    \
+        hash_map_set_backward_shift(&table->map, true);                             \
+        if (src == NULL) {                                                          \
+            return table;                                                           \
+        }                                                                           \
+        /* Published tables never have an old table, see update_commit */           \
+        table->map.max_load = src->map.max_load;                                    \
+        table->map.growth = src->map.growth;                                        \
+        table->map.incremental_resize = src->map.incremental_resize;                \
+        if (src->map.capacity == 0) {                                               \
+            return table;                                                           \
+        }                                                                           \
+        cap = src->map.capacity;                                                    \
+        table->map.keys = allocator_new_array(alloc, KeyT, cap);                    \
+        table->map.values = allocator_new_array(alloc, ValueT, cap);                \
+        table->map.hashes = allocator_new_array(alloc, hash_value_t, cap);          \
+        table->map.capacity = cap;                                                  \
+        if unlikely(table->map.keys == NULL || table->map.values == NULL            \
+                    || table->map.hashes == NULL) {                                 \
+            _rcu_hash_map_free_table_##n(&table->node, NULL);                       \
+            return NULL;                                                            \
+        }                                                                           \
+        memcpy(table->map.keys, src->map.keys, cap * sizeof(KeyT));                 \
+        memcpy(table->map.values, src->map.values, cap * sizeof(ValueT));           \
+        memcpy(table->map.hashes, src->map.hashes, cap * sizeof(hash_value_t));     \
+        table->map.size = src->map.size;                                            \
+        return table;                                                               \
+    }                                                                               \
+                                                                                    \
+    static inline int _rcu_hash_map_init_##n(                                       \
+        rcu_hash_map_t(n) *rhm_ptr,                                                 \
+        memory_allocator_handle_t alloc                                             \
+    )                                                                               \
+    {                                                                               \
+        _rcu_hash_map_table_##n##_t *table =                                        \
+            _rcu_hash_map_copy_table_##n(alloc, NULL);                              \
+                                                                                    \
+        if (table == NULL) {                                                        \
+            return -1;                                                              \
+        }                                                                           \
+        if (epoch_domain_init(&rhm_ptr->epochs, alloc) != 0) {                      \
+            allocator_delete(alloc, table);                                         \
+            return -1;                                                              \
+        }                                                                           \
+        rhm_ptr->alloc = alloc;                                                     \
+        atomic_init(&rhm_ptr->current, table);                                      \
+        pthread_mutex_init(&rhm_ptr->write_lock, NULL);                             \
+        rhm_ptr->draft = NULL;                                                      \
+        return 0;                                                                   \
+    }                                                                               \
+                                                                                    \
+    static inline void _rcu_hash_map_destroy_##n(rcu_hash_map_t(n) *rhm_ptr)        \
+    {                                                                               \
+        _rcu_hash_map_free_table_##n(&atomic_load(&rhm_ptr->current)->node, NULL);  \
+        epoch_domain_destroy(&rhm_ptr->epochs);                                     \
+        pthread_mutex_destroy(&rhm_ptr->write_lock);                                \
+    }                                                                               \
+                                                                                    \
+    static inline const hash_map_t(rcu_##n) *_rcu_hash_map_read_lock_##n(           \
+        rcu_hash_map_t(n) *rhm_ptr                                                  \
+    )                                                                               \
+    {                                                                               \
+        if unlikely(epoch_enter(&rhm_ptr->epochs) != 0) {                           \
+            return NULL;                                                            \
+        }                                                                           \
+        return &atomic_load(&rhm_ptr->current)->map;                                \
+    }                                                                               \
+                                                                                    \
+    static inline bool _rcu_hash_map_find_##n(                                      \
+        rcu_hash_map_t(n) *rhm_ptr,                                                 \
+        KeyT const key,                                                             \
+        ValueT *value_ptr                                                           \
+    )                                                                               \
+    {                                                                               \
+        const hash_map_t(rcu_##n) *table = rcu_hash_map_read_lock(n, rhm_ptr);      \
+        size_t pos;                                                                 \
+                                                                                    \
+        if unlikely(table == NULL) {                                                \
+            return false;                                                           \
+        }                                                                           \
+        pos = hash_map_find(rcu_##n, table, key);                                   \
+        if (pos != hash_map_npos && value_ptr != NULL) {                            \
+            *value_ptr = hash_map_value_at(table, pos);                             \
+        }                                                                           \
+        rcu_hash_map_read_unlock(n, rhm_ptr);                                       \
+        return pos != hash_map_npos;                                                \
+    }                                                                               \
+                                                                                    \
+    static inline size_t _rcu_hash_map_size_##n(rcu_hash_map_t(n) *rhm_ptr)         \
+    {                                                                               \
+        const hash_map_t(rcu_##n) *table = rcu_hash_map_read_lock(n, rhm_ptr);      \
+        size_t size;                                                                \
+                                                                                    \
+        if unlikely(table == NULL) {                                                \
+            return 0;                                                               \
+        }                                                                           \
+        size = hash_map_size(table);                                                \
+        rcu_hash_map_read_unlock(n, rhm_ptr);                                       \
+        return size;                                                                \
+    }                                                                               \
+                                                                                    \
+    static inline hash_map_t(rcu_##n) *_rcu_hash_map_update_begin_##n(              \
+        rcu_hash_map_t(n) *rhm_ptr                                                  \
+    )                                                                               \
+    {                                                                               \
+        pthread_mutex_lock(&rhm_ptr->write_lock);                                   \
+        /* Only writers replace the current table, which they can read as is */     \
+        rhm_ptr->draft = _rcu_hash_map_copy_table_##n(                              \
+            rhm_ptr->alloc, atomic_load(&rhm_ptr->current)                          \
+        );                                                                          \
+        if unlikely(rhm_ptr->draft == NULL) {                                       \
+            pthread_mutex_unlock(&rhm_ptr->write_lock);                             \
+            return NULL;                                                            \
+        }                                                                           \
+        return &rhm_ptr->draft->map;                                                \
+    }                                                                               \
+                                                                                    \
+    static inline void _rcu_hash_map_update_commit_##n(rcu_hash_map_t(n) *rhm_ptr)  \
+    {                                                                               \
+        _rcu_hash_map_table_##n##_t *old;                                           \
+                                                                                    \
+        /* Finish any incremental resize, as copies only take the current table */  \
+        _hash_map_migrate_rcu_##n(&rhm_ptr->draft->map, SIZE_MAX);                  \
+        old = atomic_exchange(&rhm_ptr->current, rhm_ptr->draft);                   \
+        rhm_ptr->draft = NULL;                                                      \
+        pthread_mutex_unlock(&rhm_ptr->write_lock);                                 \
+        epoch_retire(                                                               \
+            &rhm_ptr->epochs, &old->node, &_rcu_hash_map_free_table_##n, NULL       \
+        );                                                                          \
+    }                                                                               \
+                                                                                    \
+    static inline void _rcu_hash_map_update_abort_##n(rcu_hash_map_t(n) *rhm_ptr)   \
+    {                                                                               \
+        _rcu_hash_map_free_table_##n(&rhm_ptr->draft->node, NULL);                  \
+        rhm_ptr->draft = NULL;                                                      \
+        pthread_mutex_unlock(&rhm_ptr->write_lock);                                 \
+    }                                                                               \
+                                                                                    \
+    static inline int _rcu_hash_map_upsert_##n(                                     \
+        rcu_hash_map_t(n) *rhm_ptr,                                                 \
+        KeyT key,                                                                   \
+        ValueT value                                                                \
+    )                                                                               \
+    {                                                                               \
+        hash_map_t(rcu_##n) *table = rcu_hash_map_update_begin(n, rhm_ptr);         \
+        bool inserted;                                                              \
+                                                                                    \
+        if unlikely(table == NULL) {                                                \
+            return -1;                                                              \
+        }                                                                           \
+        *hash_map_try_emplace(rcu_##n, table, key, &inserted) = value;              \
+        rcu_hash_map_update_commit(n, rhm_ptr);                                     \
+        return inserted;                                                            \
+    }                                                                               \
+                                                                                    \
+    static inline int _rcu_hash_map_erase_##n(                                      \
+        rcu_hash_map_t(n) *rhm_ptr,                                                 \
+        KeyT const key                                                              \
+    )                                                                               \
+    {                                                                               \
+        size_t pos;                                                                 \
+                                                                                    \
+        pthread_mutex_lock(&rhm_ptr->write_lock);                                   \
+        pos = hash_map_find(rcu_##n, &atomic_load(&rhm_ptr->current)->map, key);    \
+        if (pos == hash_map_npos) {                                                 \
+            pthread_mutex_unlock(&rhm_ptr->write_lock);                             \
+            return 0;                                                               \
+        }                                                                           \
+        /* The copy has the same capacity, and the element the same position */     \
+        rhm_ptr->draft = _rcu_hash_map_copy_table_##n(                              \
+            rhm_ptr->alloc, atomic_load(&rhm_ptr->current)                          \
+        );                                                                          \
+        if unlikely(rhm_ptr->draft == NULL) {                                       \
+            pthread_mutex_unlock(&rhm_ptr->write_lock);                             \
+            return -1;                                                              \
+        }                                                                           \
+        hash_map_erase_pos(rcu_##n, &rhm_ptr->draft->map, pos);                     \
+        rcu_hash_map_update_commit(n, rhm_ptr);                                     \
+        return 1;                                                                   \
+    }                                                                               \
+                                                                                    \
+    struct _allow_semi_colon_rcu_hash_map_##n { int unused; }
+
+#endif /* !CEEDS_RCU_HASH_MAP_H */
@@ -0,0 +1,127 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_SCAVENGER_H
+#define CEEDS_SCAVENGER_H
+
+#include <ceeds/list.h>
+#include <ceeds/memory.h>
+
+/**
+ * Scavengers
+ *
+ * A scavenger keeps track of the spans of memory an allocator no longer uses but keeps mapped, so that they
+ * can be reused quickly, and decides when to give their pages back to the OS (with madvise, so that the spans
+ * stay mapped and can still be reused afterwards, faulting fresh pages in).
+ *
+ * Spans are released oldest first, whenever the amount of idle resident memory goes past a byte threshold, or
+ * when they have been idle for longer than a given duration. These policies are only checked when a span is
+ * handed to the scavenger, so an allocator which goes completely quiet keeps its idle spans: call
+ * allocator_trim() (which ends up in scavenger_release()) to give them back regardless of the policies.
+ *
+ * Spans taken back for reuse are the most recently idle resident ones first, whose pages are most likely
+ * still hot, and released spans only when there is no resident one left.
+ *
+ * Scavengers are not thread-safe: they are meant to be embedded in the allocators using them.
+ */
+
+#define SCAVENGER_DEFAULT_MAX_IDLE_BYTES    ((size_t)4 * 1024 * 1024)
+#define SCAVENGER_DEFAULT_MAX_IDLE_NS       ((uint64_t)1000000000)
+
+/**
+ * A span tracked by a scavenger, to be embedded in the bookkeeping of the span itself
+ */
+struct scavenger_span
+{
+    list_node_t node;
+    /** The page-aligned range given back to the OS when the span is released */
+    void *addr;
+    size_t size;
+    uint64_t idle_since;
+    bool released;
+};
+
+typedef struct
+{
+    /** The idle spans whose pages are still resident, oldest first */
+    list_t resident;
+    /** The idle spans whose pages were given back */
+    list_t released;
+    size_t resident_bytes;
+    size_t released_bytes;
+    size_t max_idle_bytes;
+    uint64_t max_idle_ns;
+    int advice;
+} scavenger_t;
+
+/**
+ * Initialize a scavenger, with the default policies
+ *
+ * @param[out]      sc              the scavenger to initialize
+ */
+void scavenger_init(scavenger_t *sc);
+
+/**
+ * Set the policies of a scavenger
+ *
+ * @param[in,out]   sc              the scavenger
+ * @param[in]       max_idle_bytes  the amount of idle resident bytes past which the oldest spans are released
+ * @param[in]       max_idle_ns     the duration (in nanoseconds) past which an idle span is released
+ * @param[in]       lazy            whether to use MADV_FREE, letting the OS reclaim the pages only under memory
+ *                                  pressure, instead of MADV_DONTNEED (where MADV_FREE is not supported, this has
+ *                                  no effect)
+ */
+void scavenger_set_policy(scavenger_t *sc, size_t max_idle_bytes, uint64_t max_idle_ns, bool lazy);
+
+/**
+ * Hand an idle span to a scavenger, then release the spans its policies say should be
+ *
+ * @param[in,out]   sc              the scavenger
+ * @param[out]      span            the bookkeeping of the span
+ * @param[in]       addr            the beginning of the range to give back when the span is released
+ * @param[in]       size            the size of that range
+ *
+ * @pre                             @p addr and @p size must be multiples of the page size
+ */
+void scavenger_put(scavenger_t *sc, struct scavenger_span *span, void *addr, size_t size);
+
+/**
+ * Take an idle span back from a scavenger, for reuse
+ *
+ * @param[in,out]   sc              the scavenger
+ * @return                          the span, or NULL if there is no idle span
+ */
+struct scavenger_span *scavenger_take(scavenger_t *sc);
+
+/**
+ * Release idle spans, oldest first, until at most a given amount of idle bytes stays resident
+ *
+ * @param[in,out]   sc              the scavenger
+ * @param[in]       keep_bytes      the amount of idle bytes allowed to stay resident
+ * @return                          the amount of bytes given back
+ */
+size_t scavenger_release(scavenger_t *sc, size_t keep_bytes);
+
+/**
+ * Forget about all the idle spans of a scavenger, e.g. because they were unmapped
+ *
+ * @param[in,out]   sc              the scavenger
+ */
+void scavenger_clear(scavenger_t *sc);
+
+/**
+ * Get the amount of idle bytes whose pages are still resident
+ *
+ * @param[in]       sc_ptr          a pointer to the scavenger
+ */
+#define scavenger_resident_bytes(sc_ptr)    ((sc_ptr)->resident_bytes)
+
+/**
+ * Get the amount of idle bytes whose pages were given back
+ *
+ * @param[in]       sc_ptr          a pointer to the scavenger
+ */
+#define scavenger_released_bytes(sc_ptr)    ((sc_ptr)->released_bytes)
+
+#endif /* !CEEDS_SCAVENGER_H */
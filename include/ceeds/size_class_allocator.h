@@ -0,0 +1,133 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_SIZE_CLASS_ALLOCATOR_H
+#define CEEDS_SIZE_CLASS_ALLOCATOR_H
+
+#include <pthread.h>
+#include <ceeds/bitmanip.h>
+#include <ceeds/list.h>
+#include <ceeds/memory.h>
+#include <ceeds/scavenger.h>
+
+/**
+ * Size-segregated general-purpose allocators
+ *
+ * Small requests are rounded up to one of a fixed set of size classes (multiples of 16 up to 128 bytes, then
+ * four classes per power of two up to SIZE_CLASS_MAX_SMALL_SIZE bytes). Each class carves its slots out of
+ * SIZE_CLASS_SPAN_SIZE-aligned spans mapped directly from the OS, whose header tells the class of any pointer
+ * inside them and holds the free list of the span. Bigger requests get a dedicated mapping.
+ *
+ * Each class allocates from its current span, then from the spans which got some slots back. A span whose
+ * slots are all free again goes to a scavenger, which gives its pages back to the OS according to its policies
+ * (see scavenger.h), and from which any class can take it back for reuse.
+ *
+ * These allocators are thread-safe, so that one can stand in for the heap allocator across threads. Each class
+ * has its own lock, held while using its spans, so that threads only contend when allocating from (or freeing
+ * into) the same class. Another lock guards the list of mappings and the scavenger, which are only touched when
+ * a class runs out of slots or gets a whole span back, and for large allocations.
+ */
+
+#define SIZE_CLASS_SPAN_SIZE        ((size_t)64 * 1024)
+#define SIZE_CLASS_MAX_SMALL_SIZE   ((size_t)8192)
+#define SIZE_CLASS_COUNT            32
+#define SIZE_CLASS_LARGE            ((uint32_t)-1)
+
+struct size_class_free_slot
+{
+    struct size_class_free_slot *next;
+};
+
+struct size_class_span
+{
+    list_node_t node;
+    size_t mapping_size;
+    uint32_t class_index;
+    uint32_t live;
+    struct size_class_free_slot *free_list;
+    char *cur;
+    char *end;
+    /** The node of the span in the partial list of its class, if it is in there */
+    list_node_t bin_node;
+    bool partial;
+    struct scavenger_span idle;
+};
+
+struct size_class_bin
+{
+    /** Guards the spans of the class, their free lists included */
+    pthread_mutex_t lock;
+    struct size_class_span *current;
+    /** The spans with some free slots, other than the current one */
+    list_t partial;
+};
+
+typedef struct
+{
+    struct memory_allocator base;
+    struct size_class_bin bins[SIZE_CLASS_COUNT];
+    /** Guards the list of mappings and the scavenger, taken after the lock of a class */
+    pthread_mutex_t lock;
+    list_t spans;
+    scavenger_t scavenger;
+} size_class_allocator_t;
+
+/**
+ * Initialize a size class allocator
+ *
+ * Its scavenger uses the default policies, which can be changed using scavenger_set_policy() on
+ * the scavenger member.
+ *
+ * @param[out]      sca             the allocator to initialize
+ */
+void size_class_allocator_init(size_class_allocator_t *sca);
+
+/**
+ * Destroy a size class allocator, giving all its memory back to the OS
+ *
+ * @param[in,out]   sca             the allocator to destroy
+ */
+void size_class_allocator_destroy(size_class_allocator_t *sca);
+
+/**
+ * Get a handle to a size class allocator
+ *
+ * @param[in]       sca_ptr         a pointer to the allocator
+ */
+#define size_class_allocator_handle(sca_ptr)    (&(sca_ptr)->base)
+
+/**
+ * Get the index of the smallest size class able to hold a given amount of bytes
+ *
+ * @param[in]       size            the amount of bytes
+ * @return                          the index of the size class
+ *
+ * @pre                             @p size must be less than or equal to SIZE_CLASS_MAX_SMALL_SIZE
+ */
+static inline uint32_t size_class_index(size_t size)
+{
+    unsigned int log;
+
+    if (size <= 128) {
+        return size == 0 ? 0 : (uint32_t)((size - 1) / 16);
+    }
+    log = (unsigned int)(bitsizeof(unsigned long) - 1 - (size_t)__builtin_clzl(size - 1));
+    return (uint32_t)(8 + (log - 7) * 4 + (((size - 1) >> (log - 2)) & 3));
+}
+
+/**
+ * Get the amount of bytes held by a given size class
+ *
+ * @param[in]       index           the index of the size class
+ * @return                          the size of the slots of that class
+ */
+static inline size_t size_class_size(uint32_t index)
+{
+    if (index < 8) {
+        return (index + 1) * 16;
+    }
+    return (size_t)(4 + (index - 8) % 4 + 1) << ((index - 8) / 4 + 5);
+}
+
+#endif /* !CEEDS_SIZE_CLASS_ALLOCATOR_H */
@@ -0,0 +1,103 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_STATS_ALLOCATOR_H
+#define CEEDS_STATS_ALLOCATOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ceeds/alloc_trace.h>
+#include <ceeds/list.h>
+#include <ceeds/memory.h>
+
+/**
+ * Instrumenting allocators
+ *
+ * A statistics allocator wraps another allocator and counts what goes through it. Counters are kept per thread
+ * and merged when they are read, so that instrumented threads never write to shared cache lines, except to
+ * publish their live bytes every STATS_LIVE_BATCH bytes (peak bytes are therefore accurate to that amount per
+ * thread). It can also write a binary trace of every call (see alloc_trace.h).
+ *
+ * Every block carries a small header recording its size, so that deallocations can be accounted for.
+ */
+
+#define STATS_HISTOGRAM_BUCKETS     65
+#define STATS_LIVE_BATCH            ((int64_t)64 * 1024)
+#define STATS_TRACE_BUFFER_SIZE     256
+
+/**
+ * A snapshot of the statistics of an allocator
+ */
+struct allocator_stats
+{
+    /** The number of calls, per operation */
+    uint64_t counts[ALLOC_TRACE_OP_COUNT];
+    /** The amount of bytes requested (or given back, for deallocations), per operation */
+    uint64_t bytes[ALLOC_TRACE_OP_COUNT];
+    /** The amount of bytes currently allocated */
+    int64_t live_bytes;
+    /** The highest amount of bytes allocated at once */
+    int64_t peak_bytes;
+    /** The number of requests per size, bucket i holding sizes of bit width i (i.e. in [2^(i-1), 2^i)) */
+    uint64_t histogram[STATS_HISTOGRAM_BUCKETS];
+};
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t backing;
+    pthread_key_t key;
+    pthread_mutex_t lock;
+    list_t threads;
+    struct allocator_stats retired;
+    uint32_t next_thread_id;
+    atomic_int_least64_t live_bytes;
+    atomic_int_least64_t peak_bytes;
+    FILE *trace;
+    pthread_mutex_t trace_lock;
+    atomic_uint_least64_t trace_seq;
+} stats_allocator_t;
+
+/**
+ * Initialize a statistics allocator
+ *
+ * @param[out]      sa              the allocator to initialize
+ * @param[in]       backing         the allocator handle to forward allocations to
+ * @param[in]       trace           a stream to write a binary trace of every call to, or NULL
+ * @return                          0 on success, -1 on failure
+ */
+int stats_allocator_init(stats_allocator_t *sa, memory_allocator_handle_t backing, FILE *trace);
+
+/**
+ * Destroy a statistics allocator, flushing the trace of every thread
+ *
+ * @param[in,out]   sa              the allocator to destroy
+ *
+ * @pre                             no other thread must be using @p sa anymore
+ */
+void stats_allocator_destroy(stats_allocator_t *sa);
+
+/**
+ * Read the statistics of an allocator, merging the counters of every thread
+ *
+ * @param[in,out]   sa              the allocator
+ * @param[out]      stats           the statistics
+ */
+void stats_allocator_read(stats_allocator_t *sa, struct allocator_stats *stats);
+
+/**
+ * Write the trace records buffered by the calling thread
+ *
+ * @param[in,out]   sa              the allocator
+ */
+void stats_allocator_flush_trace(stats_allocator_t *sa);
+
+/**
+ * Get a handle to a statistics allocator
+ *
+ * @param[in]       sa_ptr          a pointer to the allocator
+ */
+#define stats_allocator_handle(sa_ptr)      (&(sa_ptr)->base)
+
+#endif /* !CEEDS_STATS_ALLOCATOR_H */
@@ -0,0 +1,68 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_THREAD_CACHE_ALLOCATOR_H
+#define CEEDS_THREAD_CACHE_ALLOCATOR_H
+
+#include <pthread.h>
+#include <ceeds/list.h>
+#include <ceeds/size_class_allocator.h>
+
+/**
+ * Thread-caching allocators
+ *
+ * A thread-caching allocator sits in front of any other allocator, and makes it usable from several threads.
+ * Each thread keeps a small cache of recently freed blocks, grouped by the size classes of size_class_allocator.h,
+ * so that most allocations and deallocations of blocks up to THREAD_CACHE_MAX_SIZE bytes never leave the thread.
+ * The backing allocator is only used, under a lock, to refill an empty cache or to take back a batch of blocks
+ * from a cache that grew too large, or whose thread exited. Bigger blocks go straight to the backing allocator.
+ */
+
+#define THREAD_CACHE_MAX_SIZE       ((size_t)1024)
+#define THREAD_CACHE_CLASS_COUNT    20
+#define THREAD_CACHE_BIN_CAPACITY   64
+#define THREAD_CACHE_BATCH_SIZE     32
+
+typedef struct
+{
+    struct memory_allocator base;
+    memory_allocator_handle_t backing;
+    pthread_mutex_t lock;
+    pthread_key_t key;
+    list_t caches;
+} thread_cache_allocator_t;
+
+/**
+ * Initialize a thread-caching allocator
+ *
+ * @param[out]      tca             the allocator to initialize
+ * @param[in]       backing         the allocator handle to cache allocations from
+ * @return                          0 on success, -1 if the thread-local storage could not be created
+ */
+int thread_cache_allocator_init(thread_cache_allocator_t *tca, memory_allocator_handle_t backing);
+
+/**
+ * Destroy a thread-caching allocator, giving every cached block back to its backing allocator
+ *
+ * @param[in,out]   tca             the allocator to destroy
+ *
+ * @pre                             no other thread must be using @p tca anymore
+ */
+void thread_cache_allocator_destroy(thread_cache_allocator_t *tca);
+
+/**
+ * Give every block cached by the calling thread back to the backing allocator
+ *
+ * @param[in,out]   tca             the allocator to flush
+ */
+void thread_cache_allocator_flush(thread_cache_allocator_t *tca);
+
+/**
+ * Get a handle to a thread-caching allocator
+ *
+ * @param[in]       tca_ptr         a pointer to the allocator
+ */
+#define thread_cache_allocator_handle(tca_ptr)  (&(tca_ptr)->base)
+
+#endif /* !CEEDS_THREAD_CACHE_ALLOCATOR_H */
@@ -82,18 +82,14 @@
     do {                                                                    \
         typeof(alloc_handle) __alloc_handle = (alloc_handle);               \
         size_t __cap = (size_t)(capacity);                                  \
-                                                                            \
-        vector_init_with_buffer(                                            \
-            vec_ptr,                                                        \
+        typeof((vec_ptr)->data) __data = allocator_new_array_at_least(      \
             __alloc_handle,                                                 \
-            allocator_new_array(                                            \
-                __alloc_handle,                                             \
-                typeof(*(vec_ptr)->data),                                   \
-                __cap                                                       \
-            ),                                                              \
-            0,                                                              \
-            __cap                                                           \
+            typeof(*(vec_ptr)->data),                                       \
+            __cap,                                                          \
+            &__cap                                                          \
         );                                                                  \
+                                                                            \
+        vector_init_with_buffer(vec_ptr, __alloc_handle, __data, 0, __cap); \
     } while (0)
 
 /**
@@ -111,7 +107,16 @@
  * @param[in,out]   vec_ptr         a pointer to the vector to destroy
  */
 #define vector_destroy(vec_ptr)                                             \
-    allocator_delete((vec_ptr)->allocator_handle, (vec_ptr)->data)
+    do {                                                                    \
+        typeof(vec_ptr) __vec_ptr = (vec_ptr);                              \
+                                                                            \
+        allocator_delete_array(                                             \
+            __vec_ptr->allocator_handle,                                    \
+            __vec_ptr->data,                                                \
+            typeof(*__vec_ptr->data),                                       \
+            __vec_ptr->capacity                                             \
+        );                                                                  \
+    } while (0)
 
 /**
  * Get the size of a vector (i.e. the number of elements in the vector)
@@ -137,40 +142,59 @@
 /**
  * Increase the capacity of a vector to be at least equal to a given amount
  *
+ * If the allocator of the vector fails to provide the memory (e.g. a vm_reserve_allocator_t past its
+ * reservation), the vector keeps its current buffer and capacity.
+ *
  * @param[in,out]   vec_ptr         the vector whose capacity is to be increased
  * @param[in]       new_capacity    the new capacity
+ * @return                          0 on success, -1 if the capacity could not be increased
  */
 #define vector_reserve(vec_ptr, new_capacity)                               \
-    do {                                                                    \
+    ({                                                                      \
         typeof(vec_ptr) __vtg_ptr = (vec_ptr);                              \
         size_t __new_capacity = (new_capacity);                             \
+        int __vtg_ret = 0;                                                  \
                                                                             \
         if (__vtg_ptr->capacity < __new_capacity) {                         \
+            size_t __actual_capacity;                                       \
+            typeof(__vtg_ptr->data) __new_data;                             \
+                                                                            \
             __new_capacity = MAX(__new_capacity, __vtg_ptr->capacity * 2);  \
-            __vtg_ptr->data = allocator_resize_array(                       \
+            __new_data = allocator_resize_array_at_least(                   \
                 __vtg_ptr->allocator_handle,                                \
                 __vtg_ptr->data,                                            \
                 typeof(*__vtg_ptr->data),                                   \
                 __vtg_ptr->capacity,                                        \
-                __new_capacity                                              \
+                __new_capacity,                                             \
+                &__actual_capacity                                          \
             );                                                              \
-            __vtg_ptr->capacity = __new_capacity;                           \
+            if likely(__new_data != NULL) {                                 \
+                __vtg_ptr->data = __new_data;                               \
+                __vtg_ptr->capacity = __actual_capacity;                    \
+            } else {                                                        \
+                __vtg_ret = -1;                                             \
+            }                                                               \
         }                                                                   \
-    } while (0)
+        __vtg_ret;                                                          \
+    })
 
 /**
  * Add an element at the end of a vector
  *
  * @param[in,out]   vec_ptr         a pointer to the vector to append into
  * @param[in]       e               the element to append
+ * @return                          0 on success, -1 if the vector could not grow (it is then left unchanged)
  */
 #define vector_push_back(vec_ptr, e)                                        \
-    do {                                                                    \
+    ({                                                                      \
         typeof(vec_ptr) __vec_ptr = (vec_ptr);                              \
+        int __vpb_ret = vector_reserve(__vec_ptr, __vec_ptr->size + 1);     \
                                                                             \
-        vector_reserve(__vec_ptr, __vec_ptr->size + 1);                     \
-        __vec_ptr->data[__vec_ptr->size++] = e;                             \
-    } while (0)
+        if likely(__vpb_ret == 0) {                                         \
+            __vec_ptr->data[__vec_ptr->size++] = e;                         \
+        }                                                                   \
+        __vpb_ret;                                                          \
+    })
 
 /**
  * Remove the last element of a vector
@@ -192,23 +216,27 @@
  * @param[in,out]   vec_ptr         a pointer to the vector to insert into
  * @param[in]       pos             the position at which to insert
  * @param[in]       e               the element to insert
+ * @return                          0 on success, -1 if the vector could not grow (it is then left unchanged)
  *
  * @pre                             @p vec_ptr must have at least @p pos elements
  */
 #define vector_insert(vec_ptr, pos, e)                                      \
-    do {                                                                    \
+    ({                                                                      \
         typeof(vec_ptr) __vec_ptr = (vec_ptr);                              \
         size_t __pos = (pos);                                               \
+        int __vi_ret = vector_reserve(__vec_ptr, __vec_ptr->size + 1);      \
                                                                             \
-        vector_reserve(__vec_ptr, __vec_ptr->size + 1);                     \
-        memmove(                                                            \
-            __vec_ptr->data + __pos + 1,                                    \
-            __vec_ptr->data + __pos,                                        \
-            sizeof(*__vec_ptr->data) * (__vec_ptr->size - __pos)            \
-        );                                                                  \
-        ++__vec_ptr->size;                                                  \
-        __vec_ptr->data[__pos] = e;                                         \
-    } while (0)
+        if likely(__vi_ret == 0) {                                          \
+            memmove(                                                        \
+                __vec_ptr->data + __pos + 1,                                \
+                __vec_ptr->data + __pos,                                    \
+                sizeof(*__vec_ptr->data) * (__vec_ptr->size - __pos)        \
+            );                                                              \
+            ++__vec_ptr->size;                                              \
+            __vec_ptr->data[__pos] = e;                                     \
+        }                                                                   \
+        __vi_ret;                                                           \
+    })
 
 /**
  * Remove an element at a given position from a vector
@@ -0,0 +1,44 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#ifndef CEEDS_VM_RESERVE_ALLOCATOR_H
+#define CEEDS_VM_RESERVE_ALLOCATOR_H
+
+#include <ceeds/memory.h>
+
+/**
+ * Reserve-then-commit allocators
+ *
+ * Every allocation reserves a large, fixed-size range of address space up front (without any access rights,
+ * so that it does not count against the memory of the process), and only makes pages accessible as the block
+ * grows. Blocks are therefore never relocated: reallocation always returns the pointer it was given, growth
+ * never copies anything, and pointers into a block stay valid until it is deallocated.
+ *
+ * This makes them a good fit for append-only buffers, such as a vector_t using such an allocator.
+ * A block cannot grow past the reserved size: reallocation then fails and returns NULL. Since vector_t doubles
+ * its capacity when growing, the reservation should be twice as big as the biggest expected vector.
+ */
+
+typedef struct
+{
+    struct memory_allocator base;
+    size_t reserve_size;
+} vm_reserve_allocator_t;
+
+/**
+ * Initialize a reserve-then-commit allocator
+ *
+ * @param[out]      vra             the allocator to initialize
+ * @param[in]       reserve_size    the amount of address space to reserve for every allocation
+ */
+void vm_reserve_allocator_init(vm_reserve_allocator_t *vra, size_t reserve_size);
+
+/**
+ * Get a handle to a reserve-then-commit allocator
+ *
+ * @param[in]       vra_ptr         a pointer to the allocator
+ */
+#define vm_reserve_allocator_handle(vra_ptr)    (&(vra_ptr)->base)
+
+#endif /* !CEEDS_VM_RESERVE_ALLOCATOR_H */
@@ -0,0 +1,214 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/arena_allocator.h>
+
+#define arena_of(alloc)         container_of(alloc, arena_allocator_t, base)
+
+static inline uintptr_t align_up(uintptr_t n, size_t align)
+{
+    return (n + align - 1) & ~((uintptr_t)align - 1);
+}
+
+static void arena_release_block(arena_allocator_t *arena, struct arena_block *block)
+{
+    if (block->size == arena->block_size) {
+        block->prev = arena->spare;
+        arena->spare = block;
+    } else {
+        allocator_delete(arena->backing, block);
+    }
+}
+
+/**
+ * Give the spare blocks of an arena back to its backing allocator
+ *
+ * @return                          the amount of bytes given back
+ */
+static size_t arena_free_spares(arena_allocator_t *arena)
+{
+    size_t freed = 0;
+
+    while (arena->backing != NULL && arena->spare != NULL) {
+        struct arena_block *block = arena->spare;
+
+        arena->spare = block->prev;
+        freed += sizeof(*block) + block->size;
+        allocator_delete(arena->backing, block);
+    }
+    return freed;
+}
+
+static bool arena_push_block(arena_allocator_t *arena, size_t size, size_t align)
+{
+    struct arena_block *block;
+    size_t needed = size + (align > alignof(max_align_t) ? align - 1 : 0);
+
+    if (needed <= arena->block_size && arena->spare != NULL) {
+        block = arena->spare;
+        arena->spare = block->prev;
+    } else {
+        size_t block_size = MAX(needed, arena->block_size);
+
+        if unlikely(arena->backing == NULL) {
+            return false;
+        }
+        block = arena->backing->allocate(
+            arena->backing,
+            sizeof(struct arena_block) + block_size,
+            alignof(struct arena_block)
+        );
+        if unlikely(block == NULL) {
+            return false;
+        }
+        block->size = block_size;
+    }
+    block->prev = arena->block;
+    arena->block = block;
+    arena->cur = block->data;
+    arena->end = block->data + block->size;
+    return true;
+}
+
+static void *arena_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    arena_allocator_t *arena = arena_of(alloc);
+    uintptr_t ptr = align_up((uintptr_t)arena->cur, align);
+
+    if unlikely(arena->block == NULL || ptr + size > (uintptr_t)arena->end) {
+        if unlikely(!arena_push_block(arena, size, align)) {
+            return NULL;
+        }
+        ptr = align_up((uintptr_t)arena->cur, align);
+    }
+    arena->last = (char *)ptr;
+    arena->cur = (char *)ptr + size;
+    return (void *)ptr;
+}
+
+static void *arena_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    void *ptr = arena_allocate(alloc, size, align);
+
+    if likely(ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void arena_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    arena_allocator_t *arena = arena_of(alloc);
+
+    /* Only the most recent allocation can be given back, anything else is reclaimed on rewind */
+    if (ptr != NULL && ptr == arena->last) {
+        arena->cur = arena->last;
+        arena->last = NULL;
+    }
+}
+
+static void *arena_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    arena_allocator_t *arena = arena_of(alloc);
+    void *new_ptr;
+
+    if (new_size == 0) {
+        arena_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return arena_allocate(alloc, new_size, new_align);
+    }
+
+    if (is_aligned_ptr(ptr, new_align)) {
+        /* The most recent allocation can be extended (or shrunk) in place as long as the block allows it */
+        if (ptr == arena->last && new_size <= (size_t)(arena->end - arena->last)) {
+            arena->cur = arena->last + new_size;
+            return ptr;
+        }
+        if (new_size <= old_size) {
+            return ptr;
+        }
+    }
+
+    new_ptr = arena_allocate(alloc, new_size, new_align);
+    if likely(new_ptr != NULL && old_size > 0) {
+        memcpy(new_ptr, ptr, MIN(old_size, new_size));
+    }
+    return new_ptr;
+}
+
+static size_t arena_trim(memory_allocator_handle_t alloc)
+{
+    arena_allocator_t *arena = arena_of(alloc);
+    size_t freed = arena_free_spares(arena);
+
+    return arena->backing != NULL ? freed + allocator_trim(arena->backing) : freed;
+}
+
+void arena_allocator_init(arena_allocator_t *arena, memory_allocator_handle_t backing, size_t block_size)
+{
+    arena->base = (struct memory_allocator){
+        .allocate = &arena_allocate,
+        .zero_allocate = &arena_zero_allocate,
+        .deallocate = &arena_deallocate,
+        .reallocate = &arena_reallocate,
+        .trim = &arena_trim,
+    };
+    arena->backing = backing;
+    arena->block_size = block_size;
+    arena->block = NULL;
+    arena->spare = NULL;
+    arena->cur = NULL;
+    arena->end = NULL;
+    arena->last = NULL;
+}
+
+void arena_allocator_init_with_buffer(arena_allocator_t *arena, void *buffer, size_t size)
+{
+    uintptr_t start = align_up((uintptr_t)buffer, alignof(struct arena_block));
+    uintptr_t end = (uintptr_t)buffer + size;
+
+    arena_allocator_init(arena, NULL, 0);
+    if (start + sizeof(struct arena_block) < end) {
+        struct arena_block *block = (struct arena_block *)start;
+
+        /* The buffer becomes the one and only block, waiting in the spare list */
+        block->prev = NULL;
+        block->size = end - start - sizeof(struct arena_block);
+        arena->block_size = block->size;
+        arena->spare = block;
+    }
+}
+
+void arena_allocator_rewind(arena_allocator_t *arena, arena_mark_t mark)
+{
+    while (arena->block != mark.block) {
+        struct arena_block *block = arena->block;
+
+        arena->block = block->prev;
+        arena_release_block(arena, block);
+    }
+    if (arena->block != NULL) {
+        arena->cur = mark.cur;
+        arena->end = arena->block->data + arena->block->size;
+    } else {
+        arena->cur = NULL;
+        arena->end = NULL;
+    }
+    arena->last = NULL;
+}
+
+void arena_allocator_destroy(arena_allocator_t *arena)
+{
+    arena_allocator_reset(arena);
+    arena_free_spares(arena);
+}
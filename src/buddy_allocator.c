@@ -0,0 +1,289 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/bitmanip.h>
+#include <ceeds/buddy_allocator.h>
+
+#define ba_of(alloc)            container_of(alloc, buddy_allocator_t, base)
+
+/** Flag set in the order of a block which is free */
+#define BLOCK_FREE              ((uint8_t)0x80)
+
+static inline unsigned int ceil_log2(size_t n)
+{
+    return n <= 1 ? 0 : (unsigned int)(bitsizeof(unsigned long long) - __builtin_clzll(n - 1));
+}
+
+static inline size_t block_size(const buddy_allocator_t *ba, unsigned int order)
+{
+    return (size_t)1 << (ba->min_block_shift + order);
+}
+
+static inline size_t block_index(const buddy_allocator_t *ba, const void *ptr)
+{
+    return (size_t)((const char *)ptr - ba->region) >> ba->min_block_shift;
+}
+
+static inline char *block_at(const buddy_allocator_t *ba, size_t index)
+{
+    return ba->region + (index << ba->min_block_shift);
+}
+
+/**
+ * Get the smallest order of the blocks able to hold a given size with a given alignment
+ */
+static inline unsigned int order_for(const buddy_allocator_t *ba, size_t size, size_t align)
+{
+    unsigned int shift = ceil_log2(MAX(size, align));
+
+    return shift > ba->min_block_shift ? shift - ba->min_block_shift : 0;
+}
+
+static inline bool is_free_block(const buddy_allocator_t *ba, size_t index, unsigned int order)
+{
+    return ba->block_orders[index] == (BLOCK_FREE | order);
+}
+
+static void free_list_push(buddy_allocator_t *ba, size_t index, unsigned int order)
+{
+    ba->block_orders[index] = BLOCK_FREE | order;
+    ba->free_counts[order] += 1;
+    list_push_front(&ba->free_lists[order], (list_node_t *)block_at(ba, index));
+}
+
+static void free_list_remove(buddy_allocator_t *ba, size_t index, unsigned int order)
+{
+    ba->free_counts[order] -= 1;
+    list_node_remove((list_node_t *)block_at(ba, index));
+}
+
+/**
+ * Give the upper halves of a block back, until it is of a given order
+ */
+static void block_split(buddy_allocator_t *ba, size_t index, unsigned int order, unsigned int new_order)
+{
+    while (order > new_order) {
+        order -= 1;
+        free_list_push(ba, index + ((size_t)1 << order), order);
+    }
+    ba->block_orders[index] = (uint8_t)new_order;
+}
+
+static void *ba_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    buddy_allocator_t *ba = ba_of(alloc);
+    unsigned int order = order_for(ba, size, align);
+    unsigned int found = order;
+    size_t index;
+
+    assert(align <= BUDDY_MAX_ALIGN);
+    while (found <= ba->max_order && list_is_empty(&ba->free_lists[found])) {
+        ++found;
+    }
+    if unlikely(found > ba->max_order) {
+        return NULL;
+    }
+    index = block_index(ba, ba->free_lists[found].head);
+    free_list_remove(ba, index, found);
+    block_split(ba, index, found, order);
+    ba->allocated_bytes += block_size(ba, order);
+    return block_at(ba, index);
+}
+
+static void *ba_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    void *ptr = ba_allocate(alloc, size, align);
+
+    if likely(ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void ba_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    buddy_allocator_t *ba = ba_of(alloc);
+    size_t index;
+    unsigned int order;
+
+    if (ptr == NULL) {
+        return;
+    }
+    index = block_index(ba, ptr);
+    order = ba->block_orders[index];
+    ba->allocated_bytes -= block_size(ba, order);
+
+    /* Merge with the buddy for as long as it is free */
+    while (order < ba->max_order) {
+        size_t buddy = index ^ ((size_t)1 << order);
+
+        if (!is_free_block(ba, buddy, order)) {
+            break;
+        }
+        free_list_remove(ba, buddy, order);
+        index = MIN(index, buddy);
+        order += 1;
+    }
+    free_list_push(ba, index, order);
+}
+
+/**
+ * Try to grow a block in place, by merging it with the free buddies following it
+ */
+static bool block_grow(buddy_allocator_t *ba, size_t index, unsigned int order, unsigned int new_order)
+{
+    if (new_order > ba->max_order) {
+        return false;
+    }
+    for (unsigned int o = order; o < new_order; ++o) {
+        if ((index & ((size_t)1 << o)) != 0 || !is_free_block(ba, index + ((size_t)1 << o), o)) {
+            return false;
+        }
+    }
+    for (unsigned int o = order; o < new_order; ++o) {
+        free_list_remove(ba, index + ((size_t)1 << o), o);
+    }
+    ba->block_orders[index] = (uint8_t)new_order;
+    return true;
+}
+
+static void *ba_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    buddy_allocator_t *ba = ba_of(alloc);
+    size_t index;
+    unsigned int order;
+    unsigned int new_order;
+    void *new_ptr;
+
+    if (new_size == 0) {
+        ba_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return ba_allocate(alloc, new_size, new_align);
+    }
+
+    index = block_index(ba, ptr);
+    order = ba->block_orders[index];
+    new_order = order_for(ba, new_size, new_align);
+    if (is_aligned_ptr(ptr, new_align)) {
+        if (new_order <= order) {
+            block_split(ba, index, order, new_order);
+            ba->allocated_bytes -= block_size(ba, order) - block_size(ba, new_order);
+            return ptr;
+        }
+        if (block_grow(ba, index, order, new_order)) {
+            ba->allocated_bytes += block_size(ba, new_order) - block_size(ba, order);
+            return ptr;
+        }
+    }
+
+    new_ptr = ba_allocate(alloc, new_size, new_align);
+    if likely(new_ptr != NULL) {
+        memcpy(new_ptr, ptr, MIN(old_size, new_size));
+        ba_deallocate(alloc, ptr);
+    }
+    return new_ptr;
+}
+
+static void *ba_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    buddy_allocator_t *ba = ba_of(alloc);
+    void *ptr = ba_allocate(alloc, size, align);
+
+    *usable_size = ptr != NULL ? block_size(ba, ba->block_orders[block_index(ba, ptr)]) : 0;
+    return ptr;
+}
+
+static void *ba_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    buddy_allocator_t *ba = ba_of(alloc);
+
+    ptr = ba_reallocate(alloc, ptr, old_size, new_size, new_align);
+    *usable_size = ptr != NULL ? block_size(ba, ba->block_orders[block_index(ba, ptr)]) : 0;
+    return ptr;
+}
+
+int buddy_allocator_init(
+    buddy_allocator_t *ba,
+    memory_allocator_handle_t backing,
+    size_t region_size,
+    size_t min_block_size
+)
+{
+    unsigned int region_shift = ceil_log2(region_size);
+
+    ba->base = (struct memory_allocator){
+        .allocate = &ba_allocate,
+        .zero_allocate = &ba_zero_allocate,
+        .deallocate = &ba_deallocate,
+        .reallocate = &ba_reallocate,
+        .allocate_at_least = &ba_allocate_at_least,
+        .reallocate_at_least = &ba_reallocate_at_least,
+    };
+    ba->backing = backing;
+    ba->min_block_shift = ceil_log2(MAX(min_block_size, sizeof(list_node_t)));
+    assert(ba->min_block_shift <= region_shift && region_shift - ba->min_block_shift < BUDDY_MAX_ORDERS);
+    ba->max_order = region_shift - ba->min_block_shift;
+    ba->region_size = (size_t)1 << region_shift;
+    ba->allocated_bytes = 0;
+    for (size_t i = 0; i < BUDDY_MAX_ORDERS; ++i) {
+        list_init(&ba->free_lists[i]);
+        ba->free_counts[i] = 0;
+    }
+    ba->region = backing->allocate(backing, ba->region_size, MIN(ba->region_size, BUDDY_MAX_ALIGN));
+    if unlikely(ba->region == NULL) {
+        return -1;
+    }
+    ba->block_orders = allocator_new_array(backing, uint8_t, (size_t)1 << ba->max_order);
+    if unlikely(ba->block_orders == NULL) {
+        allocator_delete(backing, ba->region);
+        return -1;
+    }
+    free_list_push(ba, 0, ba->max_order);
+    return 0;
+}
+
+void buddy_allocator_destroy(buddy_allocator_t *ba)
+{
+    allocator_delete_array(ba->backing, ba->block_orders, uint8_t, (size_t)1 << ba->max_order);
+    allocator_sized_deallocate(ba->backing, ba->region, ba->region_size);
+}
+
+void buddy_allocator_stats(const buddy_allocator_t *ba, struct buddy_stats *stats)
+{
+    *stats = (struct buddy_stats){
+        .total_bytes = ba->region_size,
+        .allocated_bytes = ba->allocated_bytes,
+    };
+    for (unsigned int order = 0; order <= ba->max_order; ++order) {
+        stats->free_bytes += ba->free_counts[order] * block_size(ba, order);
+        stats->free_blocks += ba->free_counts[order];
+        if (ba->free_counts[order] > 0) {
+            stats->largest_free_block = block_size(ba, order);
+        }
+    }
+    if (stats->free_bytes > 0) {
+        stats->fragmentation = 1 - (double)stats->largest_free_block / (double)stats->free_bytes;
+    }
+}
@@ -0,0 +1,226 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/budget_allocator.h>
+
+#define ba_of(alloc)            container_of(alloc, budget_allocator_t, base)
+
+#define HEADER_SIZE             alignof(max_align_t)
+
+/**
+ * Header stored right before every block, telling how big it is and where it comes from
+ */
+struct budget_header
+{
+    size_t size;
+    uint32_t tier;
+    uint32_t offset;
+};
+
+static_assert(sizeof(struct budget_header) <= HEADER_SIZE, "the header must fit in front of every block");
+
+static inline struct budget_header *header_of(void *ptr)
+{
+    return (struct budget_header *)ptr - 1;
+}
+
+/**
+ * Allocate a block from the first tier able to provide it, without charging it to the budget
+ *
+ * @param[in]       max_size        the amount of bytes that can be reported as usable
+ */
+static void *tiers_allocate(budget_allocator_t *ba, size_t size, size_t align, bool zero, size_t max_size)
+{
+    size_t offset = MAX(align, HEADER_SIZE);
+
+    for (size_t i = 0; i < ba->tier_count; ++i) {
+        memory_allocator_handle_t tier = ba->tiers[i];
+        size_t raw_size = offset + size;
+        char *raw;
+
+        if (zero) {
+            raw = tier->zero_allocate(tier, offset + size, offset);
+        } else {
+            raw = allocator_allocate_at_least(tier, offset + size, offset, &raw_size);
+        }
+        if likely(raw != NULL) {
+            struct budget_header *header = header_of(raw + offset);
+
+            header->size = MIN(raw_size - offset, max_size);
+            header->tier = (uint32_t)i;
+            header->offset = (uint32_t)offset;
+            return raw + offset;
+        }
+    }
+    return NULL;
+}
+
+static void *ba_allocate_ll(memory_allocator_handle_t alloc, size_t size, size_t align, bool zero)
+{
+    budget_allocator_t *ba = ba_of(alloc);
+    void *ptr;
+
+    if unlikely(size > ba->budget - ba->used) {
+        return NULL;
+    }
+    ptr = tiers_allocate(ba, size, align, zero, ba->budget - ba->used);
+    if likely(ptr != NULL) {
+        ba->used += header_of(ptr)->size;
+    }
+    return ptr;
+}
+
+static void *ba_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    return ba_allocate_ll(alloc, size, align, false);
+}
+
+static void *ba_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    return ba_allocate_ll(alloc, size, align, true);
+}
+
+static void ba_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    budget_allocator_t *ba = ba_of(alloc);
+    struct budget_header header;
+
+    if (ptr == NULL) {
+        return;
+    }
+    header = *header_of(ptr);
+    ba->used -= header.size;
+    allocator_sized_deallocate(ba->tiers[header.tier], (char *)ptr - header.offset, header.offset + header.size);
+}
+
+static void ba_sized_deallocate(memory_allocator_handle_t alloc, void *ptr, _unused_ size_t size)
+{
+    /* The header knows the size the tier was told about */
+    ba_deallocate(alloc, ptr);
+}
+
+static void *ba_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    void *ptr = ba_allocate_ll(alloc, size, align, false);
+
+    *usable_size = ptr != NULL ? header_of(ptr)->size : 0;
+    return ptr;
+}
+
+static void *ba_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    _unused_ size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    budget_allocator_t *ba = ba_of(alloc);
+    struct budget_header header;
+    size_t available;
+    void *new_ptr;
+
+    if (new_size == 0) {
+        ba_deallocate(alloc, ptr);
+        *usable_size = 0;
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return ba_allocate_at_least(alloc, new_size, new_align, usable_size);
+    }
+
+    header = *header_of(ptr);
+    available = ba->budget - ba->used + header.size;
+    if unlikely(new_size > available) {
+        return NULL;
+    }
+
+    /* Let the tier resize the block if the header can stay where it is */
+    if (new_align <= header.offset) {
+        memory_allocator_handle_t tier = ba->tiers[header.tier];
+        size_t raw_size;
+        char *raw = allocator_reallocate_at_least(
+            tier,
+            (char *)ptr - header.offset,
+            header.offset + header.size,
+            header.offset + new_size,
+            header.offset,
+            &raw_size
+        );
+
+        if likely(raw != NULL) {
+            new_ptr = raw + header.offset;
+            header_of(new_ptr)->size = MIN(raw_size - header.offset, available);
+            ba->used = ba->used - header.size + header_of(new_ptr)->size;
+            *usable_size = header_of(new_ptr)->size;
+            return new_ptr;
+        }
+    }
+
+    /* Otherwise move the block to whichever tier can take it */
+    new_ptr = tiers_allocate(ba, new_size, new_align, false, available);
+    if unlikely(new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, MIN(header.size, new_size));
+    ba_deallocate(alloc, ptr);
+    ba->used += header_of(new_ptr)->size;
+    *usable_size = header_of(new_ptr)->size;
+    return new_ptr;
+}
+
+static void *ba_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    size_t usable_size;
+
+    return ba_reallocate_at_least(alloc, ptr, old_size, new_size, new_align, &usable_size);
+}
+
+static size_t ba_trim(memory_allocator_handle_t alloc)
+{
+    budget_allocator_t *ba = ba_of(alloc);
+    size_t released = 0;
+
+    for (size_t i = 0; i < ba->tier_count; ++i) {
+        released += allocator_trim(ba->tiers[i]);
+    }
+    return released;
+}
+
+void budget_allocator_init(
+    budget_allocator_t *ba,
+    size_t budget,
+    const memory_allocator_handle_t *tiers,
+    size_t tier_count
+)
+{
+    assert(tier_count > 0 && tier_count <= BUDGET_ALLOCATOR_MAX_TIERS);
+    ba->base = (struct memory_allocator){
+        .allocate = &ba_allocate,
+        .zero_allocate = &ba_zero_allocate,
+        .deallocate = &ba_deallocate,
+        .reallocate = &ba_reallocate,
+        .sized_deallocate = &ba_sized_deallocate,
+        .allocate_at_least = &ba_allocate_at_least,
+        .reallocate_at_least = &ba_reallocate_at_least,
+        .trim = &ba_trim,
+    };
+    memcpy(ba->tiers, tiers, tier_count * sizeof(*tiers));
+    ba->tier_count = tier_count;
+    ba->budget = budget;
+    ba->used = 0;
+}
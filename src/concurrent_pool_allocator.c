@@ -0,0 +1,371 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/concurrent_pool_allocator.h>
+
+#define cpool_of(alloc)         container_of(alloc, concurrent_pool_allocator_t, base)
+
+#define TAG_PTR_MASK            (((uint64_t)1 << CONCURRENT_POOL_TAG_SHIFT) - 1)
+
+struct concurrent_pool_magazine
+{
+    /** The next magazine in a stack of the depot */
+    atomic_uintptr_t next;
+    /** The next magazine of the pool, to release them all on destruction */
+    struct concurrent_pool_magazine *next_of_pool;
+    size_t count;
+    void *slots[CONCURRENT_POOL_MAGAZINE_SIZE];
+};
+
+struct cpool_cache
+{
+    list_node_t node;
+    concurrent_pool_allocator_t *owner;
+    struct concurrent_pool_magazine *loaded;
+    struct concurrent_pool_magazine *previous;
+};
+
+static inline size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+/**
+ * Lock-free stacks of magazines, whose top is a tagged pointer
+ */
+
+static void magazine_push(atomic_uint_least64_t *top, struct concurrent_pool_magazine *mag)
+{
+    uint64_t old = atomic_load_explicit(top, memory_order_relaxed);
+    uint64_t new;
+
+    do {
+        atomic_store_explicit(&mag->next, (uintptr_t)(old & TAG_PTR_MASK), memory_order_relaxed);
+        new = (((old >> CONCURRENT_POOL_TAG_SHIFT) + 1) << CONCURRENT_POOL_TAG_SHIFT) | (uintptr_t)mag;
+    } while (!atomic_compare_exchange_weak_explicit(top, &old, new, memory_order_release, memory_order_relaxed));
+}
+
+static struct concurrent_pool_magazine *magazine_pop(atomic_uint_least64_t *top)
+{
+    uint64_t old = atomic_load_explicit(top, memory_order_acquire);
+    struct concurrent_pool_magazine *mag;
+    uint64_t new;
+
+    do {
+        mag = (struct concurrent_pool_magazine *)(uintptr_t)(old & TAG_PTR_MASK);
+        if (mag == NULL) {
+            return NULL;
+        }
+        /* If mag was popped (and maybe pushed again) meanwhile, the tag changed and the exchange fails */
+        new = (((old >> CONCURRENT_POOL_TAG_SHIFT) + 1) << CONCURRENT_POOL_TAG_SHIFT) |
+              atomic_load_explicit(&mag->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(top, &old, new, memory_order_acquire, memory_order_acquire));
+    return mag;
+}
+
+/**
+ * Get an empty magazine from the depot, or create one
+ */
+static struct concurrent_pool_magazine *magazine_get_empty(concurrent_pool_allocator_t *cpool)
+{
+    struct concurrent_pool_magazine *mag = magazine_pop(&cpool->empty_magazines);
+
+    if likely(mag != NULL) {
+        return mag;
+    }
+    pthread_mutex_lock(&cpool->lock);
+    mag = allocator_new(cpool->backing, struct concurrent_pool_magazine);
+    if likely(mag != NULL) {
+        assert(((uintptr_t)mag & ~TAG_PTR_MASK) == 0);
+        mag->count = 0;
+        mag->next_of_pool = cpool->magazines;
+        cpool->magazines = mag;
+    }
+    pthread_mutex_unlock(&cpool->lock);
+    return mag;
+}
+
+static inline void magazine_give_back(concurrent_pool_allocator_t *cpool, struct concurrent_pool_magazine *mag)
+{
+    if (mag != NULL) {
+        magazine_push(mag->count > 0 ? &cpool->full_magazines : &cpool->empty_magazines, mag);
+    }
+}
+
+/**
+ * Fill an empty magazine with fresh slots
+ */
+static bool magazine_fill(concurrent_pool_allocator_t *cpool, struct concurrent_pool_magazine *mag)
+{
+    size_t slab_header_size = align_up(sizeof(struct pool_slab), cpool->slot_align);
+
+    pthread_mutex_lock(&cpool->lock);
+    while (mag->count < CONCURRENT_POOL_MAGAZINE_SIZE) {
+        if (cpool->cur == cpool->end) {
+            size_t slab_size = MAX(
+                CONCURRENT_POOL_SLAB_SIZE,
+                slab_header_size + CONCURRENT_POOL_MAGAZINE_SIZE * cpool->slot_size
+            );
+            struct pool_slab *slab = cpool->backing->allocate(
+                cpool->backing,
+                slab_size,
+                MAX(cpool->slot_align, alignof(struct pool_slab))
+            );
+
+            if unlikely(slab == NULL) {
+                break;
+            }
+            slab->next = cpool->slabs;
+            cpool->slabs = slab;
+            cpool->cur = (char *)slab + slab_header_size;
+            cpool->end = cpool->cur + (slab_size - slab_header_size) / cpool->slot_size * cpool->slot_size;
+        }
+        mag->slots[mag->count++] = cpool->cur;
+        cpool->cur += cpool->slot_size;
+    }
+    pthread_mutex_unlock(&cpool->lock);
+    return mag->count > 0;
+}
+
+static void cache_destroy(void *data)
+{
+    struct cpool_cache *cache = data;
+    concurrent_pool_allocator_t *cpool = cache->owner;
+
+    magazine_give_back(cpool, cache->loaded);
+    magazine_give_back(cpool, cache->previous);
+    pthread_mutex_lock(&cpool->lock);
+    list_node_remove(&cache->node);
+    allocator_delete(cpool->backing, cache);
+    pthread_mutex_unlock(&cpool->lock);
+}
+
+static struct cpool_cache *cache_create(concurrent_pool_allocator_t *cpool)
+{
+    struct cpool_cache *cache;
+
+    pthread_mutex_lock(&cpool->lock);
+    cache = allocator_znew(cpool->backing, struct cpool_cache);
+    if likely(cache != NULL) {
+        cache->owner = cpool;
+        list_push_back(&cpool->caches, &cache->node);
+    }
+    pthread_mutex_unlock(&cpool->lock);
+    if unlikely(cache != NULL && pthread_setspecific(cpool->key, cache) != 0) {
+        cache_destroy(cache);
+        cache = NULL;
+    }
+    return cache;
+}
+
+static inline struct cpool_cache *cache_get(concurrent_pool_allocator_t *cpool)
+{
+    struct cpool_cache *cache = pthread_getspecific(cpool->key);
+
+    if unlikely(cache == NULL) {
+        cache = cache_create(cpool);
+    }
+    return cache;
+}
+
+/**
+ * Make the loaded magazine of a cache non-empty
+ */
+static bool cache_reload(concurrent_pool_allocator_t *cpool, struct cpool_cache *cache)
+{
+    struct concurrent_pool_magazine *full;
+
+    if (cache->previous != NULL && cache->previous->count > 0) {
+        SWAP(&cache->loaded, &cache->previous);
+        return true;
+    }
+    full = magazine_pop(&cpool->full_magazines);
+    if (full != NULL) {
+        /* Both magazines are empty: keep one of them, give the other one back */
+        magazine_give_back(cpool, cache->previous);
+        cache->previous = cache->loaded;
+        cache->loaded = full;
+        return true;
+    }
+    if (cache->loaded == NULL && (cache->loaded = magazine_get_empty(cpool)) == NULL) {
+        return false;
+    }
+    return magazine_fill(cpool, cache->loaded);
+}
+
+/**
+ * Make room in the loaded magazine of a cache
+ */
+static bool cache_unload(concurrent_pool_allocator_t *cpool, struct cpool_cache *cache)
+{
+    struct concurrent_pool_magazine *empty;
+
+    if (cache->previous != NULL && cache->previous->count == 0) {
+        SWAP(&cache->loaded, &cache->previous);
+        return true;
+    }
+    if (cache->loaded == NULL) {
+        return (cache->loaded = magazine_get_empty(cpool)) != NULL;
+    }
+    if unlikely((empty = magazine_get_empty(cpool)) == NULL) {
+        return false;
+    }
+    /* Both magazines are full: keep one of them, give the other one back */
+    magazine_give_back(cpool, cache->previous);
+    cache->previous = cache->loaded;
+    cache->loaded = empty;
+    return true;
+}
+
+static void *cpool_allocate(memory_allocator_handle_t alloc, size_t size, _unused_ size_t align)
+{
+    concurrent_pool_allocator_t *cpool = cpool_of(alloc);
+    struct cpool_cache *cache = cache_get(cpool);
+
+    assert(size <= cpool->slot_size && align <= cpool->slot_align);
+    if unlikely(cache == NULL) {
+        return NULL;
+    }
+    if unlikely((cache->loaded == NULL || cache->loaded->count == 0) && !cache_reload(cpool, cache)) {
+        return NULL;
+    }
+    return cache->loaded->slots[--cache->loaded->count];
+}
+
+static void *cpool_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    void *ptr = cpool_allocate(alloc, size, align);
+
+    if likely(ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void cpool_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    concurrent_pool_allocator_t *cpool = cpool_of(alloc);
+    struct cpool_cache *cache;
+
+    if (ptr == NULL) {
+        return;
+    }
+    cache = cache_get(cpool);
+    if unlikely(cache == NULL) {
+        /* Out of memory for the bookkeeping, the slot is lost until the pool is destroyed */
+        return;
+    }
+    if unlikely(
+        (cache->loaded == NULL || cache->loaded->count == CONCURRENT_POOL_MAGAZINE_SIZE) &&
+        !cache_unload(cpool, cache)
+    ) {
+        return;
+    }
+    cache->loaded->slots[cache->loaded->count++] = ptr;
+}
+
+static void *cpool_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    _unused_ size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    if (new_size == 0) {
+        cpool_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return cpool_allocate(alloc, new_size, new_align);
+    }
+
+    /* Every slot is already as big as it can get */
+    assert(new_size <= cpool_of(alloc)->slot_size && new_align <= cpool_of(alloc)->slot_align);
+    return ptr;
+}
+
+static void *cpool_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    void *ptr = cpool_allocate(alloc, size, align);
+
+    *usable_size = ptr != NULL ? cpool_of(alloc)->slot_size : 0;
+    return ptr;
+}
+
+static void *cpool_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    ptr = cpool_reallocate(alloc, ptr, old_size, new_size, new_align);
+    *usable_size = ptr != NULL ? cpool_of(alloc)->slot_size : 0;
+    return ptr;
+}
+
+int concurrent_pool_allocator_init(
+    concurrent_pool_allocator_t *cpool,
+    memory_allocator_handle_t backing,
+    size_t slot_size,
+    size_t slot_align
+)
+{
+    cpool->base = (struct memory_allocator){
+        .allocate = &cpool_allocate,
+        .zero_allocate = &cpool_zero_allocate,
+        .deallocate = &cpool_deallocate,
+        .reallocate = &cpool_reallocate,
+        .allocate_at_least = &cpool_allocate_at_least,
+        .reallocate_at_least = &cpool_reallocate_at_least,
+    };
+    cpool->backing = backing;
+    cpool->slot_align = slot_align;
+    cpool->slot_size = align_up(MAX(slot_size, (size_t)1), slot_align);
+    atomic_init(&cpool->full_magazines, 0);
+    atomic_init(&cpool->empty_magazines, 0);
+    list_init(&cpool->caches);
+    cpool->magazines = NULL;
+    cpool->slabs = NULL;
+    cpool->cur = NULL;
+    cpool->end = NULL;
+    if (pthread_key_create(&cpool->key, &cache_destroy) != 0) {
+        return -1;
+    }
+    pthread_mutex_init(&cpool->lock, NULL);
+    return 0;
+}
+
+void concurrent_pool_allocator_destroy(concurrent_pool_allocator_t *cpool)
+{
+    pthread_key_delete(cpool->key);
+    while (!list_is_empty(&cpool->caches)) {
+        struct cpool_cache *cache = list_element(cpool->caches.head, struct cpool_cache, node);
+
+        list_node_remove(&cache->node);
+        allocator_delete(cpool->backing, cache);
+    }
+    while (cpool->magazines != NULL) {
+        struct concurrent_pool_magazine *mag = cpool->magazines;
+
+        cpool->magazines = mag->next_of_pool;
+        allocator_delete(cpool->backing, mag);
+    }
+    while (cpool->slabs != NULL) {
+        struct pool_slab *slab = cpool->slabs;
+
+        cpool->slabs = slab->next;
+        allocator_delete(cpool->backing, slab);
+    }
+    pthread_mutex_destroy(&cpool->lock);
+}
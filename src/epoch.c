@@ -0,0 +1,148 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/epoch.h>
+
+static void record_release(void *data)
+{
+    struct epoch_record *record = data;
+
+    record->depth = 0;
+    atomic_store(&record->epoch, 0);
+    atomic_store(&record->in_use, false);
+}
+
+struct epoch_record *_epoch_register(epoch_domain_t *ed)
+{
+    struct epoch_record *record;
+
+    pthread_mutex_lock(&ed->lock);
+    for (record = ed->records; record != NULL; record = record->next) {
+        if (!atomic_load(&record->in_use)) {
+            break;
+        }
+    }
+    if (record == NULL) {
+        record = allocator_new(ed->alloc, struct epoch_record);
+        if likely(record != NULL) {
+            record->next = ed->records;
+            ed->records = record;
+        }
+    }
+    if likely(record != NULL) {
+        record->depth = 0;
+        atomic_init(&record->epoch, 0);
+        atomic_init(&record->in_use, true);
+    }
+    pthread_mutex_unlock(&ed->lock);
+    if unlikely(record != NULL && pthread_setspecific(ed->key, record) != 0) {
+        record_release(record);
+        record = NULL;
+    }
+    return record;
+}
+
+int epoch_domain_init(epoch_domain_t *ed, memory_allocator_handle_t alloc)
+{
+    ed->alloc = alloc;
+    /* Records hold 0 outside of critical sections, so epochs start at 1 */
+    atomic_init(&ed->epoch, 1);
+    ed->records = NULL;
+    ed->retired = NULL;
+    ed->retired_count = 0;
+    if (pthread_key_create(&ed->key, &record_release) != 0) {
+        return -1;
+    }
+    pthread_mutex_init(&ed->lock, NULL);
+    return 0;
+}
+
+static void reclaim_all(struct epoch_node *node)
+{
+    while (node != NULL) {
+        struct epoch_node *next = node->next;
+
+        node->reclaim(node, node->ctx);
+        node = next;
+    }
+}
+
+void epoch_domain_destroy(epoch_domain_t *ed)
+{
+    pthread_key_delete(ed->key);
+    reclaim_all(ed->retired);
+    while (ed->records != NULL) {
+        struct epoch_record *record = ed->records;
+
+        ed->records = record->next;
+        allocator_delete(ed->alloc, record);
+    }
+    pthread_mutex_destroy(&ed->lock);
+}
+
+/**
+ * Unlink the retired objects no reader can still be using, giving them back
+ */
+static struct epoch_node *collect_reclaimable(epoch_domain_t *ed)
+{
+    uint_least64_t oldest = UINT_LEAST64_MAX;
+    struct epoch_node *reclaimable = NULL;
+    struct epoch_node **link = &ed->retired;
+
+    for (struct epoch_record *record = ed->records; record != NULL; record = record->next) {
+        uint_least64_t epoch = atomic_load(&record->epoch);
+
+        if (epoch != 0) {
+            oldest = MIN(oldest, epoch);
+        }
+    }
+    while (*link != NULL) {
+        struct epoch_node *node = *link;
+
+        if (node->retired_epoch < oldest) {
+            *link = node->next;
+            node->next = reclaimable;
+            reclaimable = node;
+            --ed->retired_count;
+        } else {
+            link = &node->next;
+        }
+    }
+    return reclaimable;
+}
+
+void epoch_retire(
+    epoch_domain_t *ed,
+    struct epoch_node *node,
+    void (*reclaim)(struct epoch_node *node, void *ctx),
+    void *ctx
+)
+{
+    struct epoch_node *reclaimable;
+
+    node->reclaim = reclaim;
+    node->ctx = ctx;
+    pthread_mutex_lock(&ed->lock);
+    /* Readers which enter after this can only see what replaced the object */
+    node->retired_epoch = atomic_fetch_add(&ed->epoch, 1);
+    node->next = ed->retired;
+    ed->retired = node;
+    ++ed->retired_count;
+    reclaimable = collect_reclaimable(ed);
+    pthread_mutex_unlock(&ed->lock);
+    reclaim_all(reclaimable);
+}
+
+size_t epoch_reclaim(epoch_domain_t *ed)
+{
+    struct epoch_node *reclaimable;
+    size_t left;
+
+    pthread_mutex_lock(&ed->lock);
+    reclaimable = collect_reclaimable(ed);
+    left = ed->retired_count;
+    pthread_mutex_unlock(&ed->lock);
+    reclaim_all(reclaimable);
+    return left;
+}
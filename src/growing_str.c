@@ -11,18 +11,18 @@ void _gs_reallocate(growing_str_t *str, size_t desired_capacity)
     desired_capacity = MAX(desired_capacity, str->capacity * 2);
 
     if (str->str == _gs_empty_marker) {
-        str->str = allocator_new_array(str->allocator_handle, char, desired_capacity);
+        str->str = allocator_new_array_at_least(str->allocator_handle, char, desired_capacity, &str->capacity);
         str->str[0] = '\0';
     } else {
-        str->str = (char *)allocator_resize_array(
+        str->str = (char *)allocator_resize_array_at_least(
             str->allocator_handle,
             str->str,
             char,
             str->capacity,
-            desired_capacity
+            desired_capacity,
+            &str->capacity
         );
     }
-    str->capacity = desired_capacity;
 }
 
 static void gs_append_vformatted(growing_str_t *str, const char *fmt, va_list ap)
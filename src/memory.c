@@ -3,6 +3,9 @@
 */
 
 #include <ceeds/memory.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 static __attribute_noinline__ _noreturn_ void handle_allocation_failure(void)
 {
@@ -85,11 +88,21 @@ static void *heap_reallocate(
     }
 }
 
+static size_t heap_trim(_unused_ memory_allocator_handle_t alloc)
+{
+    /* glibc does not tell how much it gave back */
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    return 0;
+}
+
 struct memory_allocator heap_allocator = {
     .allocate = &heap_allocate,
     .zero_allocate = &heap_zero_allocate,
     .deallocate = &heap_deallocate,
     .reallocate = &heap_reallocate,
+    .trim = &heap_trim,
 };
 
 static void *static_allocate(_unused_ memory_allocator_handle_t alloc, _unused_ size_t size, _unused_ size_t align)
@@ -0,0 +1,179 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <ceeds/mmap_allocator.h>
+
+/**
+ * Header stored right before every block, telling where its mapping begins and how big it is
+ */
+struct mmap_header
+{
+    size_t mapping_size;
+    size_t offset;
+};
+
+static size_t page_size(void)
+{
+    static size_t size;
+
+    if unlikely(size == 0) {
+        size = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    return size;
+}
+
+static inline size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static inline struct mmap_header *header_of(void *ptr)
+{
+    return (struct mmap_header *)ptr - 1;
+}
+
+static inline size_t data_offset(size_t align)
+{
+    return align_up(sizeof(struct mmap_header), MAX(align, alignof(struct mmap_header)));
+}
+
+static void *mmap_allocate(_unused_ memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    size_t offset = data_offset(align);
+    size_t mapping_size = align_up(offset + size, page_size());
+    size_t slack = align > page_size() ? align : 0;
+    char *base = mmap(NULL, mapping_size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if unlikely(base == MAP_FAILED) {
+        return NULL;
+    }
+    if (slack > 0) {
+        /* Over-map, then trim the excess on both sides to get a mapping aligned on the requested boundary */
+        char *aligned = (char *)align_up((uintptr_t)base, align);
+
+        if (aligned != base) {
+            munmap(base, (size_t)(aligned - base));
+        }
+        if (aligned + mapping_size != base + mapping_size + slack) {
+            munmap(aligned + mapping_size, (size_t)(base + slack - aligned));
+        }
+        base = aligned;
+    }
+    header_of(base + offset)->mapping_size = mapping_size;
+    header_of(base + offset)->offset = offset;
+    return base + offset;
+}
+
+static void *mmap_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    /* Fresh anonymous mappings are already zeroed */
+    return mmap_allocate(alloc, size, align);
+}
+
+static void mmap_deallocate(_unused_ memory_allocator_handle_t alloc, void *ptr)
+{
+    struct mmap_header *header;
+
+    if (ptr == NULL) {
+        return;
+    }
+    header = header_of(ptr);
+    munmap((char *)ptr - header->offset, header->mapping_size);
+}
+
+static void *mmap_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    struct mmap_header *header;
+    size_t offset;
+    size_t old_mapping_size;
+    size_t new_mapping_size;
+    char *base;
+    void *new_ptr;
+
+    if (new_size == 0) {
+        mmap_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return mmap_allocate(alloc, new_size, new_align);
+    }
+
+    header = header_of(ptr);
+    offset = header->offset;
+    old_mapping_size = header->mapping_size;
+    new_mapping_size = align_up(offset + new_size, page_size());
+    base = (char *)ptr - offset;
+
+    if (is_aligned_ptr(ptr, new_align) && offset >= data_offset(new_align)) {
+        if (new_mapping_size == old_mapping_size) {
+            return ptr;
+        }
+        if (new_mapping_size < old_mapping_size) {
+            munmap(base + new_mapping_size, old_mapping_size - new_mapping_size);
+            header->mapping_size = new_mapping_size;
+            return ptr;
+        }
+        /* mremap only preserves page alignment, stricter alignments need a fresh mapping */
+        if (new_align <= page_size()) {
+            base = mremap(base, old_mapping_size, new_mapping_size, MREMAP_MAYMOVE);
+            if unlikely(base == MAP_FAILED) {
+                return NULL;
+            }
+            header_of(base + offset)->mapping_size = new_mapping_size;
+            return base + offset;
+        }
+    }
+
+    new_ptr = mmap_allocate(alloc, new_size, new_align);
+    if likely(new_ptr != NULL) {
+        memcpy(new_ptr, ptr, MIN(old_size, new_size));
+        mmap_deallocate(alloc, ptr);
+    }
+    return new_ptr;
+}
+
+static void *mmap_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    void *ptr = mmap_allocate(alloc, size, align);
+
+    *usable_size = ptr != NULL ? header_of(ptr)->mapping_size - header_of(ptr)->offset : 0;
+    return ptr;
+}
+
+static void *mmap_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    ptr = mmap_reallocate(alloc, ptr, old_size, new_size, new_align);
+    *usable_size = ptr != NULL ? header_of(ptr)->mapping_size - header_of(ptr)->offset : 0;
+    return ptr;
+}
+
+struct memory_allocator mmap_allocator = {
+    .allocate = &mmap_allocate,
+    .zero_allocate = &mmap_zero_allocate,
+    .deallocate = &mmap_deallocate,
+    .reallocate = &mmap_reallocate,
+    .allocate_at_least = &mmap_allocate_at_least,
+    .reallocate_at_least = &mmap_reallocate_at_least,
+};
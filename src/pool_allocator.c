@@ -0,0 +1,145 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/pool_allocator.h>
+
+#define pool_of(alloc)          container_of(alloc, pool_allocator_t, base)
+
+static inline size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static inline size_t pool_slab_header_size(const pool_allocator_t *pool)
+{
+    return align_up(sizeof(struct pool_slab), pool->slot_align);
+}
+
+bool _pool_allocator_add_slab(pool_allocator_t *pool)
+{
+    struct pool_slab *slab = pool->backing->allocate(
+        pool->backing,
+        pool->slab_size,
+        MAX(pool->slot_align, alignof(struct pool_slab))
+    );
+
+    if unlikely(slab == NULL) {
+        return false;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->cur = (char *)slab + pool_slab_header_size(pool);
+    pool->end = pool->cur + (pool->slab_size - pool_slab_header_size(pool)) / pool->slot_size * pool->slot_size;
+    return true;
+}
+
+static void *pool_allocate(memory_allocator_handle_t alloc, size_t size, _unused_ size_t align)
+{
+    pool_allocator_t *pool = pool_of(alloc);
+
+    assert(size <= pool->slot_size && align <= pool->slot_align);
+    return pool_allocator_allocate_slot(pool);
+}
+
+static void *pool_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    void *ptr = pool_allocate(alloc, size, align);
+
+    if likely(ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void pool_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    pool_allocator_deallocate_slot(pool_of(alloc), ptr);
+}
+
+static void *pool_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    _unused_ size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    if (new_size == 0) {
+        pool_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return pool_allocate(alloc, new_size, new_align);
+    }
+
+    /* Every slot is already as big as it can get */
+    assert(new_size <= pool_of(alloc)->slot_size && new_align <= pool_of(alloc)->slot_align);
+    return ptr;
+}
+
+static void *pool_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    *usable_size = pool_of(alloc)->slot_size;
+    return pool_allocate(alloc, size, align);
+}
+
+static void *pool_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    *usable_size = new_size == 0 ? 0 : pool_of(alloc)->slot_size;
+    return pool_reallocate(alloc, ptr, old_size, new_size, new_align);
+}
+
+void pool_allocator_init(
+    pool_allocator_t *pool,
+    memory_allocator_handle_t backing,
+    size_t slot_size,
+    size_t slot_align
+)
+{
+    pool->base = (struct memory_allocator){
+        .allocate = &pool_allocate,
+        .zero_allocate = &pool_zero_allocate,
+        .deallocate = &pool_deallocate,
+        .reallocate = &pool_reallocate,
+        .allocate_at_least = &pool_allocate_at_least,
+        .reallocate_at_least = &pool_reallocate_at_least,
+    };
+    pool->backing = backing;
+    pool->slot_align = MAX(slot_align, alignof(struct pool_free_slot));
+    pool->slot_size = align_up(MAX(slot_size, sizeof(struct pool_free_slot)), pool->slot_align);
+    pool->slab_size = MAX(
+        (size_t)POOL_SLAB_SIZE,
+        pool_slab_header_size(pool) + POOL_MIN_SLOTS_PER_SLAB * pool->slot_size
+    );
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->cur = NULL;
+    pool->end = NULL;
+}
+
+void pool_allocator_destroy(pool_allocator_t *pool)
+{
+    while (pool->slabs != NULL) {
+        struct pool_slab *slab = pool->slabs;
+
+        pool->slabs = slab->next;
+        allocator_delete(pool->backing, slab);
+    }
+    pool->free_list = NULL;
+    pool->cur = NULL;
+    pool->end = NULL;
+}
@@ -0,0 +1,110 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <sys/mman.h>
+#include <time.h>
+#include <ceeds/scavenger.h>
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static size_t span_release(scavenger_t *sc, struct scavenger_span *span)
+{
+    list_node_remove(&span->node);
+    sc->resident_bytes -= span->size;
+
+    /* If the OS refuses, the span is kept as is: it can still be reused, just not released again */
+    if unlikely(madvise(span->addr, span->size, sc->advice) != 0) {
+        list_push_front(&sc->released, &span->node);
+        return 0;
+    }
+    span->released = true;
+    sc->released_bytes += span->size;
+    list_push_front(&sc->released, &span->node);
+    return span->size;
+}
+
+void scavenger_init(scavenger_t *sc)
+{
+    scavenger_clear(sc);
+    scavenger_set_policy(sc, SCAVENGER_DEFAULT_MAX_IDLE_BYTES, SCAVENGER_DEFAULT_MAX_IDLE_NS, false);
+}
+
+void scavenger_set_policy(scavenger_t *sc, size_t max_idle_bytes, uint64_t max_idle_ns, bool lazy)
+{
+    sc->max_idle_bytes = max_idle_bytes;
+    sc->max_idle_ns = max_idle_ns;
+    sc->advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+    if (lazy) {
+        sc->advice = MADV_FREE;
+    }
+#else
+    (void)lazy;
+#endif
+}
+
+void scavenger_put(scavenger_t *sc, struct scavenger_span *span, void *addr, size_t size)
+{
+    uint64_t now = now_ns();
+
+    span->addr = addr;
+    span->size = size;
+    span->idle_since = now;
+    span->released = false;
+    list_push_back(&sc->resident, &span->node);
+    sc->resident_bytes += size;
+
+    scavenger_release(sc, sc->max_idle_bytes);
+    while (!list_is_empty(&sc->resident)) {
+        struct scavenger_span *oldest = list_element(sc->resident.head, struct scavenger_span, node);
+
+        if (now - oldest->idle_since < sc->max_idle_ns) {
+            break;
+        }
+        span_release(sc, oldest);
+    }
+}
+
+struct scavenger_span *scavenger_take(scavenger_t *sc)
+{
+    struct scavenger_span *span;
+
+    if (!list_is_empty(&sc->resident)) {
+        span = list_element(sc->resident.tail, struct scavenger_span, node);
+        sc->resident_bytes -= span->size;
+    } else if (!list_is_empty(&sc->released)) {
+        span = list_element(sc->released.head, struct scavenger_span, node);
+        if (span->released) {
+            sc->released_bytes -= span->size;
+        }
+    } else {
+        return NULL;
+    }
+    list_node_remove(&span->node);
+    return span;
+}
+
+size_t scavenger_release(scavenger_t *sc, size_t keep_bytes)
+{
+    size_t released = 0;
+
+    while (sc->resident_bytes > keep_bytes) {
+        released += span_release(sc, list_element(sc->resident.head, struct scavenger_span, node));
+    }
+    return released;
+}
+
+void scavenger_clear(scavenger_t *sc)
+{
+    list_init(&sc->resident);
+    list_init(&sc->released);
+    sc->resident_bytes = 0;
+    sc->released_bytes = 0;
+}
@@ -0,0 +1,408 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <ceeds/size_class_allocator.h>
+
+#define sca_of(alloc)           container_of(alloc, size_class_allocator_t, base)
+
+#define PAGE_SIZE_HINT          ((size_t)4096)
+
+static inline size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static inline size_t size_class_alignment(uint32_t index)
+{
+    size_t size = size_class_size(index);
+
+    return MIN(size & -size, PAGE_SIZE_HINT);
+}
+
+static inline struct size_class_span *span_of(const void *ptr)
+{
+    return (struct size_class_span *)((uintptr_t)ptr & ~(SIZE_CLASS_SPAN_SIZE - 1));
+}
+
+static inline size_t span_data_offset(size_t align)
+{
+    return align_up(sizeof(struct size_class_span), MAX(align, alignof(struct size_class_span)));
+}
+
+/**
+ * Map a SIZE_CLASS_SPAN_SIZE-aligned region, by over-mapping and trimming the excess
+ */
+static struct size_class_span *map_span(size_class_allocator_t *sca, size_t size, uint32_t class_index)
+{
+    size_t mapped = size + SIZE_CLASS_SPAN_SIZE;
+    char *ptr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *aligned;
+    struct size_class_span *span;
+
+    if unlikely(ptr == MAP_FAILED) {
+        return NULL;
+    }
+    aligned = (char *)(((uintptr_t)ptr + SIZE_CLASS_SPAN_SIZE - 1) & ~(SIZE_CLASS_SPAN_SIZE - 1));
+    if (aligned != ptr) {
+        munmap(ptr, (size_t)(aligned - ptr));
+    }
+    if (aligned + size != ptr + mapped) {
+        munmap(aligned + size, (size_t)(ptr + mapped - (aligned + size)));
+    }
+    span = (struct size_class_span *)aligned;
+    span->mapping_size = size;
+    span->class_index = class_index;
+    pthread_mutex_lock(&sca->lock);
+    list_push_back(&sca->spans, &span->node);
+    pthread_mutex_unlock(&sca->lock);
+    return span;
+}
+
+static void unmap_span(size_class_allocator_t *sca, struct size_class_span *span)
+{
+    pthread_mutex_lock(&sca->lock);
+    list_node_remove(&span->node);
+    pthread_mutex_unlock(&sca->lock);
+    munmap(span, span->mapping_size);
+}
+
+/**
+ * Find the smallest size class holding at least @p size bytes with at least an alignment of @p align
+ *
+ * @return                          the index of the size class, or SIZE_CLASS_LARGE if there is none
+ */
+static uint32_t size_class_for(size_t size, size_t align)
+{
+    uint32_t index;
+
+    if unlikely(size > SIZE_CLASS_MAX_SMALL_SIZE) {
+        return SIZE_CLASS_LARGE;
+    }
+    index = size_class_index(size);
+    while (size_class_alignment(index) < align) {
+        if (++index == SIZE_CLASS_COUNT) {
+            return SIZE_CLASS_LARGE;
+        }
+    }
+    return index;
+}
+
+/**
+ * Set a span up for a given size class, with all its slots free
+ */
+static void span_setup(struct size_class_span *span, uint32_t index)
+{
+    size_t offset = span_data_offset(size_class_alignment(index));
+    size_t slot_size = size_class_size(index);
+
+    span->class_index = index;
+    span->live = 0;
+    span->free_list = NULL;
+    span->partial = false;
+    span->cur = (char *)span + offset;
+    span->end = span->cur + (SIZE_CLASS_SPAN_SIZE - offset) / slot_size * slot_size;
+}
+
+/**
+ * Hand a span whose slots are all free to the scavenger, which may give all its pages but the one holding its
+ * header back to the OS
+ *
+ * The lock of the class of the span must be held.
+ */
+static void span_retire(size_class_allocator_t *sca, struct size_class_span *span)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *first = (char *)align_up((size_t)(span + 1), page);
+    char *last = (char *)span + SIZE_CLASS_SPAN_SIZE;
+
+    if (span->partial) {
+        list_node_remove(&span->bin_node);
+        span->partial = false;
+    }
+    pthread_mutex_lock(&sca->lock);
+    scavenger_put(&sca->scavenger, &span->idle, first, first < last ? (size_t)(last - first) : 0);
+    pthread_mutex_unlock(&sca->lock);
+}
+
+static inline void *span_allocate(struct size_class_span *span, size_t slot_size)
+{
+    void *ptr;
+
+    if (span->free_list != NULL) {
+        ptr = span->free_list;
+        span->free_list = span->free_list->next;
+    } else if (span->cur != span->end) {
+        ptr = span->cur;
+        span->cur += slot_size;
+    } else {
+        return NULL;
+    }
+    span->live += 1;
+    return ptr;
+}
+
+/**
+ * Replace the full current span of a size class, with a span which got some slots back, an idle span, or
+ * a brand new one
+ *
+ * The lock of the class must be held.
+ */
+static struct scavenger_span *scavenger_take_locked(size_class_allocator_t *sca)
+{
+    struct scavenger_span *idle;
+
+    pthread_mutex_lock(&sca->lock);
+    idle = scavenger_take(&sca->scavenger);
+    pthread_mutex_unlock(&sca->lock);
+    return idle;
+}
+
+static struct size_class_span *bin_refill(size_class_allocator_t *sca, struct size_class_bin *bin, uint32_t index)
+{
+    struct size_class_span *span;
+    struct scavenger_span *idle;
+
+    if (!list_is_empty(&bin->partial)) {
+        span = list_element(bin->partial.head, struct size_class_span, bin_node);
+        list_node_remove(&span->bin_node);
+        span->partial = false;
+    } else if ((idle = scavenger_take_locked(sca)) != NULL) {
+        span = container_of(idle, struct size_class_span, idle);
+        span_setup(span, index);
+    } else {
+        span = map_span(sca, SIZE_CLASS_SPAN_SIZE, index);
+        if unlikely(span == NULL) {
+            return NULL;
+        }
+        span_setup(span, index);
+    }
+    bin->current = span;
+    return span;
+}
+
+static void *sca_allocate_small(size_class_allocator_t *sca, uint32_t index)
+{
+    struct size_class_bin *bin = &sca->bins[index];
+    size_t slot_size = size_class_size(index);
+    void *ptr = NULL;
+
+    pthread_mutex_lock(&bin->lock);
+    if likely(bin->current != NULL && (ptr = span_allocate(bin->current, slot_size)) != NULL) {
+        pthread_mutex_unlock(&bin->lock);
+        return ptr;
+    }
+    if likely(bin_refill(sca, bin, index) != NULL) {
+        ptr = span_allocate(bin->current, slot_size);
+    }
+    pthread_mutex_unlock(&bin->lock);
+    return ptr;
+}
+
+static void *sca_allocate_large(size_class_allocator_t *sca, size_t size, size_t align)
+{
+    size_t offset = span_data_offset(align);
+    struct size_class_span *span;
+
+    assert(offset < SIZE_CLASS_SPAN_SIZE);
+    span = map_span(sca, align_up(offset + size, PAGE_SIZE_HINT), SIZE_CLASS_LARGE);
+    if unlikely(span == NULL) {
+        return NULL;
+    }
+    return (char *)span + offset;
+}
+
+static void *sca_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    size_class_allocator_t *sca = sca_of(alloc);
+    uint32_t index = size_class_for(size, align);
+
+    if likely(index != SIZE_CLASS_LARGE) {
+        return sca_allocate_small(sca, index);
+    }
+    return sca_allocate_large(sca, size, align);
+}
+
+static void *sca_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    void *ptr = sca_allocate(alloc, size, align);
+
+    /* Large allocations come straight from fresh anonymous mappings, which are already zeroed */
+    if likely(ptr != NULL && span_of(ptr)->class_index != SIZE_CLASS_LARGE) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void sca_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    size_class_allocator_t *sca = sca_of(alloc);
+    struct size_class_span *span;
+    struct size_class_bin *bin;
+    struct size_class_free_slot *slot = ptr;
+
+    if (ptr == NULL) {
+        return;
+    }
+    span = span_of(ptr);
+    if unlikely(span->class_index == SIZE_CLASS_LARGE) {
+        unmap_span(sca, span);
+        return;
+    }
+    /* The span holds a live slot, so it can't change classes under our feet */
+    bin = &sca->bins[span->class_index];
+    pthread_mutex_lock(&bin->lock);
+    slot->next = span->free_list;
+    span->free_list = slot;
+    span->live -= 1;
+
+    if unlikely(span != bin->current) {
+        if (span->live == 0) {
+            span_retire(sca, span);
+        } else if (!span->partial) {
+            list_push_back(&bin->partial, &span->bin_node);
+            span->partial = true;
+        }
+    }
+    pthread_mutex_unlock(&bin->lock);
+}
+
+/**
+ * Get the amount of bytes usable at a given pointer
+ */
+static size_t sca_usable_size(const void *ptr)
+{
+    const struct size_class_span *span = span_of(ptr);
+
+    if unlikely(span->class_index == SIZE_CLASS_LARGE) {
+        return span->mapping_size - (size_t)((const char *)ptr - (const char *)span);
+    }
+    return size_class_size(span->class_index);
+}
+
+static void *sca_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    void *new_ptr;
+
+    if (new_size == 0) {
+        sca_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return sca_allocate(alloc, new_size, new_align);
+    }
+
+    /* Growing within the same size class (or the same mapping) is free */
+    if (new_size <= sca_usable_size(ptr) && is_aligned_ptr(ptr, new_align)) {
+        return ptr;
+    }
+
+    new_ptr = sca_allocate(alloc, new_size, new_align);
+    if likely(new_ptr != NULL) {
+        if (old_size > 0) {
+            memcpy(new_ptr, ptr, MIN(old_size, new_size));
+        }
+        sca_deallocate(alloc, ptr);
+    }
+    return new_ptr;
+}
+
+static void *sca_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    void *ptr = sca_allocate(alloc, size, align);
+
+    *usable_size = ptr != NULL ? sca_usable_size(ptr) : 0;
+    return ptr;
+}
+
+static void *sca_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    ptr = sca_reallocate(alloc, ptr, old_size, new_size, new_align);
+    *usable_size = ptr != NULL ? sca_usable_size(ptr) : 0;
+    return ptr;
+}
+
+static size_t sca_trim(memory_allocator_handle_t alloc)
+{
+    size_class_allocator_t *sca = sca_of(alloc);
+    size_t released;
+
+    /* Current spans are kept even when empty, so as not to bounce between the scavenger and a class */
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        struct size_class_bin *bin = &sca->bins[i];
+
+        pthread_mutex_lock(&bin->lock);
+        if (bin->current != NULL && bin->current->live == 0) {
+            span_retire(sca, bin->current);
+            bin->current = NULL;
+        }
+        pthread_mutex_unlock(&bin->lock);
+    }
+    pthread_mutex_lock(&sca->lock);
+    released = scavenger_released_bytes(&sca->scavenger);
+    scavenger_release(&sca->scavenger, 0);
+    released = scavenger_released_bytes(&sca->scavenger) - released;
+    pthread_mutex_unlock(&sca->lock);
+    return released;
+}
+
+static void bins_init(size_class_allocator_t *sca)
+{
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        pthread_mutex_init(&sca->bins[i].lock, NULL);
+        sca->bins[i].current = NULL;
+        list_init(&sca->bins[i].partial);
+    }
+}
+
+void size_class_allocator_init(size_class_allocator_t *sca)
+{
+    sca->base = (struct memory_allocator){
+        .allocate = &sca_allocate,
+        .zero_allocate = &sca_zero_allocate,
+        .deallocate = &sca_deallocate,
+        .reallocate = &sca_reallocate,
+        .allocate_at_least = &sca_allocate_at_least,
+        .reallocate_at_least = &sca_reallocate_at_least,
+        .trim = &sca_trim,
+    };
+    bins_init(sca);
+    pthread_mutex_init(&sca->lock, NULL);
+    list_init(&sca->spans);
+    scavenger_init(&sca->scavenger);
+}
+
+void size_class_allocator_destroy(size_class_allocator_t *sca)
+{
+    while (!list_is_empty(&sca->spans)) {
+        unmap_span(sca, list_element(sca->spans.head, struct size_class_span, node));
+    }
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        pthread_mutex_destroy(&sca->bins[i].lock);
+        sca->bins[i].current = NULL;
+        list_init(&sca->bins[i].partial);
+    }
+    scavenger_clear(&sca->scavenger);
+    pthread_mutex_destroy(&sca->lock);
+}
@@ -0,0 +1,465 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <time.h>
+#include <ceeds/bitmanip.h>
+#include <ceeds/stats_allocator.h>
+
+#define sa_of(alloc)            container_of(alloc, stats_allocator_t, base)
+
+#define HEADER_SIZE             alignof(max_align_t)
+
+/**
+ * Header stored right before every block, telling how big it is
+ */
+struct stats_header
+{
+    size_t size;
+    size_t offset;
+};
+
+static_assert(sizeof(struct stats_header) <= HEADER_SIZE, "the header must fit in front of every block");
+
+/**
+ * Counters of a single thread
+ *
+ * Counters are only ever written by their thread, but may be read concurrently by stats_allocator_read().
+ */
+typedef struct stats_thread
+{
+    list_node_t node;
+    stats_allocator_t *owner;
+    uint32_t id;
+    atomic_uint_least64_t counts[ALLOC_TRACE_OP_COUNT];
+    atomic_uint_least64_t bytes[ALLOC_TRACE_OP_COUNT];
+    atomic_uint_least64_t histogram[STATS_HISTOGRAM_BUCKETS];
+    atomic_int_least64_t live_delta;
+    size_t trace_count;
+    struct alloc_trace_record trace[STATS_TRACE_BUFFER_SIZE];
+} stats_thread_t;
+
+static inline struct stats_header *header_of(void *ptr)
+{
+    return (struct stats_header *)ptr - 1;
+}
+
+static inline void counter_add(atomic_uint_least64_t *counter, uint64_t n)
+{
+    /* There is a single writer, a read-modify-write operation is not needed */
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline size_t histogram_bucket(size_t size)
+{
+    return size == 0 ? 0 : bitsizeof(unsigned long long) - (size_t)__builtin_clzll(size);
+}
+
+/**
+ * Write the buffered trace records of a thread
+ */
+static void trace_flush(stats_thread_t *st)
+{
+    stats_allocator_t *sa = st->owner;
+
+    if (st->trace_count > 0) {
+        pthread_mutex_lock(&sa->trace_lock);
+        fwrite(st->trace, sizeof(st->trace[0]), st->trace_count, sa->trace);
+        pthread_mutex_unlock(&sa->trace_lock);
+        st->trace_count = 0;
+    }
+}
+
+/**
+ * Add the counters of a thread to those of threads which are gone
+ *
+ * @pre                             the lock of the owner of @p st must be held
+ */
+static void thread_retire_locked(stats_thread_t *st)
+{
+    stats_allocator_t *sa = st->owner;
+
+    for (size_t i = 0; i < ALLOC_TRACE_OP_COUNT; ++i) {
+        sa->retired.counts[i] += atomic_load_explicit(&st->counts[i], memory_order_relaxed);
+        sa->retired.bytes[i] += atomic_load_explicit(&st->bytes[i], memory_order_relaxed);
+    }
+    for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i) {
+        sa->retired.histogram[i] += atomic_load_explicit(&st->histogram[i], memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&sa->live_bytes, atomic_load_explicit(&st->live_delta, memory_order_relaxed),
+                              memory_order_relaxed);
+    if (sa->trace != NULL) {
+        trace_flush(st);
+    }
+    list_node_remove(&st->node);
+    allocator_delete(sa->backing, st);
+}
+
+static void thread_destroy(void *data)
+{
+    stats_thread_t *st = data;
+    stats_allocator_t *sa = st->owner;
+
+    pthread_mutex_lock(&sa->lock);
+    thread_retire_locked(st);
+    pthread_mutex_unlock(&sa->lock);
+}
+
+static stats_thread_t *thread_create(stats_allocator_t *sa)
+{
+    stats_thread_t *st;
+
+    pthread_mutex_lock(&sa->lock);
+    st = allocator_znew(sa->backing, stats_thread_t);
+    if likely(st != NULL) {
+        st->owner = sa;
+        st->id = sa->next_thread_id++;
+        list_push_back(&sa->threads, &st->node);
+    }
+    pthread_mutex_unlock(&sa->lock);
+    if unlikely(st != NULL && pthread_setspecific(sa->key, st) != 0) {
+        thread_destroy(st);
+        st = NULL;
+    }
+    return st;
+}
+
+static inline stats_thread_t *thread_get(stats_allocator_t *sa)
+{
+    stats_thread_t *st = pthread_getspecific(sa->key);
+
+    if unlikely(st == NULL) {
+        st = thread_create(sa);
+    }
+    return st;
+}
+
+/**
+ * Publish the live bytes of a thread once enough of them have accumulated, updating the peak
+ */
+static inline void live_add(stats_thread_t *st, int64_t n)
+{
+    stats_allocator_t *sa = st->owner;
+    int64_t delta = atomic_load_explicit(&st->live_delta, memory_order_relaxed) + n;
+
+    if likely(delta < STATS_LIVE_BATCH && delta > -STATS_LIVE_BATCH) {
+        atomic_store_explicit(&st->live_delta, delta, memory_order_relaxed);
+        return;
+    }
+
+    int64_t live = atomic_fetch_add_explicit(&sa->live_bytes, delta, memory_order_relaxed) + delta;
+    int64_t peak = atomic_load_explicit(&sa->peak_bytes, memory_order_relaxed);
+
+    atomic_store_explicit(&st->live_delta, 0, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&sa->peak_bytes, &peak, live, memory_order_relaxed,
+                                                  memory_order_relaxed));
+}
+
+/**
+ * Get the next sequence number of a trace
+ */
+static inline uint64_t trace_seq(stats_allocator_t *sa)
+{
+    return atomic_fetch_add_explicit(&sa->trace_seq, 1, memory_order_relaxed);
+}
+
+static void trace_record(
+    stats_thread_t *st,
+    enum alloc_trace_op op,
+    void *ptr,
+    size_t size,
+    void *old_ptr,
+    size_t old_size,
+    size_t align,
+    uint64_t old_seq
+)
+{
+    struct alloc_trace_record *record = &st->trace[st->trace_count++];
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *record = (struct alloc_trace_record){
+        .seq = trace_seq(st->owner),
+        .old_seq = old_seq,
+        .timestamp_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec,
+        .ptr = (uintptr_t)ptr,
+        .old_ptr = (uintptr_t)old_ptr,
+        .size = size,
+        .old_size = old_size,
+        .thread = st->id,
+        .op = (uint8_t)op,
+        .align_log2 = align == 0 ? 0 : (uint8_t)__builtin_ctzll(align),
+    };
+    if unlikely(st->trace_count == STATS_TRACE_BUFFER_SIZE) {
+        trace_flush(st);
+    }
+}
+
+/**
+ * Account for a call
+ *
+ * @param[in]       size            the size of the resulting block (or of the freed one, for deallocations)
+ * @param[in]       old_size        the size of the block before the call, for reallocations
+ * @param[in]       old_seq         the sequence number taken before the call, for reallocations
+ */
+static void account(
+    stats_allocator_t *sa,
+    enum alloc_trace_op op,
+    void *ptr,
+    size_t size,
+    void *old_ptr,
+    size_t old_size,
+    size_t align,
+    uint64_t old_seq
+)
+{
+    stats_thread_t *st = thread_get(sa);
+
+    if unlikely(st == NULL) {
+        return;
+    }
+    counter_add(&st->counts[op], 1);
+    counter_add(&st->bytes[op], size);
+    switch (op) {
+        case ALLOC_TRACE_DEALLOCATE:
+            live_add(st, -(int64_t)size);
+            break;
+        case ALLOC_TRACE_REALLOCATE:
+            counter_add(&st->histogram[histogram_bucket(size)], 1);
+            live_add(st, (int64_t)size - (int64_t)old_size);
+            break;
+        default:
+            counter_add(&st->histogram[histogram_bucket(size)], 1);
+            live_add(st, (int64_t)size);
+            break;
+    }
+    if (sa->trace != NULL) {
+        trace_record(st, op, ptr, size, old_ptr, old_size, align, old_seq);
+    }
+}
+
+/**
+ * Set up the header of a block obtained from the backing allocator
+ */
+static inline void *block_init(char *raw, size_t offset, size_t size)
+{
+    if unlikely(raw == NULL) {
+        return NULL;
+    }
+    header_of(raw + offset)->size = size;
+    header_of(raw + offset)->offset = offset;
+    return raw + offset;
+}
+
+static void *sa_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    stats_allocator_t *sa = sa_of(alloc);
+    size_t offset = MAX(align, HEADER_SIZE);
+    size_t raw_size;
+    char *raw = allocator_allocate_at_least(sa->backing, offset + size, offset, &raw_size);
+    void *ptr = block_init(raw, offset, raw_size - offset);
+
+    if likely(ptr != NULL) {
+        account(sa, ALLOC_TRACE_ALLOCATE, ptr, raw_size - offset, NULL, 0, align, 0);
+    }
+    *usable_size = ptr != NULL ? raw_size - offset : 0;
+    return ptr;
+}
+
+static void *sa_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    stats_allocator_t *sa = sa_of(alloc);
+    size_t offset = MAX(align, HEADER_SIZE);
+    void *ptr = block_init(sa->backing->allocate(sa->backing, offset + size, offset), offset, size);
+
+    if likely(ptr != NULL) {
+        account(sa, ALLOC_TRACE_ALLOCATE, ptr, size, NULL, 0, align, 0);
+    }
+    return ptr;
+}
+
+static void *sa_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    stats_allocator_t *sa = sa_of(alloc);
+    size_t offset = MAX(align, HEADER_SIZE);
+    void *ptr = block_init(sa->backing->zero_allocate(sa->backing, offset + size, offset), offset, size);
+
+    if likely(ptr != NULL) {
+        account(sa, ALLOC_TRACE_ZERO_ALLOCATE, ptr, size, NULL, 0, align, 0);
+    }
+    return ptr;
+}
+
+static void sa_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    stats_allocator_t *sa = sa_of(alloc);
+    struct stats_header header;
+
+    if (ptr == NULL) {
+        return;
+    }
+    header = *header_of(ptr);
+    account(sa, ALLOC_TRACE_DEALLOCATE, ptr, header.size, NULL, 0, 0, 0);
+    allocator_sized_deallocate(sa->backing, (char *)ptr - header.offset, header.offset + header.size);
+}
+
+static void sa_sized_deallocate(memory_allocator_handle_t alloc, void *ptr, _unused_ size_t size)
+{
+    /* The header knows better: the caller may pass any size between the requested and the usable one */
+    sa_deallocate(alloc, ptr);
+}
+
+static void *sa_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    stats_allocator_t *sa = sa_of(alloc);
+    struct stats_header header;
+    void *new_ptr;
+
+    if (new_size == 0) {
+        sa_deallocate(alloc, ptr);
+        *usable_size = 0;
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return sa_allocate_at_least(alloc, new_size, new_align, usable_size);
+    }
+
+    header = *header_of(ptr);
+    if likely(new_align <= header.offset) {
+        /* The backing allocator keeps the block aligned on the offset, so the header does not have to move */
+        size_t raw_size;
+        /* The block may be given back (and handed out to another thread) during the call */
+        uint64_t old_seq = sa->trace != NULL ? trace_seq(sa) : 0;
+        char *raw = allocator_reallocate_at_least(
+            sa->backing,
+            (char *)ptr - header.offset,
+            header.offset + header.size,
+            header.offset + new_size,
+            header.offset,
+            &raw_size
+        );
+
+        new_ptr = block_init(raw, header.offset, raw_size - header.offset);
+        *usable_size = new_ptr != NULL ? raw_size - header.offset : 0;
+        if likely(new_ptr != NULL) {
+            account(sa, ALLOC_TRACE_REALLOCATE, new_ptr, *usable_size, ptr, header.size, new_align, old_seq);
+        }
+    } else {
+        new_ptr = sa_allocate_at_least(alloc, new_size, new_align, usable_size);
+        if unlikely(new_ptr == NULL) {
+            return NULL;
+        }
+        memcpy(new_ptr, ptr, MIN(old_size, new_size));
+        sa_deallocate(alloc, ptr);
+    }
+    return new_ptr;
+}
+
+static void *sa_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    size_t usable_size;
+
+    return sa_reallocate_at_least(alloc, ptr, old_size, new_size, new_align, &usable_size);
+}
+
+static size_t sa_trim(memory_allocator_handle_t alloc)
+{
+    return allocator_trim(sa_of(alloc)->backing);
+}
+
+int stats_allocator_init(stats_allocator_t *sa, memory_allocator_handle_t backing, FILE *trace)
+{
+    sa->base = (struct memory_allocator){
+        .allocate = &sa_allocate,
+        .zero_allocate = &sa_zero_allocate,
+        .deallocate = &sa_deallocate,
+        .reallocate = &sa_reallocate,
+        .sized_deallocate = &sa_sized_deallocate,
+        .allocate_at_least = &sa_allocate_at_least,
+        .reallocate_at_least = &sa_reallocate_at_least,
+        .trim = &sa_trim,
+    };
+    sa->backing = backing;
+    list_init(&sa->threads);
+    memset(&sa->retired, 0, sizeof(sa->retired));
+    sa->next_thread_id = 0;
+    atomic_init(&sa->live_bytes, 0);
+    atomic_init(&sa->peak_bytes, 0);
+    sa->trace = trace;
+    atomic_init(&sa->trace_seq, 0);
+    if (trace != NULL && fwrite(ALLOC_TRACE_MAGIC, 1, ALLOC_TRACE_MAGIC_SIZE, trace) != ALLOC_TRACE_MAGIC_SIZE) {
+        return -1;
+    }
+    if (pthread_key_create(&sa->key, &thread_destroy) != 0) {
+        return -1;
+    }
+    pthread_mutex_init(&sa->lock, NULL);
+    pthread_mutex_init(&sa->trace_lock, NULL);
+    return 0;
+}
+
+void stats_allocator_read(stats_allocator_t *sa, struct allocator_stats *stats)
+{
+    int64_t pending = 0;
+
+    pthread_mutex_lock(&sa->lock);
+    *stats = sa->retired;
+    list_for_each_element(&sa->threads, st, stats_thread_t, node) {
+        for (size_t i = 0; i < ALLOC_TRACE_OP_COUNT; ++i) {
+            stats->counts[i] += atomic_load_explicit(&st->counts[i], memory_order_relaxed);
+            stats->bytes[i] += atomic_load_explicit(&st->bytes[i], memory_order_relaxed);
+        }
+        for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i) {
+            stats->histogram[i] += atomic_load_explicit(&st->histogram[i], memory_order_relaxed);
+        }
+        pending += atomic_load_explicit(&st->live_delta, memory_order_relaxed);
+    }
+    stats->live_bytes = atomic_load_explicit(&sa->live_bytes, memory_order_relaxed) + pending;
+    stats->peak_bytes = MAX(atomic_load_explicit(&sa->peak_bytes, memory_order_relaxed), stats->live_bytes);
+    pthread_mutex_unlock(&sa->lock);
+}
+
+void stats_allocator_flush_trace(stats_allocator_t *sa)
+{
+    stats_thread_t *st = pthread_getspecific(sa->key);
+
+    if (st != NULL && sa->trace != NULL) {
+        trace_flush(st);
+        pthread_mutex_lock(&sa->trace_lock);
+        fflush(sa->trace);
+        pthread_mutex_unlock(&sa->trace_lock);
+    }
+}
+
+void stats_allocator_destroy(stats_allocator_t *sa)
+{
+    pthread_key_delete(sa->key);
+    while (!list_is_empty(&sa->threads)) {
+        thread_retire_locked(list_element(sa->threads.head, stats_thread_t, node));
+    }
+    if (sa->trace != NULL) {
+        fflush(sa->trace);
+    }
+    pthread_mutex_destroy(&sa->trace_lock);
+    pthread_mutex_destroy(&sa->lock);
+}
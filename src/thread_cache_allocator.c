@@ -0,0 +1,375 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <ceeds/thread_cache_allocator.h>
+
+#define tca_of(alloc)           container_of(alloc, thread_cache_allocator_t, base)
+
+#define HEADER_SIZE             alignof(max_align_t)
+#define LARGE_CLASS             ((uint32_t)-1)
+
+static_assert(THREAD_CACHE_MAX_SIZE <= SIZE_CLASS_MAX_SMALL_SIZE, "cached sizes must map to size classes");
+
+/**
+ * Header stored right before every block, telling where the block comes from
+ */
+struct block_header
+{
+    uint32_t class_index;
+    uint32_t offset;
+};
+
+struct cached_block
+{
+    struct cached_block *next;
+};
+
+struct thread_cache_bin
+{
+    struct cached_block *head;
+    size_t count;
+};
+
+struct thread_cache
+{
+    list_node_t node;
+    thread_cache_allocator_t *owner;
+    struct thread_cache_bin bins[THREAD_CACHE_CLASS_COUNT];
+};
+
+static inline struct block_header *header_of(void *ptr)
+{
+    return (struct block_header *)ptr - 1;
+}
+
+/**
+ * Give @p count blocks from a bin back to the backing allocator
+ *
+ * @pre                             the lock of @p tca must be held
+ */
+static void bin_release_locked(thread_cache_allocator_t *tca, struct thread_cache_bin *bin, size_t count)
+{
+    while (count-- > 0 && bin->head != NULL) {
+        struct cached_block *block = bin->head;
+
+        bin->head = block->next;
+        bin->count -= 1;
+        allocator_delete(tca->backing, (char *)block - HEADER_SIZE);
+    }
+}
+
+/**
+ * Give every block of a cache back to the backing allocator
+ *
+ * @return                          the amount of bytes given back
+ */
+static size_t thread_cache_release_locked(struct thread_cache *tc)
+{
+    size_t released = 0;
+
+    for (uint32_t i = 0; i < THREAD_CACHE_CLASS_COUNT; ++i) {
+        released += tc->bins[i].count * (HEADER_SIZE + size_class_size(i));
+        bin_release_locked(tc->owner, &tc->bins[i], tc->bins[i].count);
+    }
+    return released;
+}
+
+static void thread_cache_destroy(void *data)
+{
+    struct thread_cache *tc = data;
+    thread_cache_allocator_t *tca = tc->owner;
+
+    pthread_mutex_lock(&tca->lock);
+    thread_cache_release_locked(tc);
+    list_node_remove(&tc->node);
+    allocator_delete(tca->backing, tc);
+    pthread_mutex_unlock(&tca->lock);
+}
+
+static struct thread_cache *thread_cache_create(thread_cache_allocator_t *tca)
+{
+    struct thread_cache *tc;
+
+    pthread_mutex_lock(&tca->lock);
+    tc = allocator_znew(tca->backing, struct thread_cache);
+    if likely(tc != NULL) {
+        tc->owner = tca;
+        list_push_back(&tca->caches, &tc->node);
+    }
+    pthread_mutex_unlock(&tca->lock);
+    if unlikely(tc != NULL && pthread_setspecific(tca->key, tc) != 0) {
+        thread_cache_destroy(tc);
+        tc = NULL;
+    }
+    return tc;
+}
+
+static inline struct thread_cache *thread_cache_get(thread_cache_allocator_t *tca)
+{
+    struct thread_cache *tc = pthread_getspecific(tca->key);
+
+    if unlikely(tc == NULL) {
+        tc = thread_cache_create(tca);
+    }
+    return tc;
+}
+
+/**
+ * Fill an empty bin with a batch of blocks from the backing allocator
+ */
+static bool bin_refill(thread_cache_allocator_t *tca, struct thread_cache_bin *bin, uint32_t index)
+{
+    size_t size = HEADER_SIZE + size_class_size(index);
+
+    pthread_mutex_lock(&tca->lock);
+    for (size_t i = 0; i < THREAD_CACHE_BATCH_SIZE; ++i) {
+        char *raw = tca->backing->allocate(tca->backing, size, HEADER_SIZE);
+        struct cached_block *block;
+
+        if unlikely(raw == NULL) {
+            break;
+        }
+        block = (struct cached_block *)(raw + HEADER_SIZE);
+        header_of(block)->class_index = index;
+        header_of(block)->offset = HEADER_SIZE;
+        block->next = bin->head;
+        bin->head = block;
+        bin->count += 1;
+    }
+    pthread_mutex_unlock(&tca->lock);
+    return bin->head != NULL;
+}
+
+static void *tca_allocate_large(thread_cache_allocator_t *tca, size_t size, size_t align)
+{
+    size_t offset = MAX(align, HEADER_SIZE);
+    char *raw;
+
+    pthread_mutex_lock(&tca->lock);
+    raw = tca->backing->allocate(tca->backing, offset + size, offset);
+    pthread_mutex_unlock(&tca->lock);
+    if unlikely(raw == NULL) {
+        return NULL;
+    }
+    header_of(raw + offset)->class_index = LARGE_CLASS;
+    header_of(raw + offset)->offset = (uint32_t)offset;
+    return raw + offset;
+}
+
+static void *tca_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    thread_cache_allocator_t *tca = tca_of(alloc);
+
+    if likely(size <= THREAD_CACHE_MAX_SIZE && align <= HEADER_SIZE) {
+        uint32_t index = size_class_index(size);
+        struct thread_cache *tc = thread_cache_get(tca);
+        struct thread_cache_bin *bin;
+        struct cached_block *block;
+
+        if unlikely(tc == NULL) {
+            return NULL;
+        }
+        bin = &tc->bins[index];
+        if unlikely(bin->head == NULL && !bin_refill(tca, bin, index)) {
+            return NULL;
+        }
+        block = bin->head;
+        bin->head = block->next;
+        bin->count -= 1;
+        return block;
+    }
+    return tca_allocate_large(tca, size, align);
+}
+
+static void *tca_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    void *ptr = tca_allocate(alloc, size, align);
+
+    if likely(ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void tca_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    thread_cache_allocator_t *tca = tca_of(alloc);
+    struct block_header *header;
+    struct thread_cache *tc;
+    struct thread_cache_bin *bin;
+    struct cached_block *block = ptr;
+
+    if (ptr == NULL) {
+        return;
+    }
+    header = header_of(ptr);
+    if unlikely(header->class_index == LARGE_CLASS || (tc = thread_cache_get(tca)) == NULL) {
+        pthread_mutex_lock(&tca->lock);
+        allocator_delete(tca->backing, (char *)ptr - header->offset);
+        pthread_mutex_unlock(&tca->lock);
+        return;
+    }
+    bin = &tc->bins[header->class_index];
+    block->next = bin->head;
+    bin->head = block;
+    bin->count += 1;
+    if unlikely(bin->count > THREAD_CACHE_BIN_CAPACITY) {
+        pthread_mutex_lock(&tca->lock);
+        bin_release_locked(tca, bin, THREAD_CACHE_BATCH_SIZE);
+        pthread_mutex_unlock(&tca->lock);
+    }
+}
+
+/**
+ * Get the amount of bytes usable at a given pointer, or 0 if it is not known
+ */
+static size_t tca_usable_size(void *ptr)
+{
+    struct block_header *header = header_of(ptr);
+
+    if (header->class_index == LARGE_CLASS) {
+        return 0;
+    }
+    return size_class_size(header->class_index);
+}
+
+static void *tca_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    thread_cache_allocator_t *tca = tca_of(alloc);
+    struct block_header *header;
+    void *new_ptr;
+
+    if (new_size == 0) {
+        tca_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return tca_allocate(alloc, new_size, new_align);
+    }
+
+    header = header_of(ptr);
+    if (new_size <= tca_usable_size(ptr) && new_align <= HEADER_SIZE) {
+        return ptr;
+    }
+
+    /* Large blocks can be resized by the backing allocator, as long as the header does not have to move */
+    if (header->class_index == LARGE_CLASS && new_size > THREAD_CACHE_MAX_SIZE && new_align <= header->offset) {
+        size_t offset = header->offset;
+        char *raw;
+
+        pthread_mutex_lock(&tca->lock);
+        raw = tca->backing->reallocate(
+            tca->backing,
+            (char *)ptr - offset,
+            offset + old_size,
+            offset + new_size,
+            offset
+        );
+        pthread_mutex_unlock(&tca->lock);
+        return raw == NULL ? NULL : raw + offset;
+    }
+
+    new_ptr = tca_allocate(alloc, new_size, new_align);
+    if likely(new_ptr != NULL) {
+        if (old_size > 0) {
+            memcpy(new_ptr, ptr, MIN(old_size, new_size));
+        }
+        tca_deallocate(alloc, ptr);
+    }
+    return new_ptr;
+}
+
+static void *tca_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    void *ptr = tca_allocate(alloc, size, align);
+
+    *usable_size = ptr != NULL ? MAX(size, tca_usable_size(ptr)) : 0;
+    return ptr;
+}
+
+static void *tca_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    ptr = tca_reallocate(alloc, ptr, old_size, new_size, new_align);
+    *usable_size = ptr != NULL ? MAX(new_size, tca_usable_size(ptr)) : 0;
+    return ptr;
+}
+
+static size_t tca_trim(memory_allocator_handle_t alloc)
+{
+    thread_cache_allocator_t *tca = tca_of(alloc);
+    struct thread_cache *tc = pthread_getspecific(tca->key);
+    size_t released = 0;
+
+    /* Only the cache of the calling thread can be flushed, the others are only ever touched by their owner */
+    pthread_mutex_lock(&tca->lock);
+    if (tc != NULL) {
+        released = thread_cache_release_locked(tc);
+    }
+    released += allocator_trim(tca->backing);
+    pthread_mutex_unlock(&tca->lock);
+    return released;
+}
+
+int thread_cache_allocator_init(thread_cache_allocator_t *tca, memory_allocator_handle_t backing)
+{
+    tca->base = (struct memory_allocator){
+        .allocate = &tca_allocate,
+        .zero_allocate = &tca_zero_allocate,
+        .deallocate = &tca_deallocate,
+        .reallocate = &tca_reallocate,
+        .allocate_at_least = &tca_allocate_at_least,
+        .reallocate_at_least = &tca_reallocate_at_least,
+        .trim = &tca_trim,
+    };
+    tca->backing = backing;
+    list_init(&tca->caches);
+    if (pthread_key_create(&tca->key, &thread_cache_destroy) != 0) {
+        return -1;
+    }
+    pthread_mutex_init(&tca->lock, NULL);
+    return 0;
+}
+
+void thread_cache_allocator_flush(thread_cache_allocator_t *tca)
+{
+    struct thread_cache *tc = pthread_getspecific(tca->key);
+
+    if (tc != NULL) {
+        pthread_mutex_lock(&tca->lock);
+        thread_cache_release_locked(tc);
+        pthread_mutex_unlock(&tca->lock);
+    }
+}
+
+void thread_cache_allocator_destroy(thread_cache_allocator_t *tca)
+{
+    pthread_key_delete(tca->key);
+    while (!list_is_empty(&tca->caches)) {
+        struct thread_cache *tc = list_element(tca->caches.head, struct thread_cache, node);
+
+        thread_cache_release_locked(tc);
+        list_node_remove(&tc->node);
+        allocator_delete(tca->backing, tc);
+    }
+    pthread_mutex_destroy(&tca->lock);
+}
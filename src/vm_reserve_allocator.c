@@ -0,0 +1,158 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <ceeds/vm_reserve_allocator.h>
+
+#define vra_of(alloc)           container_of(alloc, vm_reserve_allocator_t, base)
+
+/**
+ * Header stored right before every block, telling how much of its reservation is accessible
+ */
+struct vm_reserve_header
+{
+    size_t committed;
+    size_t offset;
+};
+
+static size_t page_size(void)
+{
+    static size_t size;
+
+    if unlikely(size == 0) {
+        size = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    return size;
+}
+
+static inline size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static inline struct vm_reserve_header *header_of(void *ptr)
+{
+    return (struct vm_reserve_header *)ptr - 1;
+}
+
+static void *vra_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    vm_reserve_allocator_t *vra = vra_of(alloc);
+    size_t offset = align_up(sizeof(struct vm_reserve_header), MAX(align, alignof(struct vm_reserve_header)));
+    size_t committed = align_up(offset + size, page_size());
+    char *base;
+
+    assert(align <= page_size());
+    if unlikely(committed > vra->reserve_size) {
+        return NULL;
+    }
+    base = mmap(NULL, vra->reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if unlikely(base == MAP_FAILED) {
+        return NULL;
+    }
+    if unlikely(mprotect(base, committed, PROT_READ | PROT_WRITE) != 0) {
+        munmap(base, vra->reserve_size);
+        return NULL;
+    }
+    header_of(base + offset)->committed = committed;
+    header_of(base + offset)->offset = offset;
+    return base + offset;
+}
+
+static void *vra_zero_allocate(memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    /* Fresh anonymous mappings are already zeroed */
+    return vra_allocate(alloc, size, align);
+}
+
+static void vra_deallocate(memory_allocator_handle_t alloc, void *ptr)
+{
+    if (ptr != NULL) {
+        munmap((char *)ptr - header_of(ptr)->offset, vra_of(alloc)->reserve_size);
+    }
+}
+
+static void *vra_reallocate(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    _unused_ size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    vm_reserve_allocator_t *vra = vra_of(alloc);
+    struct vm_reserve_header *header;
+    size_t committed;
+    char *base;
+
+    if (new_size == 0) {
+        vra_deallocate(alloc, ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return vra_allocate(alloc, new_size, new_align);
+    }
+
+    assert(is_aligned_ptr(ptr, new_align));
+    header = header_of(ptr);
+    base = (char *)ptr - header->offset;
+    committed = align_up(header->offset + new_size, page_size());
+    if (committed > header->committed) {
+        if unlikely(committed > vra->reserve_size) {
+            return NULL;
+        }
+        if unlikely(mprotect(base + header->committed, committed - header->committed, PROT_READ | PROT_WRITE) != 0) {
+            return NULL;
+        }
+        header->committed = committed;
+    } else if (committed < header->committed) {
+        /* Give the pages back, but keep the address range reserved */
+        madvise(base + committed, header->committed - committed, MADV_DONTNEED);
+        mprotect(base + committed, header->committed - committed, PROT_NONE);
+        header->committed = committed;
+    }
+    return ptr;
+}
+
+static void *vra_allocate_at_least(
+    memory_allocator_handle_t alloc,
+    size_t size,
+    size_t align,
+    size_t *usable_size
+)
+{
+    void *ptr = vra_allocate(alloc, size, align);
+
+    *usable_size = ptr != NULL ? header_of(ptr)->committed - header_of(ptr)->offset : 0;
+    return ptr;
+}
+
+static void *vra_reallocate_at_least(
+    memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align,
+    size_t *usable_size
+)
+{
+    ptr = vra_reallocate(alloc, ptr, old_size, new_size, new_align);
+    *usable_size = ptr != NULL ? header_of(ptr)->committed - header_of(ptr)->offset : 0;
+    return ptr;
+}
+
+void vm_reserve_allocator_init(vm_reserve_allocator_t *vra, size_t reserve_size)
+{
+    vra->base = (struct memory_allocator){
+        .allocate = &vra_allocate,
+        .zero_allocate = &vra_zero_allocate,
+        .deallocate = &vra_deallocate,
+        .reallocate = &vra_reallocate,
+        .allocate_at_least = &vra_allocate_at_least,
+        .reallocate_at_least = &vra_reallocate_at_least,
+    };
+    vra->reserve_size = align_up(reserve_size, page_size());
+}
@@ -0,0 +1,154 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/arena_allocator.h>
+#include <ceeds/growing_str.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(arena_int, int);
+
+ut_test(allocate)
+{
+    arena_allocator_t arena;
+    memory_allocator_handle_t handle = arena_allocator_handle(&arena);
+
+    arena_allocator_init(&arena, heap_allocator_handle(), 128);
+
+    int *a = allocator_new(handle, int);
+    int *b = allocator_new(handle, int);
+    ut_assert_ne(a, NULL);
+    ut_assert_ne(b, NULL);
+    ut_assert_ne(a, b);
+    *a = 1;
+    *b = 2;
+    ut_assert_eq(*a, 1);
+    ut_assert_eq(*b, 2);
+
+    long double *c = allocator_aligned_new(handle, long double, 64);
+    ut_assert(is_aligned_ptr(c, 64));
+
+    char *zeroed = allocator_znew_array(handle, char, 100);
+    for (size_t i = 0; i < 100; ++i) {
+        ut_assert_eq(zeroed[i], 0);
+    }
+
+    /* Bigger than a block */
+    char *big = allocator_new_array(handle, char, 1000);
+    ut_assert_ne(big, NULL);
+    memset(big, 'x', 1000);
+
+    arena_allocator_destroy(&arena);
+}
+
+ut_test(reallocate_in_place)
+{
+    arena_allocator_t arena;
+    memory_allocator_handle_t handle = arena_allocator_handle(&arena);
+
+    arena_allocator_init(&arena, heap_allocator_handle(), 256);
+
+    int *arr = allocator_new_array(handle, int, 4);
+    int *grown = allocator_resize_array(handle, arr, int, 4, 16);
+    ut_assert_eq(arr, grown);
+
+    int *other = allocator_new(handle, int);
+    int *moved;
+    for (int i = 0; i < 16; ++i) {
+        grown[i] = i;
+    }
+    moved = allocator_resize_array(handle, grown, int, 16, 32);
+    ut_assert_ne(moved, grown);
+    ut_assert_ne(moved, other);
+    for (int i = 0; i < 16; ++i) {
+        ut_assert_eq(moved[i], i);
+    }
+
+    arena_allocator_destroy(&arena);
+}
+
+ut_test(mark_rewind)
+{
+    arena_allocator_t arena;
+    memory_allocator_handle_t handle = arena_allocator_handle(&arena);
+    arena_mark_t mark;
+
+    arena_allocator_init(&arena, heap_allocator_handle(), 64);
+
+    int *first = allocator_new(handle, int);
+    mark = arena_allocator_mark(&arena);
+    int *second = allocator_new(handle, int);
+    for (int i = 0; i < 100; ++i) {
+        allocator_new_array(handle, char, 32);
+    }
+    arena_allocator_rewind(&arena, mark);
+    int *third = allocator_new(handle, int);
+    ut_assert_ne(first, third);
+    ut_assert_eq(second, third);
+
+    arena_allocator_reset(&arena);
+    ut_assert_eq(arena.block, NULL);
+    ut_assert_ne(arena.spare, NULL);
+
+    /* Trimming gives the spare blocks back */
+    ut_assert_ge(allocator_trim(handle), 50 * 64);
+    ut_assert_eq(arena.spare, NULL);
+
+    arena_allocator_destroy(&arena);
+}
+
+ut_test(containers)
+{
+    arena_allocator_t arena;
+    arena_allocator_init(&arena, heap_allocator_handle(), 4096);
+
+    for (int round = 0; round < 3; ++round) {
+        vector_t(arena_int) vec = vector_empty(arena_allocator_handle(&arena));
+        growing_str_t gs = gs_empty(arena_allocator_handle(&arena));
+
+        for (int i = 0; i < 1000; ++i) {
+            vector_push_back(&vec, i);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            ut_assert_eq(vec.data[i], i);
+        }
+        gs_append_formatted(&gs, "%s %d", "round", round);
+        ut_assert_streq(gs.str, round == 0 ? "round 0" : round == 1 ? "round 1" : "round 2");
+
+        vector_destroy(&vec);
+        gs_destroy(&gs);
+        arena_allocator_reset(&arena);
+    }
+
+    arena_allocator_destroy(&arena);
+}
+
+ut_test(fixed_buffer)
+{
+    alignas(max_align_t) char buffer[256];
+    arena_allocator_t arena;
+    memory_allocator_handle_t handle = arena_allocator_handle(&arena);
+
+    arena_allocator_init_with_buffer(&arena, buffer, sizeof(buffer));
+
+    char *a = allocator_new_array(handle, char, 100);
+    ut_assert(a >= buffer && a + 100 <= buffer + sizeof(buffer));
+    ut_assert_eq(allocator_new_array(handle, char, 1000), NULL);
+    char *b = allocator_new_array(handle, char, 100);
+    ut_assert(b >= buffer && b + 100 <= buffer + sizeof(buffer));
+    ut_assert_eq(allocator_new_array(handle, char, 100), NULL);
+
+    arena_allocator_reset(&arena);
+    ut_assert_eq(allocator_new_array(handle, char, 100), a);
+
+    arena_allocator_destroy(&arena);
+}
+
+ut_group(arena_allocator,
+         ut_get_test(allocate),
+         ut_get_test(reallocate_in_place),
+         ut_get_test(mark_rewind),
+         ut_get_test(containers),
+         ut_get_test(fixed_buffer),
+);
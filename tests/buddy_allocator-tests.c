@@ -0,0 +1,144 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/buddy_allocator.h>
+#include <ceeds/hash_map.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(buddy_int, int);
+
+#define buddy_hash_int(i)   fnv_one64((const char *)&i, sizeof(i))
+
+MAKE_HASH_MAP_TYPE(buddy_int, int, int, buddy_hash_int, CMP);
+
+ut_test(split_coalesce)
+{
+    buddy_allocator_t ba;
+    memory_allocator_handle_t handle = buddy_allocator_handle(&ba);
+    struct buddy_stats stats;
+    char *blocks[16];
+
+    ut_assert_eq(buddy_allocator_init(&ba, heap_allocator_handle(), 1024, 64), 0);
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.total_bytes, 1024);
+    ut_assert_eq(stats.free_bytes, 1024);
+    ut_assert_eq(stats.largest_free_block, 1024);
+
+    for (size_t i = 0; i < 16; ++i) {
+        blocks[i] = allocator_new_array(handle, char, 50);
+        ut_assert_ne(blocks[i], NULL);
+        ut_assert(is_aligned_ptr(blocks[i], 64));
+    }
+    ut_assert_eq(allocator_new(handle, char), NULL);
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.allocated_bytes, 1024);
+    ut_assert_eq(stats.free_bytes, 0);
+
+    /* Free every other block: plenty of free memory, but no block bigger than 64 bytes */
+    for (size_t i = 0; i < 16; i += 2) {
+        allocator_delete(handle, blocks[i]);
+    }
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.free_bytes, 512);
+    ut_assert_eq(stats.free_blocks, 8);
+    ut_assert_eq(stats.largest_free_block, 64);
+    ut_assert_gt(stats.fragmentation, 0.8);
+    ut_assert_eq(allocator_new_array(handle, char, 100), NULL);
+
+    /* Freeing the rest merges everything back into a single block */
+    for (size_t i = 1; i < 16; i += 2) {
+        allocator_delete(handle, blocks[i]);
+    }
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.free_bytes, 1024);
+    ut_assert_eq(stats.free_blocks, 1);
+    ut_assert_eq(stats.fragmentation, 0);
+    ut_assert_ne(allocator_new_array(handle, char, 1024), NULL);
+
+    buddy_allocator_destroy(&ba);
+}
+
+ut_test(reallocate_in_place)
+{
+    buddy_allocator_t ba;
+    memory_allocator_handle_t handle = buddy_allocator_handle(&ba);
+    struct buddy_stats stats;
+    size_t usable;
+
+    ut_assert_eq(buddy_allocator_init(&ba, heap_allocator_handle(), 4096, 64), 0);
+
+    char *a = allocator_allocate_at_least(handle, 40, 1, &usable);
+    ut_assert_eq(usable, 64);
+    memset(a, 'a', 64);
+
+    /* The buddies following a are free: it grows in place */
+    char *grown = allocator_resize_array(handle, a, char, 64, 1000);
+    ut_assert_eq(grown, a);
+    ut_assert_eq(grown[63], 'a');
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.allocated_bytes, 1024);
+
+    /* Shrinking gives the upper halves back */
+    char *shrunk = allocator_resize_array(handle, grown, char, 1000, 100);
+    ut_assert_eq(shrunk, a);
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.allocated_bytes, 128);
+
+    /* Now the buddy of a is taken, so it has to move */
+    char *b = allocator_new_array(handle, char, 128);
+    ut_assert_eq(b, a + 128);
+    char *moved = allocator_resize_array(handle, shrunk, char, 100, 200);
+    ut_assert_ne(moved, a);
+    ut_assert_eq(moved[63], 'a');
+
+    allocator_delete(handle, moved);
+    allocator_delete(handle, b);
+    buddy_allocator_stats(&ba, &stats);
+    ut_assert_eq(stats.free_bytes, 4096);
+    ut_assert_eq(stats.free_blocks, 1);
+
+    buddy_allocator_destroy(&ba);
+}
+
+ut_test(containers)
+{
+    buddy_allocator_t ba;
+    struct buddy_stats stats;
+    vector_t(buddy_int) vec;
+    hash_map_t(buddy_int) hm;
+
+    ut_assert_eq(buddy_allocator_init(&ba, heap_allocator_handle(), 1 << 20, 16), 0);
+    vec = (vector_t(buddy_int))vector_empty(buddy_allocator_handle(&ba));
+    hm = (hash_map_t(buddy_int))hash_map_empty(buddy_allocator_handle(&ba));
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 10000; ++i) {
+            vector_push_back(&vec, i);
+            hash_map_insert(buddy_int, &hm, i, i * 2);
+        }
+        for (int i = 0; i < 10000; ++i) {
+            size_t pos = hash_map_find(buddy_int, &hm, i);
+
+            ut_assert_eq(vec.data[i], i);
+            ut_assert_ne(pos, hash_map_npos);
+            ut_assert_eq(hm.values[pos], i * 2);
+        }
+        vector_destroy(&vec);
+        hash_map_destroy(buddy_int, &hm);
+        vec = (vector_t(buddy_int))vector_empty(buddy_allocator_handle(&ba));
+        hm = (hash_map_t(buddy_int))hash_map_empty(buddy_allocator_handle(&ba));
+
+        /* Growing and shrinking containers leave nothing behind */
+        buddy_allocator_stats(&ba, &stats);
+        ut_assert_eq(stats.free_bytes, stats.total_bytes);
+        ut_assert_eq(stats.free_blocks, 1);
+    }
+    buddy_allocator_destroy(&ba);
+}
+
+ut_group(buddy_allocator,
+         ut_get_test(split_coalesce),
+         ut_get_test(reallocate_in_place),
+         ut_get_test(containers),
+);
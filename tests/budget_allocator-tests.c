@@ -0,0 +1,128 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/arena_allocator.h>
+#include <ceeds/budget_allocator.h>
+#include <ceeds/size_class_allocator.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(budget_int, int);
+
+ut_test(budget)
+{
+    budget_allocator_t ba;
+    memory_allocator_handle_t handle = budget_allocator_handle(&ba);
+
+    budget_allocator_init(&ba, 1000, (memory_allocator_handle_t[]){heap_allocator_handle()}, 1);
+
+    char *a = allocator_new_array(handle, char, 600);
+    ut_assert_ne(a, NULL);
+    ut_assert_eq(budget_allocator_used(&ba), 600);
+    ut_assert_eq(allocator_new_array(handle, char, 600), NULL);
+    ut_assert_eq(budget_allocator_used(&ba), 600);
+
+    char *b = allocator_znew_array(handle, char, 400);
+    ut_assert_ne(b, NULL);
+    ut_assert_eq(b[399], 0);
+    ut_assert_eq(budget_allocator_remaining(&ba), 0);
+    ut_assert_eq(allocator_new(handle, char), NULL);
+
+    allocator_delete(handle, a);
+    ut_assert_eq(budget_allocator_used(&ba), 400);
+    ut_assert_eq(allocator_resize_array(handle, b, char, 400, 1001), NULL);
+    b = allocator_resize_array(handle, b, char, 400, 1000);
+    ut_assert_ne(b, NULL);
+    ut_assert_eq(budget_allocator_used(&ba), 1000);
+    allocator_delete(handle, b);
+    ut_assert_eq(budget_allocator_used(&ba), 0);
+}
+
+ut_test(fallback_chain)
+{
+    alignas(max_align_t) char buffer[512];
+    arena_allocator_t stack_arena;
+    budget_allocator_t ba;
+    memory_allocator_handle_t handle = budget_allocator_handle(&ba);
+
+    arena_allocator_init_with_buffer(&stack_arena, buffer, sizeof(buffer));
+    budget_allocator_init(&ba, 4096, (memory_allocator_handle_t[]){
+        arena_allocator_handle(&stack_arena),
+        heap_allocator_handle(),
+    }, 2);
+
+#define in_buffer(p)    ((char *)(p) >= buffer && (char *)(p) < buffer + sizeof(buffer))
+
+    int *small = allocator_new_array(handle, int, 16);
+    ut_assert(in_buffer(small));
+    for (int i = 0; i < 16; ++i) {
+        small[i] = i;
+    }
+    int *big = allocator_new_array(handle, int, 256);
+    ut_assert(!in_buffer(big));
+
+    /* Growing past the buffer moves the block to the heap */
+    small = allocator_resize_array(handle, small, int, 16, 200);
+    ut_assert(!in_buffer(small));
+    for (int i = 0; i < 16; ++i) {
+        ut_assert_eq(small[i], i);
+    }
+    ut_assert_eq(budget_allocator_used(&ba), 456 * sizeof(int));
+    ut_assert_eq(allocator_new_array(handle, int, 1000), NULL);
+
+    allocator_delete(handle, small);
+    allocator_delete(handle, big);
+    ut_assert_eq(budget_allocator_used(&ba), 0);
+
+#undef in_buffer
+
+    arena_allocator_destroy(&stack_arena);
+}
+
+ut_test(at_least)
+{
+    size_class_allocator_t sca;
+    budget_allocator_t ba;
+    memory_allocator_handle_t handle = budget_allocator_handle(&ba);
+    size_t usable;
+
+    size_class_allocator_init(&sca);
+    budget_allocator_init(&ba, 75, (memory_allocator_handle_t[]){size_class_allocator_handle(&sca)}, 1);
+
+    /* The size class has room for more, but the budget does not */
+    void *ptr = allocator_allocate_at_least(handle, 70, 1, &usable);
+    ut_assert_ne(ptr, NULL);
+    ut_assert_eq(usable, 75);
+    ut_assert_eq(budget_allocator_remaining(&ba), 0);
+    allocator_sized_deallocate(handle, ptr, usable);
+    ut_assert_eq(budget_allocator_used(&ba), 0);
+
+    size_class_allocator_destroy(&sca);
+}
+
+ut_test(containers)
+{
+    budget_allocator_t ba;
+    vector_t(budget_int) vec;
+
+    budget_allocator_init(&ba, 1024 * sizeof(int), (memory_allocator_handle_t[]){heap_allocator_handle()}, 1);
+    vec = (vector_t(budget_int))vector_empty(budget_allocator_handle(&ba));
+    for (int i = 0; i < 1024; ++i) {
+        vector_push_back(&vec, i);
+    }
+    ut_assert_eq(budget_allocator_used(&ba), vec.capacity * sizeof(int));
+    ut_assert_eq(allocator_resize_array(budget_allocator_handle(&ba), vec.data, int, vec.capacity, 2048), NULL);
+    for (int i = 0; i < 1024; ++i) {
+        ut_assert_eq(vec.data[i], i);
+    }
+    vector_destroy(&vec);
+    ut_assert_eq(budget_allocator_used(&ba), 0);
+}
+
+ut_group(budget_allocator,
+         ut_get_test(budget),
+         ut_get_test(fallback_chain),
+         ut_get_test(at_least),
+         ut_get_test(containers),
+);
@@ -0,0 +1,159 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <stdatomic.h>
+#include "unit_tests.h"
+#include <ceeds/concurrent_hash_map.h>
+
+#define chm_hash_int(i)         fnv_one64((const char *)&(i), sizeof(i))
+
+MAKE_CONCURRENT_HASH_MAP_TYPE(chm_int, int, long, chm_hash_int, CMP);
+
+static void chm_increment(long *value, bool inserted, void *ctx)
+{
+    (void)inserted;
+    *value += *(const long *)ctx;
+}
+
+static void chm_sum(int const *key, long const *value, void *ctx)
+{
+    long *sums = ctx;
+
+    sums[0] += *key;
+    sums[1] += *value;
+}
+
+ut_test(basics)
+{
+    concurrent_hash_map_t(chm_int) chm;
+    long value = 0;
+    long one = 1;
+    long sums[2] = {0, 0};
+
+    ut_assert_eq(concurrent_hash_map_init(chm_int, &chm, heap_allocator_handle(), 5), 0);
+    ut_assert_eq(concurrent_hash_map_shard_count(&chm), 8);
+    ut_assert(is_aligned_ptr(chm.shards, CONCURRENT_HASH_MAP_SHARD_ALIGN));
+    ut_assert(!concurrent_hash_map_find(chm_int, &chm, 1, &value));
+
+    for (int i = 0; i < 1000; ++i) {
+        ut_assert(concurrent_hash_map_upsert(chm_int, &chm, i, -i));
+    }
+    ut_assert(!concurrent_hash_map_upsert(chm_int, &chm, 42, 42));
+    ut_assert_eq(concurrent_hash_map_size(chm_int, &chm), 1000);
+    ut_assert(concurrent_hash_map_find(chm_int, &chm, 42, &value));
+    ut_assert_eq(value, 42);
+    ut_assert(concurrent_hash_map_find(chm_int, &chm, 43, NULL));
+
+    /* Keys are spread over all the shards */
+    for (size_t i = 0; i < concurrent_hash_map_shard_count(&chm); ++i) {
+        ut_assert_gt(hash_map_size(&chm.shards[i].map), 1000 / 16);
+    }
+
+    ut_assert(!concurrent_hash_map_update(chm_int, &chm, 42, &chm_increment, &one));
+    ut_assert(concurrent_hash_map_update(chm_int, &chm, 1000, &chm_increment, &one));
+    ut_assert(concurrent_hash_map_find(chm_int, &chm, 42, &value));
+    ut_assert_eq(value, 43);
+    ut_assert(concurrent_hash_map_find(chm_int, &chm, 1000, &value));
+    ut_assert_eq(value, 1);
+
+    ut_assert(concurrent_hash_map_erase(chm_int, &chm, 1000));
+    ut_assert(!concurrent_hash_map_erase(chm_int, &chm, 1000));
+    ut_assert(!concurrent_hash_map_find(chm_int, &chm, 1000, NULL));
+
+    /* Keys 0..999, values -i except for 42 which is now 43 */
+    concurrent_hash_map_visit(chm_int, &chm, &chm_sum, sums);
+    ut_assert_eq(sums[0], 999 * 1000 / 2);
+    ut_assert_eq(sums[1], -(999 * 1000 / 2) + 42 + 43);
+
+    concurrent_hash_map_destroy(chm_int, &chm);
+
+    /* A single shard works as well */
+    ut_assert_eq(concurrent_hash_map_init(chm_int, &chm, heap_allocator_handle(), 1), 0);
+    ut_assert_eq(concurrent_hash_map_shard_count(&chm), 1);
+    concurrent_hash_map_upsert(chm_int, &chm, 7, 7);
+    ut_assert(concurrent_hash_map_find(chm_int, &chm, 7, &value));
+    concurrent_hash_map_destroy(chm_int, &chm);
+}
+
+#define CHM_THREAD_COUNT        8
+#define CHM_KEYS_PER_THREAD     20000
+#define CHM_COUNTERS            100
+
+struct chm_stress
+{
+    concurrent_hash_map_t(chm_int) chm;
+    pthread_barrier_t barrier;
+    atomic_size_t errors;
+};
+
+struct chm_stress_arg
+{
+    struct chm_stress *stress;
+    int id;
+};
+
+static void *chm_stress_main(void *data)
+{
+    struct chm_stress_arg *arg = data;
+    concurrent_hash_map_t(chm_int) *chm = &arg->stress->chm;
+    int first = CHM_COUNTERS + arg->id * CHM_KEYS_PER_THREAD;
+    int neighbour = CHM_COUNTERS + ((arg->id + 1) % CHM_THREAD_COUNT) * CHM_KEYS_PER_THREAD;
+    long one = 1;
+    long value;
+
+    pthread_barrier_wait(&arg->stress->barrier);
+    for (int i = 0; i < CHM_KEYS_PER_THREAD; ++i) {
+        /* Own keys, shared counters, and lookups of the keys of a neighbour being inserted */
+        concurrent_hash_map_upsert(chm_int, chm, first + i, first + i);
+        concurrent_hash_map_update(chm_int, chm, i % CHM_COUNTERS, &chm_increment, &one);
+        if (concurrent_hash_map_find(chm_int, chm, neighbour + i, &value) && value != neighbour + i) {
+            atomic_fetch_add(&arg->stress->errors, 1);
+        }
+    }
+    for (int i = 0; i < CHM_KEYS_PER_THREAD; i += 2) {
+        if (!concurrent_hash_map_erase(chm_int, chm, first + i)) {
+            atomic_fetch_add(&arg->stress->errors, 1);
+        }
+    }
+    return NULL;
+}
+
+ut_test(stress)
+{
+    static struct chm_stress stress;
+    pthread_t threads[CHM_THREAD_COUNT];
+    struct chm_stress_arg args[CHM_THREAD_COUNT];
+    long value;
+
+    ut_assert_eq(concurrent_hash_map_init(chm_int, &stress.chm, heap_allocator_handle(), 32), 0);
+    pthread_barrier_init(&stress.barrier, NULL, CHM_THREAD_COUNT);
+    atomic_init(&stress.errors, 0);
+    for (int i = 0; i < CHM_THREAD_COUNT; ++i) {
+        args[i] = (struct chm_stress_arg){&stress, i};
+        ut_assert_eq(pthread_create(&threads[i], NULL, &chm_stress_main, &args[i]), 0);
+    }
+    for (int i = 0; i < CHM_THREAD_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ut_assert_eq(atomic_load(&stress.errors), 0);
+
+    /* No update to the shared counters was lost */
+    ut_assert_eq(concurrent_hash_map_size(chm_int, &stress.chm),
+                 CHM_COUNTERS + CHM_THREAD_COUNT * CHM_KEYS_PER_THREAD / 2);
+    for (int i = 0; i < CHM_COUNTERS; ++i) {
+        ut_assert(concurrent_hash_map_find(chm_int, &stress.chm, i, &value));
+        ut_assert_eq(value, CHM_THREAD_COUNT * CHM_KEYS_PER_THREAD / CHM_COUNTERS);
+    }
+    for (int i = CHM_COUNTERS; i < CHM_COUNTERS + CHM_THREAD_COUNT * CHM_KEYS_PER_THREAD; ++i) {
+        ut_assert_eq(concurrent_hash_map_find(chm_int, &stress.chm, i, NULL), (i - CHM_COUNTERS) % 2 == 1);
+    }
+
+    pthread_barrier_destroy(&stress.barrier);
+    concurrent_hash_map_destroy(chm_int, &stress.chm);
+}
+
+ut_group(concurrent_hash_map,
+         ut_get_test(basics),
+         ut_get_test(stress),
+);
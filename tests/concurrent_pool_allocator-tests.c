@@ -0,0 +1,169 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/concurrent_pool_allocator.h>
+
+struct cpool_object
+{
+    size_t owner;
+    size_t stamp;
+    char payload[48];
+};
+
+ut_test(allocate_deallocate)
+{
+    concurrent_pool_allocator_t cpool;
+    memory_allocator_handle_t handle = concurrent_pool_allocator_handle(&cpool);
+    struct cpool_object *objs[1000];
+
+    ut_assert_eq(concurrent_pool_allocator_init(&cpool, heap_allocator_handle(), sizeof(struct cpool_object),
+                                                alignof(struct cpool_object)), 0);
+    for (size_t i = 0; i < 1000; ++i) {
+        objs[i] = allocator_new(handle, struct cpool_object);
+        ut_assert_ne(objs[i], NULL);
+        ut_assert(is_aligned_ptr(objs[i], alignof(struct cpool_object)));
+        objs[i]->stamp = i;
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        ut_assert_eq(objs[i]->stamp, i);
+    }
+
+    /* Freed slots are reused, most recently freed first */
+    allocator_delete(handle, objs[10]);
+    ut_assert_eq(allocator_new(handle, struct cpool_object), objs[10]);
+
+    struct cpool_object *zeroed = allocator_znew(handle, struct cpool_object);
+    ut_assert_eq(zeroed->stamp, 0);
+    allocator_delete(handle, zeroed);
+    for (size_t i = 0; i < 1000; ++i) {
+        allocator_delete(handle, objs[i]);
+    }
+    concurrent_pool_allocator_destroy(&cpool);
+}
+
+#define CPOOL_THREAD_COUNT      8
+#define CPOOL_ROUNDS            200
+#define CPOOL_BATCH             300
+
+struct cpool_stress
+{
+    concurrent_pool_allocator_t cpool;
+    pthread_barrier_t barrier;
+    struct cpool_object *batches[CPOOL_THREAD_COUNT][CPOOL_BATCH];
+    atomic_size_t errors;
+};
+
+struct cpool_stress_arg
+{
+    struct cpool_stress *stress;
+    size_t id;
+};
+
+static void *cpool_stress_main(void *data)
+{
+    struct cpool_stress_arg *arg = data;
+    struct cpool_stress *stress = arg->stress;
+    memory_allocator_handle_t handle = concurrent_pool_allocator_handle(&stress->cpool);
+
+    for (size_t round = 0; round < CPOOL_ROUNDS; ++round) {
+        size_t count = (arg->id * 7 + round * 13) % CPOOL_BATCH + 1;
+        struct cpool_object **batch = stress->batches[arg->id];
+        struct cpool_object **neighbour = stress->batches[(arg->id + 1) % CPOOL_THREAD_COUNT];
+
+        for (size_t i = 0; i < CPOOL_BATCH; ++i) {
+            batch[i] = i < count ? allocator_new(handle, struct cpool_object) : NULL;
+            if (batch[i] != NULL) {
+                batch[i]->owner = arg->id;
+                batch[i]->stamp = round * CPOOL_BATCH + i;
+            }
+        }
+        pthread_barrier_wait(&stress->barrier);
+
+        /* Free what the neighbour allocated, checking nobody else got the same slots */
+        for (size_t i = 0; i < CPOOL_BATCH; ++i) {
+            if (neighbour[i] == NULL) {
+                continue;
+            }
+            if (neighbour[i]->owner != (arg->id + 1) % CPOOL_THREAD_COUNT ||
+                neighbour[i]->stamp != round * CPOOL_BATCH + i) {
+                atomic_fetch_add(&stress->errors, 1);
+            }
+            allocator_delete(handle, neighbour[i]);
+        }
+        pthread_barrier_wait(&stress->barrier);
+    }
+    return NULL;
+}
+
+ut_test(stress)
+{
+    static struct cpool_stress stress;
+    pthread_t threads[CPOOL_THREAD_COUNT];
+    struct cpool_stress_arg args[CPOOL_THREAD_COUNT];
+
+    ut_assert_eq(concurrent_pool_allocator_init(&stress.cpool, heap_allocator_handle(),
+                                                sizeof(struct cpool_object), alignof(struct cpool_object)), 0);
+    pthread_barrier_init(&stress.barrier, NULL, CPOOL_THREAD_COUNT);
+    atomic_init(&stress.errors, 0);
+    for (size_t i = 0; i < CPOOL_THREAD_COUNT; ++i) {
+        args[i] = (struct cpool_stress_arg){&stress, i};
+        ut_assert_eq(pthread_create(&threads[i], NULL, &cpool_stress_main, &args[i]), 0);
+    }
+    for (size_t i = 0; i < CPOOL_THREAD_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ut_assert_eq(atomic_load(&stress.errors), 0);
+    pthread_barrier_destroy(&stress.barrier);
+    concurrent_pool_allocator_destroy(&stress.cpool);
+}
+
+#define CPOOL_CHURN_OPS    1000000
+
+static void *cpool_churn_main(void *data)
+{
+    memory_allocator_handle_t handle = data;
+    void *live[16] = {NULL};
+
+    for (size_t i = 0; i < CPOOL_CHURN_OPS; ++i) {
+        size_t slot = i % array_length(live);
+
+        allocator_delete(handle, live[slot]);
+        live[slot] = allocator_new(handle, struct cpool_object);
+    }
+    for (size_t i = 0; i < array_length(live); ++i) {
+        allocator_delete(handle, live[i]);
+    }
+    return NULL;
+}
+
+ut_test(magazine_churn)
+{
+    concurrent_pool_allocator_t cpool;
+    pthread_t threads[CPOOL_THREAD_COUNT];
+    size_t slab_count = 0;
+
+    ut_assert_eq(concurrent_pool_allocator_init(&cpool, heap_allocator_handle(), sizeof(struct cpool_object),
+                                                alignof(struct cpool_object)), 0);
+    for (size_t i = 0; i < CPOOL_THREAD_COUNT; ++i) {
+        ut_assert_eq(pthread_create(&threads[i], NULL, &cpool_churn_main,
+                                    concurrent_pool_allocator_handle(&cpool)), 0);
+    }
+    for (size_t i = 0; i < CPOOL_THREAD_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Steady-state churn stays within the magazines of each thread, and never needs more slabs */
+    for (struct pool_slab *slab = cpool.slabs; slab != NULL; slab = slab->next) {
+        ++slab_count;
+    }
+    ut_assert_le(slab_count, CPOOL_THREAD_COUNT);
+    concurrent_pool_allocator_destroy(&cpool);
+}
+
+ut_group(concurrent_pool_allocator,
+         ut_get_test(allocate_deallocate),
+         ut_get_test(stress),
+         ut_get_test(magazine_churn),
+);
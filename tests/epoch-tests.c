@@ -0,0 +1,103 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/epoch.h>
+
+struct epoch_object
+{
+    struct epoch_node node;
+    size_t *reclaimed;
+};
+
+static void epoch_object_reclaim(struct epoch_node *node, void *ctx)
+{
+    struct epoch_object *obj = container_of(node, struct epoch_object, node);
+
+    (void)ctx;
+    ++*obj->reclaimed;
+}
+
+ut_test(critical_sections)
+{
+    epoch_domain_t ed;
+    struct epoch_object objs[3];
+    size_t reclaimed = 0;
+
+    ut_assert_eq(epoch_domain_init(&ed, heap_allocator_handle()), 0);
+    for (size_t i = 0; i < array_length(objs); ++i) {
+        objs[i].reclaimed = &reclaimed;
+    }
+
+    /* Without readers, objects are reclaimed as soon as they are retired */
+    epoch_retire(&ed, &objs[0].node, &epoch_object_reclaim, NULL);
+    ut_assert_eq(reclaimed, 1);
+
+    /* Objects retired during a critical section wait for its end, however nested it is */
+    ut_assert_eq(epoch_enter(&ed), 0);
+    ut_assert_eq(epoch_enter(&ed), 0);
+    ut_assert(is_aligned_ptr(ed.records, EPOCH_RECORD_ALIGN));
+    epoch_retire(&ed, &objs[1].node, &epoch_object_reclaim, NULL);
+    epoch_exit(&ed);
+    ut_assert_eq(epoch_reclaim(&ed), 1);
+    ut_assert_eq(reclaimed, 1);
+    epoch_exit(&ed);
+    ut_assert_eq(epoch_reclaim(&ed), 0);
+    ut_assert_eq(reclaimed, 2);
+
+    /* Critical sections entered after an object was retired do not hold it back */
+    ut_assert_eq(epoch_enter(&ed), 0);
+    epoch_retire(&ed, &objs[2].node, &epoch_object_reclaim, NULL);
+    epoch_exit(&ed);
+    ut_assert_eq(epoch_enter(&ed), 0);
+    ut_assert_eq(epoch_reclaim(&ed), 0);
+    ut_assert_eq(reclaimed, 3);
+    epoch_exit(&ed);
+
+    epoch_domain_destroy(&ed);
+}
+
+static void *epoch_thread_main(void *data)
+{
+    epoch_domain_t *ed = data;
+
+    epoch_enter(ed);
+    epoch_exit(ed);
+    return NULL;
+}
+
+ut_test(threads)
+{
+    epoch_domain_t ed;
+    struct epoch_object obj;
+    size_t reclaimed = 0;
+    size_t record_count = 0;
+    pthread_t thread;
+
+    ut_assert_eq(epoch_domain_init(&ed, heap_allocator_handle()), 0);
+
+    /* The records of exited threads are reused */
+    for (size_t i = 0; i < 4; ++i) {
+        ut_assert_eq(pthread_create(&thread, NULL, &epoch_thread_main, &ed), 0);
+        pthread_join(thread, NULL);
+    }
+    for (struct epoch_record *record = ed.records; record != NULL; record = record->next) {
+        ++record_count;
+    }
+    ut_assert_eq(record_count, 1);
+
+    /* Destroying a domain reclaims what was still waiting for readers */
+    obj.reclaimed = &reclaimed;
+    ut_assert_eq(epoch_enter(&ed), 0);
+    epoch_retire(&ed, &obj.node, &epoch_object_reclaim, NULL);
+    epoch_exit(&ed);
+    ut_assert_eq(reclaimed, 0);
+    epoch_domain_destroy(&ed);
+    ut_assert_eq(reclaimed, 1);
+}
+
+ut_group(epoch,
+         ut_get_test(critical_sections),
+         ut_get_test(threads),
+);
@@ -0,0 +1,112 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/flat_hash_map.h>
+#include <ceeds/size_class_allocator.h>
+
+#define flat_hash_int(i)        fnv_one64((const char *)&(i), sizeof(i))
+#define flat_hash_str(s)        fnv_one64(s, strlen(s))
+
+MAKE_FLAT_HASH_MAP_TYPE(flat_int, int, int, flat_hash_int, CMP);
+
+MAKE_FLAT_HASH_MAP_TYPE(flat_str, const char *, size_t, flat_hash_str, strcmp);
+
+ut_test(insert_find)
+{
+    flat_hash_map_t(flat_int) hm = flat_hash_map_empty(heap_allocator_handle());
+    size_t pos;
+
+    ut_assert_eq(flat_hash_map_find(flat_int, &hm, 1), flat_hash_map_npos);
+    for (int i = 0; i < 10000; ++i) {
+        flat_hash_map_insert(flat_int, &hm, i * 2 + 3, -i);
+    }
+    ut_assert_eq(flat_hash_map_size(&hm), 10000);
+    ut_assert_eq(flat_hash_map_capacity(&hm) & (flat_hash_map_capacity(&hm) - 1), 0);
+    for (int i = 0; i < 10000; ++i) {
+        pos = flat_hash_map_find(flat_int, &hm, i * 2 + 3);
+        ut_assert_ne(pos, flat_hash_map_npos);
+        ut_assert_eq(hm.keys[pos], i * 2 + 3);
+        ut_assert_eq(hm.values[pos], -i);
+        ut_assert_eq(flat_hash_map_find(flat_int, &hm, i * 2 + 4), flat_hash_map_npos);
+    }
+
+    /* Inserting an existing key replaces its value */
+    pos = flat_hash_map_insert(flat_int, &hm, 3, 42);
+    ut_assert_eq(flat_hash_map_size(&hm), 10000);
+    ut_assert_eq(flat_hash_map_find(flat_int, &hm, 3), pos);
+    ut_assert_eq(hm.values[pos], 42);
+
+    flat_hash_map_destroy(flat_int, &hm);
+}
+
+ut_test(erase)
+{
+    flat_hash_map_t(flat_int) hm = flat_hash_map_empty(heap_allocator_handle());
+    size_t capacity;
+    size_t count = 0;
+
+    flat_hash_map_reserve(flat_int, &hm, 1000);
+    capacity = flat_hash_map_capacity(&hm);
+    ut_assert_ge(capacity, 1000);
+
+    /* Churn through a sliding window of keys: deleted slots get reclaimed, and the map never grows */
+    for (int i = 0; i < 1000; ++i) {
+        flat_hash_map_insert(flat_int, &hm, i, i);
+    }
+    for (int i = 1000; i < 100000; ++i) {
+        flat_hash_map_erase(flat_int, &hm, i - 1000);
+        flat_hash_map_insert(flat_int, &hm, i, i);
+    }
+    ut_assert_eq(flat_hash_map_size(&hm), 1000);
+    ut_assert_eq(flat_hash_map_capacity(&hm), capacity);
+    for (int i = 0; i < 100000; ++i) {
+        size_t pos = flat_hash_map_find(flat_int, &hm, i);
+
+        if (i < 99000) {
+            ut_assert_eq(pos, flat_hash_map_npos);
+        } else {
+            ut_assert_ne(pos, flat_hash_map_npos);
+            ut_assert_eq(hm.values[pos], i);
+        }
+    }
+    for (size_t i = 0; i < flat_hash_map_capacity(&hm); ++i) {
+        count += flat_hash_map_is_full(&hm, i);
+    }
+    ut_assert_eq(count, 1000);
+
+    flat_hash_map_destroy(flat_int, &hm);
+}
+
+ut_test(string_keys)
+{
+    size_class_allocator_t sca;
+    flat_hash_map_t(flat_str) hm = flat_hash_map_empty(size_class_allocator_handle(&sca));
+    static const char *words[] = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"};
+    char buffer[16];
+    size_t pos;
+
+    size_class_allocator_init(&sca);
+    for (size_t i = 0; i < array_length(words); ++i) {
+        flat_hash_map_insert(flat_str, &hm, words[i], i);
+    }
+
+    /* Keys are compared with strcmp, not by address */
+    strcpy(buffer, "gamma");
+    pos = flat_hash_map_find(flat_str, &hm, buffer);
+    ut_assert_ne(pos, flat_hash_map_npos);
+    ut_assert_eq(hm.values[pos], 2);
+    flat_hash_map_erase(flat_str, &hm, buffer);
+    ut_assert_eq(flat_hash_map_find(flat_str, &hm, "gamma"), flat_hash_map_npos);
+    ut_assert_eq(flat_hash_map_size(&hm), array_length(words) - 1);
+
+    flat_hash_map_destroy(flat_str, &hm);
+    size_class_allocator_destroy(&sca);
+}
+
+ut_group(flat_hash_map,
+         ut_get_test(insert_find),
+         ut_get_test(erase),
+         ut_get_test(string_keys),
+);
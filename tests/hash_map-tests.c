@@ -9,6 +9,14 @@
 
 MAKE_HASH_MAP_TYPE(test, int, int, hash_int, CMP);
 
+MAKE_HASH_MAP_TYPE_WITH_POLICY(test_fastrange, int, int, hash_int, CMP, HASH_MAP_FASTRANGE);
+
+MAKE_HASH_MAP_TYPE_WITH_POLICY(test_modulo, int, int, hash_int, CMP, HASH_MAP_MODULO);
+
+MAKE_HASH_MAP_TYPE_WITH_LAYOUT(test_aos, int, long, hash_int, CMP, HASH_MAP_FASTRANGE, HASH_MAP_AOS);
+
+MAKE_VECTOR_TYPE(test_int, int);
+
 ut_test(initialization)
 {
     hash_map_t(test) hm = hash_map_empty(heap_allocator_handle());
@@ -73,9 +81,457 @@ ut_test(erase)
     hash_map_destroy(test, &hm);
 }
 
+/* Insert, erase a third of the elements, insert more over the tombstones, and check everything is found */
+#define check_policy(n)                                                             \
+    do {                                                                            \
+        hash_map_t(n) phm = hash_map_empty(heap_allocator_handle());                \
+        size_t pos;                                                                 \
+                                                                                    \
+        for (int i = 0; i < 10000; ++i) {                                           \
+            hash_map_insert(n, &phm, i, -i);                                        \
+        }                                                                           \
+        for (int i = 0; i < 10000; i += 3) {                                        \
+            hash_map_erase(n, &phm, i);                                             \
+        }                                                                           \
+        for (int i = 10000; i < 12000; ++i) {                                       \
+            hash_map_insert(n, &phm, i, -i);                                        \
+        }                                                                           \
+        ut_assert_eq(hash_map_size(&phm), 12000 - 3334);                            \
+        for (int i = 0; i < 12000; ++i) {                                           \
+            pos = hash_map_find(n, &phm, i);                                        \
+            if (i < 10000 && i % 3 == 0) {                                          \
+                ut_assert_eq(pos, hash_map_npos);                                   \
+            } else {                                                                \
+                ut_assert_ne(pos, hash_map_npos);                                   \
+                ut_assert_eq(phm.values[pos], -i);                                  \
+            }                                                                       \
+        }                                                                           \
+        hash_map_destroy(n, &phm);                                                  \
+    } while (0)
+
+ut_test(capacity_policies)
+{
+    hash_map_t(test) hm = hash_map_empty(heap_allocator_handle());
+
+    /* Power-of-two capacities are kept whatever is reserved (1000 elements need 1112 slots at 90% load) */
+    hash_map_reserve(test, &hm, 1000);
+    ut_assert_eq(hash_map_capacity(&hm), 2048);
+    hash_map_reserve(test, &hm, 1000000);
+    ut_assert_eq(hash_map_capacity(&hm) & (hash_map_capacity(&hm) - 1), 0);
+    ut_assert_ge(hash_map_capacity(&hm), 1000000);
+    hash_map_destroy(test, &hm);
+
+    check_policy(test);
+    check_policy(test_fastrange);
+    check_policy(test_modulo);
+}
+
+ut_test(buffers)
+{
+    int *keys = allocator_new_array(heap_allocator_handle(), int, 10);
+    int *values = allocator_new_array(heap_allocator_handle(), int, 10);
+    hash_value_t *hashes = allocator_new_array(heap_allocator_handle(), hash_value_t, 10);
+    hash_map_t(test) hm = hash_map_empty_with_buffers(test, heap_allocator_handle(), keys, values, hashes, 10);
+    hash_map_t(test_modulo) hm_modulo;
+
+    /* Only the first 8 slots are used by power-of-two maps, the buffers being given back when growing */
+    ut_assert_eq(hash_map_capacity(&hm), 8);
+    ut_assert_eq(hm.keys, keys);
+    for (int i = 0; i < 100; ++i) {
+        hash_map_insert(test, &hm, i, -i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        ut_assert_eq(hash_map_value_at(&hm, hash_map_find(test, &hm, i)), -i);
+    }
+    hash_map_destroy(test, &hm);
+
+    /* Other policies use all of them */
+    keys = allocator_new_array(heap_allocator_handle(), int, 10);
+    values = allocator_new_array(heap_allocator_handle(), int, 10);
+    hashes = allocator_new_array(heap_allocator_handle(), hash_value_t, 10);
+    hm_modulo = hash_map_empty_with_buffers(test_modulo, heap_allocator_handle(), keys, values, hashes, 10);
+    ut_assert_eq(hash_map_capacity(&hm_modulo), 10);
+    for (int i = 0; i < 9; ++i) {
+        hash_map_insert(test_modulo, &hm_modulo, i, -i);
+    }
+    ut_assert_eq(hash_map_capacity(&hm_modulo), 10);
+    for (int i = 0; i < 9; ++i) {
+        ut_assert_eq(hash_map_value_at(&hm_modulo, hash_map_find(test_modulo, &hm_modulo, i)), -i);
+    }
+    hash_map_destroy(test_modulo, &hm_modulo);
+}
+
+ut_test(backward_shift)
+{
+    hash_map_t(test) hm = hash_map_empty(heap_allocator_handle());
+    size_t capacity;
+    size_t pos;
+
+    hash_map_set_backward_shift(&hm, true);
+    for (int i = 0; i < 1000; ++i) {
+        hash_map_insert(test, &hm, i, -i);
+    }
+    capacity = hash_map_capacity(&hm);
+
+    /* Churn through a sliding window of keys: no tombstone is ever left, and the map never grows */
+    for (int i = 1000; i < 100000; ++i) {
+        hash_map_erase(test, &hm, i - 1000);
+        hash_map_insert(test, &hm, i, -i);
+    }
+    ut_assert_eq(hash_map_size(&hm), 1000);
+    ut_assert_eq(hash_map_capacity(&hm), capacity);
+    for (size_t i = 0; i < capacity; ++i) {
+        ut_assert(!_hash_map_is_tombstone(hm.hashes[i]));
+    }
+    for (int i = 0; i < 100000; ++i) {
+        pos = hash_map_find(test, &hm, i);
+        if (i < 99000) {
+            ut_assert_eq(pos, hash_map_npos);
+        } else {
+            ut_assert_ne(pos, hash_map_npos);
+            ut_assert_eq(hm.values[pos], -i);
+        }
+    }
+
+    /* Erasing everything leaves a map as empty as a new one */
+    for (int i = 99000; i < 100000; ++i) {
+        hash_map_erase(test, &hm, i);
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        ut_assert(_hash_map_is_empty_slot(hm.hashes[i]));
+    }
+    hash_map_destroy(test, &hm);
+}
+
+ut_test(load_factors)
+{
+    hash_map_t(test_fastrange) hm = hash_map_empty(heap_allocator_handle());
+    size_t capacity;
+
+    ut_assert_eq(hash_map_set_max_load(&hm, 10), -1);
+    ut_assert_eq(hash_map_set_max_load(&hm, 99), -1);
+    ut_assert_eq(hash_map_set_growth(&hm, 100), -1);
+    ut_assert_eq(hash_map_set_growth(&hm, 1000), -1);
+    ut_assert_eq(hm.max_load, HASH_MAP_DEFAULT_MAX_LOAD);
+    ut_assert_eq(hm.growth, HASH_MAP_DEFAULT_GROWTH);
+
+    /* The map never gets more than half full, and quadruples when it grows */
+    ut_assert_eq(hash_map_set_max_load(&hm, 50), 0);
+    ut_assert_eq(hash_map_set_growth(&hm, 400), 0);
+    for (int i = 0; i < 1000; ++i) {
+        capacity = hash_map_capacity(&hm);
+        hash_map_insert(test_fastrange, &hm, i, i);
+        ut_assert_ge(hash_map_capacity(&hm) * 50 / 100, hash_map_size(&hm));
+        if (capacity > 10 && hash_map_capacity(&hm) != capacity) {
+            ut_assert_eq(hash_map_capacity(&hm), capacity * 4);
+        }
+    }
+
+    /* Shrinking goes down to the smallest capacity within the load factor */
+    for (int i = 100; i < 1000; ++i) {
+        hash_map_erase(test_fastrange, &hm, i);
+    }
+    hash_map_shrink_to_fit(test_fastrange, &hm);
+    ut_assert_eq(hash_map_capacity(&hm), 200);
+    for (int i = 0; i < 1000; ++i) {
+        ut_assert_eq(hash_map_find(test_fastrange, &hm, i) != hash_map_npos, i < 100);
+    }
+    for (int i = 0; i < 100; ++i) {
+        hash_map_erase(test_fastrange, &hm, i);
+    }
+    hash_map_shrink_to_fit(test_fastrange, &hm);
+    ut_assert_eq(hash_map_capacity(&hm), 0);
+    hash_map_insert(test_fastrange, &hm, 1, 2);
+    ut_assert_ne(hash_map_find(test_fastrange, &hm, 1), hash_map_npos);
+
+    hash_map_destroy(test_fastrange, &hm);
+}
+
+ut_test(incremental_resize)
+{
+    hash_map_t(test) hm = hash_map_empty(heap_allocator_handle());
+    size_t capacity = 0;
+    size_t pos;
+
+    hash_map_set_incremental_resize(&hm, true);
+    hash_map_set_backward_shift(&hm, true);
+    for (int i = 0; i < 15000; ++i) {
+        bool was_resizing = hm.old.hashes != NULL;
+
+        hash_map_insert(test, &hm, i, i);
+        if (hash_map_capacity(&hm) != capacity) {
+            /* The previous old table was all moved before growing again, and only one step is taken */
+            ut_assert(!was_resizing);
+            ut_assert_le(hm.old.migrated, HASH_MAP_MIGRATION_SLOTS);
+            capacity = hash_map_capacity(&hm);
+        }
+        if (i % 97 == 0) {
+            for (int j = 0; j <= i; ++j) {
+                pos = hash_map_find(test, &hm, j);
+                ut_assert_ne(pos, hash_map_npos);
+                ut_assert_eq(hash_map_key_at(&hm, pos), j);
+                ut_assert_eq(hash_map_value_at(&hm, pos), j);
+            }
+        }
+    }
+    /* The last growth happened at 14746 elements, not all the old table was moved since */
+    ut_assert_eq(hash_map_size(&hm), 15000);
+    ut_assert_eq(hash_map_capacity(&hm), 32768);
+    ut_assert_ne(hm.old.hashes, NULL);
+
+    /* Elements still in the old table can be updated and erased */
+    pos = 0;
+    for (int i = 0; pos < hash_map_capacity(&hm); ++i) {
+        pos = hash_map_find(test, &hm, i);
+    }
+    hash_map_value_at(&hm, pos) = -1;
+    ut_assert_eq(hash_map_value_at(&hm, hash_map_find(test, &hm, hash_map_key_at(&hm, pos))), -1);
+    for (int i = 0; i < 15000; i += 2) {
+        hash_map_erase(test, &hm, i);
+    }
+    ut_assert_eq(hash_map_size(&hm), 7500);
+    for (int i = 0; i < 15000; ++i) {
+        ut_assert_eq(hash_map_find(test, &hm, i) != hash_map_npos, i % 2 == 1);
+    }
+
+    /* Shrinking finishes the resizing in progress */
+    hash_map_insert(test, &hm, 0, 0);
+    hash_map_shrink_to_fit(test, &hm);
+    ut_assert_eq(hm.old.hashes, NULL);
+    ut_assert_eq(hash_map_capacity(&hm), 16384);
+    for (int i = 0; i < 15000; ++i) {
+        ut_assert_eq(hash_map_find(test, &hm, i) != hash_map_npos, i % 2 == 1 || i == 0);
+    }
+
+    /* Destroying a hash map in the middle of a resize frees both tables */
+    for (int i = 15000; hm.old.hashes == NULL; ++i) {
+        hash_map_insert(test, &hm, i, i);
+    }
+    hash_map_destroy(test, &hm);
+}
+
+ut_test(batches)
+{
+    hash_map_t(test) hm = hash_map_empty(heap_allocator_handle());
+    int keys[1000];
+    int values[1000];
+    size_t positions[1990];
+    int lookups[1990];
+
+    /* Looking up into an empty map finds nothing */
+    for (int i = 0; i < 1000; ++i) {
+        keys[i] = i * 3;
+        values[i] = -i;
+    }
+    hash_map_find_batch(test, &hm, keys, 1000, positions);
+    for (int i = 0; i < 1000; ++i) {
+        ut_assert_eq(positions[i], hash_map_npos);
+    }
+
+    /* Room is made for a whole batch at once, just enough for this one at 90% load */
+    hash_map_insert_batch(test, &hm, keys, values, 921);
+    ut_assert_eq(hash_map_size(&hm), 921);
+    ut_assert_eq(hash_map_capacity(&hm), 1024);
+
+    /* A small batch then starts a resize, without finishing it */
+    hash_map_set_incremental_resize(&hm, true);
+    hash_map_insert_batch(test, &hm, keys + 921, values + 921, 20);
+    ut_assert_eq(hash_map_size(&hm), 941);
+    ut_assert_eq(hash_map_capacity(&hm), 2048);
+    ut_assert_ne(hm.old.hashes, NULL);
+
+    /* Batches find the same elements as single lookups, in both tables */
+    for (int i = 0; i < 1990; ++i) {
+        lookups[i] = i % 2 == 0 ? keys[i / 2] : i * 3 + 1;
+    }
+    hash_map_find_batch(test, &hm, lookups, 1990, positions);
+    for (int i = 0; i < 1990; ++i) {
+        ut_assert_eq(positions[i], hash_map_find(test, &hm, lookups[i]));
+        if (i % 2 == 0 && i / 2 < 941) {
+            ut_assert_eq(hash_map_value_at(&hm, positions[i]), -(i / 2));
+        } else {
+            ut_assert_eq(positions[i], hash_map_npos);
+        }
+    }
+
+    hash_map_destroy(test, &hm);
+}
+
+ut_test(try_emplace)
+{
+    hash_map_t(test) hm = hash_map_empty(heap_allocator_handle());
+    bool inserted;
+    size_t pos;
+    int key;
+
+    /* Count the occurrences of i % 1000, with i % 1000 < 500 appearing once more */
+    for (int i = 0; i < 10500; ++i) {
+        int *count = hash_map_try_emplace(test, &hm, i % 1000, &inserted);
+
+        ut_assert_eq(inserted, i < 1000);
+        ut_assert_eq(*count, i < 1000 ? 0 : i / 1000);
+        ++*count;
+        if (i == 4999) {
+            hash_map_set_incremental_resize(&hm, true);
+        }
+    }
+    ut_assert_eq(hash_map_size(&hm), 1000);
+    for (int i = 0; i < 1000; ++i) {
+        pos = hash_map_find(test, &hm, i);
+        ut_assert_eq(hash_map_value_at(&hm, pos), i < 500 ? 11 : 10);
+    }
+
+    /* Elements still in the old table are found there rather than inserted again */
+    hash_map_reserve(test, &hm, 2000);
+    ut_assert_ne(hm.old.hashes, NULL);
+    pos = 0;
+    for (int i = 0; pos < hash_map_capacity(&hm); ++i) {
+        pos = hash_map_find(test, &hm, i);
+    }
+    key = hash_map_key_at(&hm, pos);
+    ut_assert_eq(*hash_map_try_emplace(test, &hm, key, NULL), key < 500 ? 11 : 10);
+    ut_assert_eq(hash_map_size(&hm), 1000);
+
+    /* Insertions give the position of the element inserted, however far it displaced others */
+    for (int i = 1000; i < 5000; ++i) {
+        pos = hash_map_insert(test, &hm, i, i);
+        ut_assert_eq(hash_map_key_at(&hm, pos), i);
+        ut_assert_eq(hash_map_value_at(&hm, pos), i);
+    }
+
+    hash_map_destroy(test, &hm);
+}
+
+ut_test(iteration)
+{
+    hash_map_t(test_modulo) hm = hash_map_empty(heap_allocator_handle());
+    vector_t(test_int) keys = vector_empty(heap_allocator_handle());
+    vector_t(test_int) values = vector_empty(heap_allocator_handle());
+    bool seen[10000] = {false};
+    size_t count = 0;
+
+    hash_map_for_each(&hm, pos) {
+        ut_assert(false);
+    }
+
+    /* A sparse map, with long runs of empty slots and a few tombstones */
+    hash_map_reserve(test_modulo, &hm, 10000);
+    for (int i = 0; i < 10000; i += 37) {
+        hash_map_insert(test_modulo, &hm, i, -i);
+    }
+    hash_map_erase(test_modulo, &hm, 37);
+    hash_map_for_each(&hm, pos) {
+        int key = hash_map_key_at(&hm, pos);
+
+        ut_assert(!seen[key]);
+        ut_assert_eq(hash_map_value_at(&hm, pos), -key);
+        seen[key] = true;
+        hash_map_value_at(&hm, pos) = key;
+        ++count;
+    }
+    ut_assert_eq(count, hash_map_size(&hm));
+    for (int i = 0; i < 10000; ++i) {
+        ut_assert_eq(seen[i], i % 37 == 0 && i != 37);
+    }
+
+    /* Elements which are still in the old table are visited too */
+    hash_map_set_incremental_resize(&hm, true);
+    for (int i = 1; hm.old.hashes == NULL; i += 37) {
+        hash_map_insert(test_modulo, &hm, i, i);
+    }
+    hash_map_to_vectors(&hm, &keys, &values);
+    ut_assert_eq(vector_size(&keys), hash_map_size(&hm));
+    ut_assert_eq(vector_size(&values), hash_map_size(&hm));
+    for (size_t i = 0; i < vector_size(&keys); ++i) {
+        ut_assert_eq(keys.data[i], values.data[i]);
+        ut_assert_ne(hash_map_find(test_modulo, &hm, keys.data[i]), hash_map_npos);
+    }
+
+    vector_destroy(&keys);
+    vector_destroy(&values);
+    hash_map_destroy(test_modulo, &hm);
+}
+
+ut_test(interleaved_layout)
+{
+    hash_map_t(test_aos) hm = hash_map_empty(heap_allocator_handle());
+    int keys[100];
+    size_t positions[100];
+    size_t old_positions = 0;
+    size_t count = 0;
+    size_t pos;
+
+    /* The layout takes no room in the hash map itself */
+    ut_assert_eq(sizeof(hm), sizeof(hash_map_t(test)));
+
+    hash_map_set_incremental_resize(&hm, true);
+    for (int i = 0; i < 20000; ++i) {
+        pos = hash_map_insert(test_aos, &hm, i, -i);
+        ut_assert_eq(hash_map_key_at(&hm, pos), i);
+        ut_assert_eq(hash_map_value_at(&hm, pos), -i);
+        /* Which may be in the old table */
+        pos = hash_map_find(test_aos, &hm, i / 2);
+        ut_assert_eq(hash_map_value_at(&hm, pos), -(i / 2));
+        old_positions += pos >= hash_map_capacity(&hm);
+    }
+    ut_assert_ne(old_positions, 0);
+
+    /* Keys, values and hashes of a slot are in the same bucket */
+    pos = hash_map_find(test_aos, &hm, 42);
+    ut_assert_lt(pos, hash_map_capacity(&hm));
+    ut_assert_lt((char *)&hash_map_value_at(&hm, pos) - (char *)&hash_map_key_at(&hm, pos), 16);
+    ut_assert_eq(hash_map_value_at(&hm, pos), -42);
+
+    /* Erasing through tombstones then through backward shifts */
+    for (int i = 0; i < 20000; i += 4) {
+        hash_map_erase(test_aos, &hm, i);
+    }
+    hash_map_set_backward_shift(&hm, true);
+    for (int i = 2; i < 20000; i += 4) {
+        hash_map_erase(test_aos, &hm, i);
+    }
+    ut_assert_eq(hash_map_size(&hm), 10000);
+    for (int i = 0; i < 20000; ++i) {
+        pos = hash_map_find(test_aos, &hm, i);
+        ut_assert_eq(pos != hash_map_npos, i % 2 == 1);
+        if (pos != hash_map_npos) {
+            ut_assert_eq(hash_map_value_at(&hm, pos), -i);
+        }
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        keys[i] = i;
+    }
+    hash_map_find_batch(test_aos, &hm, keys, 100, positions);
+    for (int i = 0; i < 100; ++i) {
+        ut_assert_eq(positions[i], hash_map_find(test_aos, &hm, i));
+    }
+    ++*hash_map_try_emplace(test_aos, &hm, 1, NULL);
+    ut_assert_eq(hash_map_value_at(&hm, hash_map_find(test_aos, &hm, 1)), 0);
+
+    hash_map_shrink_to_fit(test_aos, &hm);
+    ut_assert_eq(hm.old.hashes, NULL);
+    hash_map_for_each(&hm, it) {
+        ut_assert_eq(hash_map_key_at(&hm, it) % 2, 1);
+        ++count;
+    }
+    ut_assert_eq(count, 10000);
+
+    hash_map_destroy(test_aos, &hm);
+}
+
 ut_group(hash_map,
          ut_get_test(initialization),
          ut_get_test(insert1000),
          ut_get_test(insert_find),
-         ut_get_test(erase)
+         ut_get_test(erase),
+         ut_get_test(capacity_policies),
+         ut_get_test(buffers),
+         ut_get_test(backward_shift),
+         ut_get_test(load_factors),
+         ut_get_test(incremental_resize),
+         ut_get_test(batches),
+         ut_get_test(try_emplace),
+         ut_get_test(iteration),
+         ut_get_test(interleaved_layout)
 );
@@ -0,0 +1,104 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/hash_set.h>
+
+#define set_hash_int(i)         fnv_one64((const char *)&(i), sizeof(i))
+#define set_hash_str(s)         fnv_one64(s, strlen(s))
+
+MAKE_HASH_SET_TYPE(set_int, int, set_hash_int, CMP);
+
+MAKE_VECTOR_TYPE(set_int, int);
+
+MAKE_HASH_SET_TYPE_WITH_POLICY(set_str, const char *, set_hash_str, strcmp, HASH_MAP_FASTRANGE);
+
+ut_test(insert_contains)
+{
+    hash_set_t(set_int) hs = hash_set_empty(heap_allocator_handle());
+    vector_t(set_int) keys = vector_empty(heap_allocator_handle());
+    size_t pos;
+
+    ut_assert(!hash_set_contains(set_int, &hs, 1));
+    for (int i = 0; i < 10000; ++i) {
+        ut_assert(hash_set_insert(set_int, &hs, i * 2 + 3));
+    }
+
+    /* Keys already there are not inserted again */
+    for (int i = 0; i < 10000; ++i) {
+        ut_assert(!hash_set_insert(set_int, &hs, i * 2 + 3));
+    }
+    ut_assert_eq(hash_set_size(&hs), 10000);
+    for (int i = 0; i < 10000; ++i) {
+        pos = hash_set_find(set_int, &hs, i * 2 + 3);
+        ut_assert_ne(pos, hash_map_npos);
+        ut_assert_eq(hash_map_key_at(&hs, pos), i * 2 + 3);
+        ut_assert(!hash_set_contains(set_int, &hs, i * 2 + 4));
+    }
+
+    /* No values array is ever allocated */
+    ut_assert_eq(hs.values, NULL);
+
+    hash_set_to_vector(&hs, &keys);
+    ut_assert_eq(vector_size(&keys), 10000);
+    for (size_t i = 0; i < vector_size(&keys); ++i) {
+        ut_assert_eq(keys.data[i] % 2, 1);
+        ut_assert(hash_set_contains(set_int, &hs, keys.data[i]));
+    }
+
+    vector_destroy(&keys);
+    hash_set_destroy(set_int, &hs);
+}
+
+ut_test(erase_shrink)
+{
+    hash_set_t(set_int) hs = hash_set_empty(heap_allocator_handle());
+    int keys[100];
+    size_t positions[100];
+
+    hash_map_set_backward_shift(&hs, true);
+    hash_map_set_incremental_resize(&hs, true);
+    for (int i = 0; i < 5000; ++i) {
+        hash_set_insert(set_int, &hs, i);
+    }
+    for (int i = 0; i < 5000; i += 2) {
+        hash_set_erase(set_int, &hs, i);
+    }
+    ut_assert_eq(hash_set_size(&hs), 2500);
+    hash_set_shrink_to_fit(set_int, &hs);
+    ut_assert_eq(hash_map_capacity(&hs), 4096);
+
+    for (int i = 0; i < 100; ++i) {
+        keys[i] = i;
+    }
+    hash_set_find_batch(set_int, &hs, keys, 100, positions);
+    for (int i = 0; i < 100; ++i) {
+        ut_assert_eq(positions[i] != hash_map_npos, i % 2 == 1);
+    }
+
+    hash_set_destroy(set_int, &hs);
+}
+
+ut_test(string_keys)
+{
+    hash_set_t(set_str) hs = hash_set_empty(heap_allocator_handle());
+    static const char *words[] = {"the", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog"};
+
+    for (size_t i = 0; i < array_length(words); ++i) {
+        hash_set_insert(set_str, &hs, words[i]);
+    }
+    ut_assert_eq(hash_set_size(&hs), 8);
+    ut_assert(hash_set_contains(set_str, &hs, "fox"));
+    hash_set_erase(set_str, &hs, "fox");
+    ut_assert(!hash_set_contains(set_str, &hs, "fox"));
+    ut_assert(hash_set_contains(set_str, &hs, "dog"));
+
+    hash_set_destroy(set_str, &hs);
+}
+
+ut_group(hash_set,
+         ut_get_test(insert_contains),
+         ut_get_test(erase_shrink),
+         ut_get_test(string_keys),
+);
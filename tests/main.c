@@ -10,11 +10,27 @@ ut_declare_group(bitmanip);
 ut_declare_group(ascii_set);
 ut_declare_group(string_utils);
 ut_declare_group(memory);
+ut_declare_group(scavenger);
+ut_declare_group(arena_allocator);
+ut_declare_group(pool_allocator);
+ut_declare_group(size_class_allocator);
+ut_declare_group(thread_cache_allocator);
+ut_declare_group(mmap_allocator);
+ut_declare_group(vm_reserve_allocator);
+ut_declare_group(stats_allocator);
+ut_declare_group(budget_allocator);
+ut_declare_group(concurrent_pool_allocator);
+ut_declare_group(buddy_allocator);
 ut_declare_group(str);
 ut_declare_group(vector);
 ut_declare_group(growing_str);
 ut_declare_group(binary_heap);
 ut_declare_group(hash_map);
+ut_declare_group(hash_set);
+ut_declare_group(concurrent_hash_map);
+ut_declare_group(epoch);
+ut_declare_group(rcu_hash_map);
+ut_declare_group(flat_hash_map);
 
 int main(void)
 {
@@ -24,10 +40,26 @@ int main(void)
     ut_run_group(ut_get_group(ascii_set));
     ut_run_group(ut_get_group(string_utils));
     ut_run_group(ut_get_group(memory));
+    ut_run_group(ut_get_group(scavenger));
+    ut_run_group(ut_get_group(arena_allocator));
+    ut_run_group(ut_get_group(pool_allocator));
+    ut_run_group(ut_get_group(size_class_allocator));
+    ut_run_group(ut_get_group(thread_cache_allocator));
+    ut_run_group(ut_get_group(mmap_allocator));
+    ut_run_group(ut_get_group(vm_reserve_allocator));
+    ut_run_group(ut_get_group(stats_allocator));
+    ut_run_group(ut_get_group(budget_allocator));
+    ut_run_group(ut_get_group(concurrent_pool_allocator));
+    ut_run_group(ut_get_group(buddy_allocator));
     ut_run_group(ut_get_group(str));
     ut_run_group(ut_get_group(vector));
     ut_run_group(ut_get_group(growing_str));
     ut_run_group(ut_get_group(binary_heap));
     ut_run_group(ut_get_group(hash_map));
+    ut_run_group(ut_get_group(hash_set));
+    ut_run_group(ut_get_group(concurrent_hash_map));
+    ut_run_group(ut_get_group(epoch));
+    ut_run_group(ut_get_group(rcu_hash_map));
+    ut_run_group(ut_get_group(flat_hash_map));
     return 0;
 }
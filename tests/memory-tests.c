@@ -58,6 +58,26 @@ ut_test(heap_allocator)
     delete(arr);
 }
 
+ut_test(at_least_fallbacks)
+{
+    size_t actual_n;
+
+    /* The heap allocator does not report usable sizes, so exactly what was asked for is reported */
+    int *arr = allocator_new_array_at_least(heap_allocator_handle(), int, 10, &actual_n);
+    ut_assert_eq(actual_n, 10);
+    for (int i = 0; i < 10; ++i) {
+        arr[i] = i;
+    }
+
+    arr = allocator_resize_array_at_least(heap_allocator_handle(), arr, int, 10, 100, &actual_n);
+    ut_assert_eq(actual_n, 100);
+    for (int i = 0; i < 10; ++i) {
+        ut_assert_eq(arr[i], i);
+    }
+
+    allocator_delete_array(heap_allocator_handle(), arr, int, actual_n);
+}
+
 ut_test(static_allocator)
 {
     struct allocator_aware_buf_test aabt = {.buf = "a string", .handle = static_allocator_handle()};
@@ -67,5 +87,6 @@ ut_test(static_allocator)
 
 ut_group(memory,
          ut_get_test(heap_allocator),
+         ut_get_test(at_least_fallbacks),
          ut_get_test(static_allocator),
 );
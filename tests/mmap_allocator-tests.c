@@ -0,0 +1,95 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <unistd.h>
+#include "unit_tests.h"
+#include <ceeds/hash_map.h>
+#include <ceeds/mmap_allocator.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(mmap_long, long);
+
+#define mmap_hash_long(l)   fnv_one64((const char *)&l, sizeof(l))
+
+MAKE_HASH_MAP_TYPE(mmap_long, long, long, mmap_hash_long, CMP);
+
+ut_test(allocate)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t actual_n;
+
+    char *small = allocator_new_array_at_least(mmap_allocator_handle(), char, 10, &actual_n);
+    ut_assert_ge(actual_n, 10);
+    ut_assert_lt(actual_n, page);
+    memset(small, 'a', actual_n);
+    allocator_delete(mmap_allocator_handle(), small);
+
+    int *zeroed = allocator_znew_array(mmap_allocator_handle(), int, 100000);
+    for (int i = 0; i < 100000; ++i) {
+        ut_assert_eq(zeroed[i], 0);
+    }
+    allocator_delete(mmap_allocator_handle(), zeroed);
+
+    char *aligned = allocator_aligned_new_array(mmap_allocator_handle(), char, 100, page * 4);
+    ut_assert(is_aligned_ptr(aligned, page * 4));
+    memset(aligned, 'b', 100);
+    aligned = allocator_aligned_resize_array(mmap_allocator_handle(), aligned, char, 100, page * 10, page * 4);
+    ut_assert(is_aligned_ptr(aligned, page * 4));
+    ut_assert_eq(aligned[99], 'b');
+    allocator_delete(mmap_allocator_handle(), aligned);
+}
+
+ut_test(reallocate)
+{
+    long *arr = allocator_new_array(mmap_allocator_handle(), long, 1000);
+    long *shrunk;
+
+    for (long i = 0; i < 1000; ++i) {
+        arr[i] = i;
+    }
+    arr = allocator_resize_array(mmap_allocator_handle(), arr, long, 1000, 1000000);
+    for (long i = 0; i < 1000; ++i) {
+        ut_assert_eq(arr[i], i);
+    }
+    for (long i = 1000; i < 1000000; ++i) {
+        arr[i] = i;
+    }
+    shrunk = allocator_resize_array(mmap_allocator_handle(), arr, long, 1000000, 10);
+    ut_assert_eq(shrunk, arr);
+    for (long i = 0; i < 10; ++i) {
+        ut_assert_eq(shrunk[i], i);
+    }
+    allocator_delete(mmap_allocator_handle(), shrunk);
+}
+
+ut_test(containers)
+{
+    vector_t(mmap_long) vec = vector_empty(mmap_allocator_handle());
+    hash_map_t(mmap_long) hm = hash_map_empty(mmap_allocator_handle());
+
+    for (long i = 0; i < 1000000; ++i) {
+        vector_push_back(&vec, i);
+    }
+    for (long i = 0; i < 1000000; ++i) {
+        ut_assert_eq(vec.data[i], i);
+    }
+    vector_destroy(&vec);
+
+    for (long i = 0; i < 10000; ++i) {
+        hash_map_insert(mmap_long, &hm, i, i * 3);
+    }
+    for (long i = 0; i < 10000; ++i) {
+        size_t pos = hash_map_find(mmap_long, &hm, i);
+
+        ut_assert_ne(pos, hash_map_npos);
+        ut_assert_eq(hm.values[pos], i * 3);
+    }
+    hash_map_destroy(mmap_long, &hm);
+}
+
+ut_group(mmap_allocator,
+         ut_get_test(allocate),
+         ut_get_test(reallocate),
+         ut_get_test(containers),
+);
@@ -0,0 +1,104 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/list.h>
+#include <ceeds/pool_allocator.h>
+
+struct pool_test_node
+{
+    list_node_t node;
+    int value;
+};
+
+MAKE_POOL_TYPE(node, struct pool_test_node);
+
+struct pool_test_big
+{
+    char buf[1000];
+} _aligned_(64);
+
+ut_test(allocate_deallocate)
+{
+    pool_allocator_t pool;
+    memory_allocator_handle_t handle = pool_allocator_handle(&pool);
+
+    pool_allocator_init(&pool, heap_allocator_handle(), sizeof(int), alignof(int));
+    ut_assert_ge(pool.slot_size, sizeof(int));
+
+    int *a = allocator_new(handle, int);
+    int *b = allocator_new(handle, int);
+    ut_assert_ne(a, NULL);
+    ut_assert_ne(b, NULL);
+    ut_assert_ne(a, b);
+    *a = 1;
+    *b = 2;
+    ut_assert_eq(*a, 1);
+    ut_assert_eq(*b, 2);
+
+    allocator_delete(handle, a);
+    int *c = allocator_znew(handle, int);
+    ut_assert_eq(c, a);
+    ut_assert_eq(*c, 0);
+
+    pool_allocator_destroy(&pool);
+}
+
+ut_test(many_slabs)
+{
+    pool_allocator_t pool;
+    struct pool_test_big *ptrs[100];
+
+    pool_allocator_init(&pool, heap_allocator_handle(), sizeof(struct pool_test_big), alignof(struct pool_test_big));
+
+    for (size_t i = 0; i < ut_sizeof_array(ptrs); ++i) {
+        ptrs[i] = allocator_new(pool_allocator_handle(&pool), struct pool_test_big);
+        ut_assert(is_aligned_ptr(ptrs[i], 64));
+        memset(ptrs[i]->buf, (int)i, sizeof(ptrs[i]->buf));
+    }
+    for (size_t i = 0; i < ut_sizeof_array(ptrs); ++i) {
+        ut_assert_eq(ptrs[i]->buf[0], (char)i);
+        ut_assert_eq(ptrs[i]->buf[999], (char)i);
+    }
+
+    pool_allocator_destroy(&pool);
+}
+
+ut_test(typed_pool)
+{
+    pool_t(node) pool;
+    list_t list;
+    int expected = 0;
+
+    pool_init(node, &pool, heap_allocator_handle());
+    list_init(&list);
+
+    for (int i = 0; i < 1000; ++i) {
+        struct pool_test_node *n = pool_znew(node, &pool);
+
+        ut_assert_eq(n->value, 0);
+        n->value = i;
+        list_push_back(&list, &n->node);
+    }
+    for (list_node_t *cur = list.head; cur != &list.guard_node; cur = cur->next) {
+        ut_assert_eq(container_of(cur, struct pool_test_node, node)->value, expected);
+        ++expected;
+    }
+    ut_assert_eq(expected, 1000);
+
+    while (!list_is_empty(&list)) {
+        struct pool_test_node *n = container_of(list.head, struct pool_test_node, node);
+
+        list_pop_front(&list);
+        pool_delete(node, &pool, n);
+    }
+
+    pool_destroy(&pool);
+}
+
+ut_group(pool_allocator,
+         ut_get_test(allocate_deallocate),
+         ut_get_test(many_slabs),
+         ut_get_test(typed_pool),
+);
@@ -0,0 +1,208 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/rcu_hash_map.h>
+
+#define rcu_hash_int(i)         fnv_one64((const char *)&(i), sizeof(i))
+
+MAKE_RCU_HASH_MAP_TYPE(rcu_int, int, long, rcu_hash_int, CMP);
+
+ut_test(basics)
+{
+    rcu_hash_map_t(rcu_int) rhm;
+    hash_map_t(rcu_rcu_int) *draft;
+    long value = 0;
+
+    ut_assert_eq(rcu_hash_map_init(rcu_int, &rhm, heap_allocator_handle()), 0);
+    ut_assert(!rcu_hash_map_find(rcu_int, &rhm, 1, &value));
+    ut_assert_eq(rcu_hash_map_erase(rcu_int, &rhm, 1), 0);
+
+    ut_assert_eq(rcu_hash_map_upsert(rcu_int, &rhm, 1, 10), 1);
+    ut_assert_eq(rcu_hash_map_upsert(rcu_int, &rhm, 1, 11), 0);
+    ut_assert(rcu_hash_map_find(rcu_int, &rhm, 1, &value));
+    ut_assert_eq(value, 11);
+
+    /* Many changes at once, with a single copy */
+    draft = rcu_hash_map_update_begin(rcu_int, &rhm);
+    for (int i = 2; i < 1000; ++i) {
+        hash_map_insert(rcu_rcu_int, draft, i, -i);
+    }
+    ut_assert_eq(rcu_hash_map_size(rcu_int, &rhm), 1);
+    rcu_hash_map_update_commit(rcu_int, &rhm);
+    ut_assert_eq(rcu_hash_map_size(rcu_int, &rhm), 999);
+    for (int i = 2; i < 1000; ++i) {
+        ut_assert(rcu_hash_map_find(rcu_int, &rhm, i, &value));
+        ut_assert_eq(value, -i);
+    }
+
+    /* Aborted changes are never seen */
+    draft = rcu_hash_map_update_begin(rcu_int, &rhm);
+    hash_map_erase(rcu_rcu_int, draft, 2);
+    rcu_hash_map_update_abort(rcu_int, &rhm);
+    ut_assert(rcu_hash_map_find(rcu_int, &rhm, 2, NULL));
+
+    for (int i = 1; i < 1000; i += 2) {
+        ut_assert_eq(rcu_hash_map_erase(rcu_int, &rhm, i), 1);
+    }
+    ut_assert_eq(rcu_hash_map_size(rcu_int, &rhm), 499);
+    for (int i = 1; i < 1000; ++i) {
+        ut_assert_eq(rcu_hash_map_find(rcu_int, &rhm, i, NULL), i % 2 == 0);
+    }
+
+    /* No reader was left in its critical section, so every retired table was freed */
+    ut_assert_eq(rcu_hash_map_reclaim(rcu_int, &rhm), 0);
+    rcu_hash_map_destroy(rcu_int, &rhm);
+}
+
+ut_test(snapshots)
+{
+    rcu_hash_map_t(rcu_int) rhm;
+    const hash_map_t(rcu_rcu_int) *table;
+    const hash_map_t(rcu_rcu_int) *nested;
+
+    ut_assert_eq(rcu_hash_map_init(rcu_int, &rhm, heap_allocator_handle()), 0);
+    rcu_hash_map_upsert(rcu_int, &rhm, 1, 1);
+
+    /* A reader keeps its table, even when it updates the map itself */
+    table = rcu_hash_map_read_lock(rcu_int, &rhm);
+    ut_assert_ne(table, NULL);
+    rcu_hash_map_upsert(rcu_int, &rhm, 2, 2);
+    rcu_hash_map_erase(rcu_int, &rhm, 1);
+    ut_assert_eq(hash_map_find(rcu_rcu_int, table, 2), hash_map_npos);
+    ut_assert_eq(hash_map_value_at(table, hash_map_find(rcu_rcu_int, table, 1)), 1);
+
+    /* Nested critical sections see the current table, and keep the old one alive */
+    nested = rcu_hash_map_read_lock(rcu_int, &rhm);
+    ut_assert_ne(hash_map_find(rcu_rcu_int, nested, 2), hash_map_npos);
+    rcu_hash_map_read_unlock(rcu_int, &rhm);
+    ut_assert_eq(rcu_hash_map_reclaim(rcu_int, &rhm), 2);
+    rcu_hash_map_read_unlock(rcu_int, &rhm);
+    ut_assert_eq(rcu_hash_map_reclaim(rcu_int, &rhm), 0);
+
+    /* Tables still waiting for readers are freed with the map */
+    table = rcu_hash_map_read_lock(rcu_int, &rhm);
+    rcu_hash_map_upsert(rcu_int, &rhm, 3, 3);
+    rcu_hash_map_read_unlock(rcu_int, &rhm);
+    rcu_hash_map_destroy(rcu_int, &rhm);
+}
+
+ut_test(resizing_draft)
+{
+    rcu_hash_map_t(rcu_int) rhm;
+    hash_map_t(rcu_rcu_int) *draft;
+    const hash_map_t(rcu_rcu_int) *table;
+    int count = 0;
+    long value;
+
+    ut_assert_eq(rcu_hash_map_init(rcu_int, &rhm, heap_allocator_handle()), 0);
+    draft = rcu_hash_map_update_begin(rcu_int, &rhm);
+    hash_map_set_incremental_resize(draft, true);
+    hash_map_set_max_load(draft, 50);
+    while (draft->old.hashes == NULL || count < 1000) {
+        hash_map_insert(rcu_rcu_int, draft, count, count);
+        ++count;
+    }
+
+    /* The resize is finished before the table is published, keeping every element */
+    rcu_hash_map_update_commit(rcu_int, &rhm);
+    table = rcu_hash_map_read_lock(rcu_int, &rhm);
+    ut_assert_eq(table->old.hashes, NULL);
+    ut_assert_eq(hash_map_size(table), (size_t)count);
+    rcu_hash_map_read_unlock(rcu_int, &rhm);
+
+    /* Copies keep the settings of the table, and all its elements */
+    ut_assert_eq(rcu_hash_map_upsert(rcu_int, &rhm, -1, -1), 1);
+    table = rcu_hash_map_read_lock(rcu_int, &rhm);
+    ut_assert_eq(table->max_load, 50);
+    ut_assert(table->incremental_resize);
+    rcu_hash_map_read_unlock(rcu_int, &rhm);
+    ut_assert_eq(rcu_hash_map_size(rcu_int, &rhm), (size_t)count + 1);
+    for (int i = -1; i < count; ++i) {
+        ut_assert(rcu_hash_map_find(rcu_int, &rhm, i, &value));
+        ut_assert_eq(value, i);
+    }
+
+    rcu_hash_map_destroy(rcu_int, &rhm);
+}
+
+#define RCU_READER_COUNT        4
+#define RCU_KEYS                64
+#define RCU_VERSIONS            300
+
+struct rcu_stress
+{
+    rcu_hash_map_t(rcu_int) rhm;
+    atomic_bool done;
+    atomic_size_t errors;
+};
+
+/* Every table must hold a single version of all the keys, and versions must never go back */
+static void *rcu_reader_main(void *data)
+{
+    struct rcu_stress *stress = data;
+    long last = 0;
+
+    while (!atomic_load(&stress->done)) {
+        const hash_map_t(rcu_rcu_int) *table = rcu_hash_map_read_lock(rcu_int, &stress->rhm);
+        long version = hash_map_value_at(table, hash_map_find(rcu_rcu_int, table, 0));
+
+        if (version < last || hash_map_size(table) != RCU_KEYS) {
+            atomic_fetch_add(&stress->errors, 1);
+        }
+        for (int i = 1; i < RCU_KEYS; ++i) {
+            if (hash_map_value_at(table, hash_map_find(rcu_rcu_int, table, i)) != version) {
+                atomic_fetch_add(&stress->errors, 1);
+            }
+        }
+        last = version;
+        rcu_hash_map_read_unlock(rcu_int, &stress->rhm);
+    }
+    return NULL;
+}
+
+ut_test(stress)
+{
+    static struct rcu_stress stress;
+    pthread_t readers[RCU_READER_COUNT];
+    hash_map_t(rcu_rcu_int) *draft;
+    long value;
+
+    ut_assert_eq(rcu_hash_map_init(rcu_int, &stress.rhm, heap_allocator_handle()), 0);
+    atomic_init(&stress.done, false);
+    atomic_init(&stress.errors, 0);
+    draft = rcu_hash_map_update_begin(rcu_int, &stress.rhm);
+    for (int i = 0; i < RCU_KEYS; ++i) {
+        hash_map_insert(rcu_rcu_int, draft, i, 0);
+    }
+    rcu_hash_map_update_commit(rcu_int, &stress.rhm);
+
+    for (size_t i = 0; i < RCU_READER_COUNT; ++i) {
+        ut_assert_eq(pthread_create(&readers[i], NULL, &rcu_reader_main, &stress), 0);
+    }
+    for (long version = 1; version <= RCU_VERSIONS; ++version) {
+        draft = rcu_hash_map_update_begin(rcu_int, &stress.rhm);
+        for (int i = 0; i < RCU_KEYS; ++i) {
+            *hash_map_try_emplace(rcu_rcu_int, draft, i, NULL) = version;
+        }
+        rcu_hash_map_update_commit(rcu_int, &stress.rhm);
+    }
+    atomic_store(&stress.done, true);
+    for (size_t i = 0; i < RCU_READER_COUNT; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+
+    ut_assert_eq(atomic_load(&stress.errors), 0);
+    ut_assert(rcu_hash_map_find(rcu_int, &stress.rhm, RCU_KEYS - 1, &value));
+    ut_assert_eq(value, RCU_VERSIONS);
+    ut_assert_eq(rcu_hash_map_reclaim(rcu_int, &stress.rhm), 0);
+    rcu_hash_map_destroy(rcu_int, &stress.rhm);
+}
+
+ut_group(rcu_hash_map,
+         ut_get_test(basics),
+         ut_get_test(snapshots),
+         ut_get_test(resizing_draft),
+         ut_get_test(stress),
+);
@@ -0,0 +1,97 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include "unit_tests.h"
+#include <ceeds/scavenger.h>
+
+#define SCAVENGER_TEST_SPANS    4
+
+static bool is_resident(void *addr)
+{
+    unsigned char vec = 0;
+
+    return mincore(addr, 1, &vec) == 0 && (vec & 1) != 0;
+}
+
+ut_test(byte_threshold)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t span_size = 2 * page;
+    char *region = mmap(NULL, SCAVENGER_TEST_SPANS * span_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    struct scavenger_span spans[SCAVENGER_TEST_SPANS];
+    scavenger_t sc;
+
+    ut_assert_ne(region, MAP_FAILED);
+    memset(region, 'x', SCAVENGER_TEST_SPANS * span_size);
+    scavenger_init(&sc);
+    scavenger_set_policy(&sc, 2 * span_size, UINT64_MAX, false);
+
+    scavenger_put(&sc, &spans[0], region, span_size);
+    scavenger_put(&sc, &spans[1], region + span_size, span_size);
+    ut_assert_eq(scavenger_resident_bytes(&sc), 2 * span_size);
+    ut_assert_eq(scavenger_released_bytes(&sc), 0);
+
+    /* Going past the threshold releases the oldest span */
+    scavenger_put(&sc, &spans[2], region + 2 * span_size, span_size);
+    ut_assert_eq(scavenger_resident_bytes(&sc), 2 * span_size);
+    ut_assert_eq(scavenger_released_bytes(&sc), span_size);
+    ut_assert(spans[0].released);
+    ut_assert(!is_resident(region));
+    ut_assert_eq(region[0], 0);
+    ut_assert(is_resident(region + 2 * span_size));
+
+    /* The most recently idle spans are reused first, released ones last */
+    ut_assert_eq(scavenger_take(&sc), &spans[2]);
+    ut_assert_eq(scavenger_take(&sc), &spans[1]);
+    ut_assert_eq(scavenger_take(&sc), &spans[0]);
+    ut_assert_eq(scavenger_take(&sc), NULL);
+    ut_assert_eq(scavenger_resident_bytes(&sc), 0);
+    ut_assert_eq(scavenger_released_bytes(&sc), 0);
+
+    munmap(region, SCAVENGER_TEST_SPANS * span_size);
+}
+
+ut_test(age_and_trim)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *region = mmap(NULL, SCAVENGER_TEST_SPANS * page, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    struct scavenger_span spans[SCAVENGER_TEST_SPANS];
+    scavenger_t sc;
+
+    ut_assert_ne(region, MAP_FAILED);
+    memset(region, 'x', SCAVENGER_TEST_SPANS * page);
+    scavenger_init(&sc);
+
+    /* With no idle time allowed, spans are released as soon as they are handed over */
+    scavenger_set_policy(&sc, SIZE_MAX, 0, false);
+    scavenger_put(&sc, &spans[0], region, page);
+    ut_assert_eq(scavenger_resident_bytes(&sc), 0);
+    ut_assert_eq(scavenger_released_bytes(&sc), page);
+    ut_assert(!is_resident(region));
+
+    /* Otherwise, spans stay resident until explicitly released */
+    scavenger_set_policy(&sc, SIZE_MAX, UINT64_MAX, true);
+    for (size_t i = 1; i < SCAVENGER_TEST_SPANS; ++i) {
+        scavenger_put(&sc, &spans[i], region + i * page, page);
+    }
+    ut_assert_eq(scavenger_resident_bytes(&sc), 3 * page);
+    ut_assert_eq(scavenger_release(&sc, page), 2 * page);
+    ut_assert_eq(scavenger_resident_bytes(&sc), page);
+    ut_assert_eq(scavenger_release(&sc, 0), page);
+    ut_assert_eq(scavenger_release(&sc, 0), 0);
+    ut_assert_eq(scavenger_released_bytes(&sc), SCAVENGER_TEST_SPANS * page);
+
+    scavenger_clear(&sc);
+    ut_assert_eq(scavenger_take(&sc), NULL);
+    munmap(region, SCAVENGER_TEST_SPANS * page);
+}
+
+ut_group(scavenger,
+         ut_get_test(byte_threshold),
+         ut_get_test(age_and_trim),
+);
@@ -0,0 +1,291 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/growing_str.h>
+#include <ceeds/hash_map.h>
+#include <ceeds/size_class_allocator.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(sca_long, long);
+
+MAKE_VECTOR_TYPE(sca_char, char);
+
+#define sca_hash_int(i)     fnv_one64((const char *)&i, sizeof(i))
+
+MAKE_HASH_MAP_TYPE(sca_int, int, int, sca_hash_int, CMP);
+
+ut_test(size_classes)
+{
+    for (size_t size = 1; size <= SIZE_CLASS_MAX_SMALL_SIZE; ++size) {
+        uint32_t index = size_class_index(size);
+
+        ut_assert_lt(index, SIZE_CLASS_COUNT);
+        ut_assert_ge(size_class_size(index), size);
+        if (index > 0) {
+            ut_assert_lt(size_class_size(index - 1), size);
+        }
+    }
+    ut_assert_eq(size_class_size(SIZE_CLASS_COUNT - 1), SIZE_CLASS_MAX_SMALL_SIZE);
+}
+
+ut_test(allocate_deallocate)
+{
+    size_class_allocator_t sca;
+    memory_allocator_handle_t handle = size_class_allocator_handle(&sca);
+    char *ptrs[512];
+
+    size_class_allocator_init(&sca);
+
+    for (size_t i = 0; i < ut_sizeof_array(ptrs); ++i) {
+        ptrs[i] = allocator_new_array(handle, char, i * 7 + 1);
+        ut_assert_ne(ptrs[i], NULL);
+        memset(ptrs[i], (int)i, i * 7 + 1);
+    }
+    for (size_t i = 0; i < ut_sizeof_array(ptrs); ++i) {
+        ut_assert_eq(ptrs[i][0], (char)i);
+        ut_assert_eq(ptrs[i][i * 7], (char)i);
+    }
+    for (size_t i = 0; i < ut_sizeof_array(ptrs); i += 2) {
+        allocator_delete(handle, ptrs[i]);
+    }
+    /* Freed slots are reused by the same size class, the most recently freed first */
+    char *again = allocator_new_array(handle, char, 1);
+    ut_assert_eq(again, ptrs[2]);
+
+    int *zeroed = allocator_znew_array(handle, int, 100);
+    for (int i = 0; i < 100; ++i) {
+        ut_assert_eq(zeroed[i], 0);
+    }
+
+    size_class_allocator_destroy(&sca);
+}
+
+ut_test(alignment)
+{
+    size_class_allocator_t sca;
+    memory_allocator_handle_t handle = size_class_allocator_handle(&sca);
+
+    size_class_allocator_init(&sca);
+
+    for (size_t align = 1; align <= 4096; align *= 2) {
+        void *ptr = allocator_aligned_new(handle, char, align);
+
+        ut_assert(is_aligned_ptr(ptr, align));
+        ptr = allocator_aligned_new_array(handle, char, 100000, align);
+        ut_assert(is_aligned_ptr(ptr, align));
+        allocator_delete(handle, ptr);
+    }
+
+    size_class_allocator_destroy(&sca);
+}
+
+ut_test(reallocate)
+{
+    size_class_allocator_t sca;
+    memory_allocator_handle_t handle = size_class_allocator_handle(&sca);
+
+    size_class_allocator_init(&sca);
+
+    /* 40 and 48 bytes both fit in the 48 bytes class */
+    char *ptr = allocator_new_array(handle, char, 40);
+    memset(ptr, 'a', 40);
+    ut_assert_eq(allocator_resize_array(handle, ptr, char, 40, 48), ptr);
+
+    char *moved = allocator_resize_array(handle, ptr, char, 48, 100000);
+    for (size_t i = 0; i < 40; ++i) {
+        ut_assert_eq(moved[i], 'a');
+    }
+    memset(moved, 'b', 100000);
+    ut_assert_eq(allocator_resize_array(handle, moved, char, 100000, 100001), moved);
+    allocator_delete(handle, moved);
+
+    size_class_allocator_destroy(&sca);
+}
+
+ut_test(containers)
+{
+    size_class_allocator_t sca;
+    vector_t(sca_long) vec;
+
+    size_class_allocator_init(&sca);
+    vector_init_empty(&vec, size_class_allocator_handle(&sca));
+
+    for (long i = 0; i < 100000; ++i) {
+        vector_push_back(&vec, i);
+    }
+    for (long i = 0; i < 100000; ++i) {
+        ut_assert_eq(vec.data[i], i);
+    }
+
+    vector_destroy(&vec);
+    size_class_allocator_destroy(&sca);
+}
+
+ut_test(real_capacity)
+{
+    size_class_allocator_t sca;
+    memory_allocator_handle_t handle = size_class_allocator_handle(&sca);
+    size_t actual_n;
+
+    size_class_allocator_init(&sca);
+
+    /* 100 bytes are rounded up to the 112 bytes class */
+    char *arr = allocator_new_array_at_least(handle, char, 100, &actual_n);
+    ut_assert_eq(actual_n, 112);
+    allocator_delete_array(handle, arr, char, actual_n);
+
+    vector_t(sca_char) vec = vector_empty(handle);
+    vector_reserve(&vec, 100);
+    ut_assert_eq(vector_capacity(&vec), 112);
+    vector_destroy(&vec);
+
+    growing_str_t gs = gs_empty(handle);
+    gs_reserve(&gs, 100);
+    ut_assert_eq(gs.capacity, 112);
+    gs_destroy(&gs);
+
+    hash_map_t(sca_int) hm = hash_map_empty(handle);
+    hash_map_reserve(sca_int, &hm, 20);
+    ut_assert_ge(hash_map_capacity(&hm), 20);
+    for (int i = 0; i < 1000; ++i) {
+        hash_map_insert(sca_int, &hm, i, -i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        size_t pos = hash_map_find(sca_int, &hm, i);
+
+        ut_assert_ne(pos, hash_map_npos);
+        ut_assert_eq(hm.values[pos], -i);
+    }
+    hash_map_destroy(sca_int, &hm);
+
+    size_class_allocator_destroy(&sca);
+}
+
+#define SCA_TRIM_COUNT      20000
+
+ut_test(trim)
+{
+    static char *ptrs[SCA_TRIM_COUNT];
+    size_class_allocator_t sca;
+    memory_allocator_handle_t handle = size_class_allocator_handle(&sca);
+    size_t span_count = 0;
+    size_t released;
+
+    size_class_allocator_init(&sca);
+    for (size_t i = 0; i < SCA_TRIM_COUNT; ++i) {
+        ptrs[i] = allocator_new_array(handle, char, 64);
+        memset(ptrs[i], 'a', 64);
+    }
+    list_for_each(&sca.spans, node) {
+        ++span_count;
+    }
+    ut_assert_gt(span_count, 10);
+
+    /* Emptied spans (all but the current one) stay around, up to the byte threshold of the scavenger */
+    for (size_t i = 0; i < SCA_TRIM_COUNT; ++i) {
+        allocator_delete(handle, ptrs[i]);
+    }
+    ut_assert_gt(scavenger_resident_bytes(&sca.scavenger), 0);
+    ut_assert_eq(scavenger_released_bytes(&sca.scavenger), 0);
+
+    released = allocator_trim(handle);
+    ut_assert_ge(released, (span_count - 1) * (SIZE_CLASS_SPAN_SIZE - 4096));
+    ut_assert_eq(scavenger_resident_bytes(&sca.scavenger), 0);
+    ut_assert_eq(scavenger_released_bytes(&sca.scavenger), released);
+
+    /* Released spans are reused by any size class, without mapping anything */
+    for (size_t i = 0; i < SCA_TRIM_COUNT / 2; ++i) {
+        ptrs[i] = allocator_new_array(handle, char, 128);
+        memset(ptrs[i], 'b', 128);
+    }
+    list_for_each(&sca.spans, node) {
+        --span_count;
+    }
+    ut_assert_eq(span_count, 0);
+    ut_assert_eq(ptrs[0][127], 'b');
+
+    size_class_allocator_destroy(&sca);
+}
+
+#define SCA_THREAD_COUNT        4
+#define SCA_THREAD_ROUNDS       200
+#define SCA_THREAD_BLOCKS       256
+
+struct sca_thread
+{
+    pthread_t thread;
+    memory_allocator_handle_t handle;
+    char tag;
+};
+
+static void *sca_thread_main(void *arg)
+{
+    memory_allocator_handle_t handle = ((struct sca_thread *)arg)->handle;
+    char tag = ((struct sca_thread *)arg)->tag;
+    char **ptrs = allocator_new_array(handle, char *, SCA_THREAD_BLOCKS);
+
+    for (size_t round = 0; round < SCA_THREAD_ROUNDS; ++round) {
+        for (size_t i = 0; i < SCA_THREAD_BLOCKS; ++i) {
+            size_t size = (i * 37 + round) % 300 + 1;
+
+            ptrs[i] = allocator_new_array(handle, char, size);
+            if (ptrs[i] == NULL) {
+                return NULL;
+            }
+            memset(ptrs[i], tag, size);
+        }
+        for (size_t i = 0; i < SCA_THREAD_BLOCKS; ++i) {
+            size_t size = (i * 37 + round) % 300 + 1;
+
+            /* Another thread writing into one of our slots would show up here */
+            if (ptrs[i][0] != tag || ptrs[i][size - 1] != tag) {
+                return NULL;
+            }
+            allocator_delete(handle, ptrs[i]);
+        }
+    }
+    /* Left for the main thread to free */
+    return ptrs;
+}
+
+ut_test(threads)
+{
+    struct sca_thread threads[SCA_THREAD_COUNT];
+    void *results[SCA_THREAD_COUNT];
+    size_class_allocator_t sca;
+    memory_allocator_handle_t handle = size_class_allocator_handle(&sca);
+
+    size_class_allocator_init(&sca);
+    for (size_t i = 0; i < SCA_THREAD_COUNT; ++i) {
+        threads[i] = (struct sca_thread){.handle = handle, .tag = (char)('a' + i)};
+        ut_assert_eq(pthread_create(&threads[i].thread, NULL, &sca_thread_main, &threads[i]), 0);
+    }
+    for (size_t i = 0; i < SCA_THREAD_COUNT; ++i) {
+        pthread_join(threads[i].thread, &results[i]);
+    }
+    for (size_t i = 0; i < SCA_THREAD_COUNT; ++i) {
+        ut_assert_ne(results[i], NULL);
+        allocator_delete(handle, results[i]);
+    }
+
+    /* Every span went back to the scavenger */
+    allocator_trim(handle);
+    ut_assert_eq(scavenger_resident_bytes(&sca.scavenger), 0);
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        ut_assert_eq(sca.bins[i].current, NULL);
+    }
+    size_class_allocator_destroy(&sca);
+}
+
+ut_group(size_class_allocator,
+         ut_get_test(size_classes),
+         ut_get_test(allocate_deallocate),
+         ut_get_test(alignment),
+         ut_get_test(reallocate),
+         ut_get_test(containers),
+         ut_get_test(real_capacity),
+         ut_get_test(trim),
+         ut_get_test(threads),
+);
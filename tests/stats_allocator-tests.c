@@ -0,0 +1,159 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/stats_allocator.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(stats_int, int);
+
+ut_test(counters)
+{
+    stats_allocator_t sa;
+    struct allocator_stats stats;
+
+    ut_assert_eq(stats_allocator_init(&sa, heap_allocator_handle(), NULL), 0);
+
+    char *a = allocator_new_array(stats_allocator_handle(&sa), char, 100);
+    int *b = allocator_znew_array(stats_allocator_handle(&sa), int, 10);
+    char *c = allocator_aligned_new_array(stats_allocator_handle(&sa), char, 64, 64);
+
+    ut_assert(is_aligned_ptr(c, 64));
+    for (int i = 0; i < 10; ++i) {
+        ut_assert_eq(b[i], 0);
+    }
+    memset(a, 'a', 100);
+    a = allocator_resize_array(stats_allocator_handle(&sa), a, char, 100, 1000);
+    ut_assert_eq(a[99], 'a');
+
+    stats_allocator_read(&sa, &stats);
+    ut_assert_eq(stats.counts[ALLOC_TRACE_ALLOCATE], 2);
+    ut_assert_eq(stats.counts[ALLOC_TRACE_ZERO_ALLOCATE], 1);
+    ut_assert_eq(stats.counts[ALLOC_TRACE_REALLOCATE], 1);
+    ut_assert_eq(stats.counts[ALLOC_TRACE_DEALLOCATE], 0);
+    ut_assert_eq(stats.bytes[ALLOC_TRACE_ALLOCATE], 164);
+    ut_assert_eq(stats.live_bytes, 1000 + 40 + 64);
+    ut_assert_eq(stats.peak_bytes, 1000 + 40 + 64);
+    ut_assert_eq(stats.histogram[6], 1);
+    ut_assert_eq(stats.histogram[7], 2);
+    ut_assert_eq(stats.histogram[10], 1);
+
+    allocator_delete(stats_allocator_handle(&sa), a);
+    allocator_delete(stats_allocator_handle(&sa), b);
+    allocator_delete(stats_allocator_handle(&sa), c);
+    stats_allocator_read(&sa, &stats);
+    ut_assert_eq(stats.counts[ALLOC_TRACE_DEALLOCATE], 3);
+    ut_assert_eq(stats.bytes[ALLOC_TRACE_DEALLOCATE], 1104);
+    ut_assert_eq(stats.live_bytes, 0);
+    stats_allocator_destroy(&sa);
+}
+
+ut_test(peak)
+{
+    stats_allocator_t sa;
+    struct allocator_stats stats;
+    vector_t(stats_int) vec;
+
+    ut_assert_eq(stats_allocator_init(&sa, heap_allocator_handle(), NULL), 0);
+    vec = (vector_t(stats_int))vector_empty(stats_allocator_handle(&sa));
+    for (int i = 0; i < 100000; ++i) {
+        vector_push_back(&vec, i);
+    }
+    vector_destroy(&vec);
+
+    stats_allocator_read(&sa, &stats);
+    ut_assert_eq(stats.live_bytes, 0);
+    ut_assert_ge(stats.peak_bytes, (int64_t)(100000 * sizeof(int)) - STATS_LIVE_BATCH);
+    ut_assert_le(stats.peak_bytes, (int64_t)(2 * 100000 * sizeof(int)) + STATS_LIVE_BATCH);
+    stats_allocator_destroy(&sa);
+}
+
+ut_test(trace)
+{
+    FILE *trace = tmpfile();
+    stats_allocator_t sa;
+    struct alloc_trace_record records[3];
+    char magic[ALLOC_TRACE_MAGIC_SIZE];
+
+    ut_assert_ne(trace, NULL);
+    ut_assert_eq(stats_allocator_init(&sa, heap_allocator_handle(), trace), 0);
+
+    char *ptr = allocator_new_array(stats_allocator_handle(&sa), char, 10);
+    char *grown = allocator_resize_array(stats_allocator_handle(&sa), ptr, char, 10, 20);
+    allocator_delete(stats_allocator_handle(&sa), grown);
+    stats_allocator_destroy(&sa);
+
+    rewind(trace);
+    ut_assert_eq(fread(magic, 1, sizeof(magic), trace), sizeof(magic));
+    ut_assert_eq(memcmp(magic, ALLOC_TRACE_MAGIC, ALLOC_TRACE_MAGIC_SIZE), 0);
+    ut_assert_eq(fread(records, sizeof(records[0]), 4, trace), 3);
+    ut_assert_eq(records[0].op, ALLOC_TRACE_ALLOCATE);
+    ut_assert_eq(records[0].ptr, (uintptr_t)ptr);
+    ut_assert_eq(records[0].size, 10);
+    ut_assert_eq(records[1].op, ALLOC_TRACE_REALLOCATE);
+    ut_assert_eq(records[1].old_ptr, (uintptr_t)ptr);
+    ut_assert_eq(records[1].ptr, (uintptr_t)grown);
+    ut_assert_eq(records[1].old_size, 10);
+    ut_assert_eq(records[1].size, 20);
+    ut_assert_eq(records[2].op, ALLOC_TRACE_DEALLOCATE);
+    ut_assert_eq(records[2].ptr, (uintptr_t)grown);
+    ut_assert_le(records[0].timestamp_ns, records[1].timestamp_ns);
+    ut_assert_le(records[1].timestamp_ns, records[2].timestamp_ns);
+    /* The freeing half of the reallocation is numbered before the call, its allocating half after it */
+    ut_assert_lt(records[0].seq, records[1].old_seq);
+    ut_assert_lt(records[1].old_seq, records[1].seq);
+    ut_assert_lt(records[1].seq, records[2].seq);
+    fclose(trace);
+}
+
+#define STATS_THREAD_COUNT      4
+#define STATS_ITERATIONS        10000
+
+static void *stats_thread_main(void *arg)
+{
+    memory_allocator_handle_t alloc = arg;
+
+    for (size_t i = 0; i < STATS_ITERATIONS; ++i) {
+        void *ptr = alloc->allocate(alloc, 32, 8);
+
+        alloc->deallocate(alloc, ptr);
+    }
+    return alloc->allocate(alloc, 1, 1);
+}
+
+ut_test(threads)
+{
+    pthread_t threads[STATS_THREAD_COUNT];
+    void *leftovers[STATS_THREAD_COUNT];
+    stats_allocator_t sa;
+    struct allocator_stats stats;
+
+    ut_assert_eq(stats_allocator_init(&sa, heap_allocator_handle(), NULL), 0);
+    for (size_t i = 0; i < STATS_THREAD_COUNT; ++i) {
+        ut_assert_eq(pthread_create(&threads[i], NULL, &stats_thread_main, stats_allocator_handle(&sa)), 0);
+    }
+    for (size_t i = 0; i < STATS_THREAD_COUNT; ++i) {
+        pthread_join(threads[i], &leftovers[i]);
+    }
+
+    stats_allocator_read(&sa, &stats);
+    ut_assert_eq(stats.counts[ALLOC_TRACE_ALLOCATE], STATS_THREAD_COUNT * (STATS_ITERATIONS + 1));
+    ut_assert_eq(stats.counts[ALLOC_TRACE_DEALLOCATE], STATS_THREAD_COUNT * STATS_ITERATIONS);
+    ut_assert_eq(stats.histogram[6], STATS_THREAD_COUNT * STATS_ITERATIONS);
+    ut_assert_eq(stats.live_bytes, STATS_THREAD_COUNT);
+
+    for (size_t i = 0; i < STATS_THREAD_COUNT; ++i) {
+        allocator_delete(stats_allocator_handle(&sa), leftovers[i]);
+    }
+    stats_allocator_read(&sa, &stats);
+    ut_assert_eq(stats.live_bytes, 0);
+    stats_allocator_destroy(&sa);
+}
+
+ut_group(stats_allocator,
+         ut_get_test(counters),
+         ut_get_test(peak),
+         ut_get_test(trace),
+         ut_get_test(threads),
+);
@@ -0,0 +1,149 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <stdatomic.h>
+#include "unit_tests.h"
+#include <ceeds/thread_cache_allocator.h>
+#include <ceeds/vector.h>
+
+MAKE_VECTOR_TYPE(tca_int, int);
+
+#define THREAD_COUNT    4
+
+/* A heap allocator counting live allocations, to check that every block is eventually given back */
+static atomic_long counting_live;
+
+static void *counting_allocate(_unused_ memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    atomic_fetch_add(&counting_live, 1);
+    return heap_allocator.allocate(heap_allocator_handle(), size, align);
+}
+
+static void *counting_zero_allocate(_unused_ memory_allocator_handle_t alloc, size_t size, size_t align)
+{
+    atomic_fetch_add(&counting_live, 1);
+    return heap_allocator.zero_allocate(heap_allocator_handle(), size, align);
+}
+
+static void counting_deallocate(_unused_ memory_allocator_handle_t alloc, void *ptr)
+{
+    if (ptr != NULL) {
+        atomic_fetch_sub(&counting_live, 1);
+    }
+    heap_allocator.deallocate(heap_allocator_handle(), ptr);
+}
+
+static void *counting_reallocate(
+    _unused_ memory_allocator_handle_t alloc,
+    void *ptr,
+    size_t old_size,
+    size_t new_size,
+    size_t new_align
+)
+{
+    atomic_fetch_add(&counting_live, (ptr == NULL) - (new_size == 0));
+    return heap_allocator.reallocate(heap_allocator_handle(), ptr, old_size, new_size, new_align);
+}
+
+static struct memory_allocator counting_allocator = {
+    .allocate = &counting_allocate,
+    .zero_allocate = &counting_zero_allocate,
+    .deallocate = &counting_deallocate,
+    .reallocate = &counting_reallocate,
+};
+
+ut_test(allocate_deallocate)
+{
+    thread_cache_allocator_t tca;
+    memory_allocator_handle_t handle = thread_cache_allocator_handle(&tca);
+
+    atomic_store(&counting_live, 0);
+    ut_assert_eq(thread_cache_allocator_init(&tca, &counting_allocator), 0);
+
+    int *a = allocator_new(handle, int);
+    *a = 42;
+    allocator_delete(handle, a);
+    int *b = allocator_new(handle, int);
+    ut_assert_eq(a, b);
+    allocator_delete(handle, b);
+
+    char *big = allocator_aligned_new_array(handle, char, 102400, 256);
+    ut_assert(is_aligned_ptr(big, 256));
+    memset(big, 'a', 102400);
+    big = allocator_aligned_resize_array(handle, big, char, 102400, 204800, 256);
+    ut_assert(is_aligned_ptr(big, 256));
+    ut_assert_eq(big[102399], 'a');
+    allocator_delete(handle, big);
+
+    char *small = allocator_new_array(handle, char, 10);
+    ut_assert_eq(allocator_resize_array(handle, small, char, 10, 16), small);
+    memset(small, 'b', 16);
+    small = allocator_resize_array(handle, small, char, 16, 5000);
+    ut_assert_eq(small[15], 'b');
+    allocator_delete(handle, small);
+
+    thread_cache_allocator_flush(&tca);
+    ut_assert_eq(atomic_load(&counting_live), 1);
+
+    thread_cache_allocator_destroy(&tca);
+    ut_assert_eq(atomic_load(&counting_live), 0);
+}
+
+static void *thread_cache_worker(void *arg)
+{
+    memory_allocator_handle_t handle = arg;
+    long ok = 1;
+
+    for (int round = 0; round < 50; ++round) {
+        vector_t(tca_int) vec = vector_empty(handle);
+        char *ptrs[200];
+
+        for (size_t i = 0; i < array_length(ptrs); ++i) {
+            ptrs[i] = allocator_new_array(handle, char, i * 5 + 1);
+            memset(ptrs[i], (int)i, i * 5 + 1);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            vector_push_back(&vec, i);
+        }
+        for (size_t i = 0; i < array_length(ptrs); ++i) {
+            ok &= ptrs[i][i * 5] == (char)i;
+            allocator_delete(handle, ptrs[i]);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            ok &= vec.data[i] == i;
+        }
+        vector_destroy(&vec);
+    }
+    return (void *)ok;
+}
+
+ut_test(threads)
+{
+    thread_cache_allocator_t tca;
+    pthread_t threads[THREAD_COUNT];
+
+    atomic_store(&counting_live, 0);
+    ut_assert_eq(thread_cache_allocator_init(&tca, &counting_allocator), 0);
+
+    for (size_t i = 0; i < THREAD_COUNT; ++i) {
+        pthread_create(&threads[i], NULL, &thread_cache_worker, thread_cache_allocator_handle(&tca));
+    }
+    for (size_t i = 0; i < THREAD_COUNT; ++i) {
+        void *ok;
+
+        pthread_join(threads[i], &ok);
+        ut_assert_eq((long)ok, 1);
+    }
+
+    /* Every thread gave its cache back when exiting */
+    ut_assert_eq(atomic_load(&counting_live), 0);
+    ut_assert(list_is_empty(&tca.caches));
+
+    thread_cache_allocator_destroy(&tca);
+}
+
+ut_group(thread_cache_allocator,
+         ut_get_test(allocate_deallocate),
+         ut_get_test(threads),
+);
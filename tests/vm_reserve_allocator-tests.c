@@ -0,0 +1,104 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include "unit_tests.h"
+#include <ceeds/vector.h>
+#include <ceeds/vm_reserve_allocator.h>
+
+MAKE_VECTOR_TYPE(vra_int, int);
+
+ut_test(stable_growth)
+{
+    vm_reserve_allocator_t vra;
+    vector_t(vra_int) vec;
+    int *first;
+
+    vm_reserve_allocator_init(&vra, (size_t)64 * 1024 * 1024);
+    vector_init_with_capacity(&vec, vm_reserve_allocator_handle(&vra), 1);
+    first = vec.data;
+    ut_assert_ge(vector_capacity(&vec), 1);
+
+    for (int i = 0; i < 1000000; ++i) {
+        vector_push_back(&vec, i);
+        if (vec.data != first) {
+            break;
+        }
+    }
+    ut_assert_eq(vec.data, first);
+    ut_assert_eq(vector_size(&vec), 1000000);
+    for (int i = 0; i < 1000000; ++i) {
+        ut_assert_eq(vec.data[i], i);
+    }
+
+    vector_destroy(&vec);
+}
+
+ut_test(reallocate)
+{
+    vm_reserve_allocator_t vra;
+    memory_allocator_handle_t handle = vm_reserve_allocator_handle(&vra);
+
+    vm_reserve_allocator_init(&vra, (size_t)1024 * 1024);
+
+    int *zeroed = allocator_znew_array(handle, int, 100);
+    for (int i = 0; i < 100; ++i) {
+        ut_assert_eq(zeroed[i], 0);
+        zeroed[i] = i;
+    }
+
+    ut_assert_eq(allocator_resize_array(handle, zeroed, int, 100, 200000), zeroed);
+    zeroed[199999] = 42;
+    ut_assert_eq(allocator_resize_array(handle, zeroed, int, 200000, 10), zeroed);
+    for (int i = 0; i < 10; ++i) {
+        ut_assert_eq(zeroed[i], i);
+    }
+
+    /* Growing past the reservation fails instead of relocating */
+    ut_assert_eq(allocator_resize_array(handle, zeroed, int, 10, 1024 * 1024), NULL);
+    ut_assert_eq(zeroed[9], 9);
+
+    allocator_delete(handle, zeroed);
+    ut_assert_eq(allocator_new_array(handle, char, 2 * 1024 * 1024), NULL);
+}
+
+ut_test(reservation_exhausted)
+{
+    vm_reserve_allocator_t vra;
+    vector_t(vra_int) vec;
+    int *data;
+    size_t capacity;
+    int i = 0;
+
+    vm_reserve_allocator_init(&vra, (size_t)64 * 1024);
+    vector_init_empty(&vec, vm_reserve_allocator_handle(&vra));
+    while (vector_push_back(&vec, i) == 0) {
+        ++i;
+    }
+    ut_assert_gt(i, 0);
+
+    /* The vector keeps its buffer when it can't grow, and can still be used */
+    data = vec.data;
+    capacity = vector_capacity(&vec);
+    ut_assert_ne(data, NULL);
+    ut_assert_eq(vector_size(&vec), (size_t)i);
+    ut_assert_eq(vector_reserve(&vec, capacity * 4), -1);
+    ut_assert_eq(vector_insert(&vec, 0, -1), -1);
+    ut_assert_eq(vec.data, data);
+    ut_assert_eq(vector_capacity(&vec), capacity);
+    ut_assert_eq(vector_size(&vec), (size_t)i);
+    for (int j = 0; j < i; ++j) {
+        ut_assert_eq(vec.data[j], j);
+    }
+    vector_pop_back(&vec);
+    ut_assert_eq(vector_push_back(&vec, 42), 0);
+    ut_assert_eq(vec.data[i - 1], 42);
+
+    vector_destroy(&vec);
+}
+
+ut_group(vm_reserve_allocator,
+         ut_get_test(stable_growth),
+         ut_get_test(reallocate),
+         ut_get_test(reservation_exhausted),
+);
@@ -0,0 +1,532 @@
+/*
+** Created by doom on 17/10/26.
+*/
+
+#include <getopt.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <ceeds/alloc_trace.h>
+#include <ceeds/arena_allocator.h>
+#include <ceeds/hash_map.h>
+#include <ceeds/hash_utils.h>
+#include <ceeds/mmap_allocator.h>
+#include <ceeds/pool_allocator.h>
+#include <ceeds/size_class_allocator.h>
+#include <ceeds/thread_cache_allocator.h>
+#include <ceeds/vector.h>
+#include <ceeds/vm_reserve_allocator.h>
+
+/**
+ * Allocation trace replay
+ *
+ * Replays a trace written by a stats_allocator_t against the allocators of the library, and reports how each
+ * of them fares. Records are replayed in the order of their sequence numbers from a single thread, so traces from
+ * several threads measure the allocators without contention.
+ *
+ * Every allocator runs in its own child process, so that they do not share any memory and peak RSS can be
+ * measured independently. Allocated memory is written to (outside of the timed section), so that it is
+ * actually resident.
+ */
+
+#define REPLAY_ARENA_BLOCK_SIZE     ((size_t)1024 * 1024)
+#define REPLAY_NO_SLOT              ((uint32_t)-1)
+
+/**
+ * A trace record, where pointers have been replaced by slot indices
+ */
+struct replay_op
+{
+    uint64_t size;
+    uint32_t slot;
+    uint8_t op;
+    uint8_t align_log2;
+};
+
+/**
+ * A trace record, sorted on @c order
+ *
+ * A reallocation is read twice: once to release its old pointer at @c old_seq, and once to resize the block
+ * into its new pointer at @c seq, as another thread may have been handed the old pointer in between.
+ */
+struct replay_record
+{
+    struct alloc_trace_record rec;
+    uint64_t order;
+    bool release;
+};
+
+struct replay_slot
+{
+    void *ptr;
+    size_t size;
+};
+
+MAKE_VECTOR_TYPE(replay_record, struct replay_record);
+MAKE_VECTOR_TYPE(replay_op, struct replay_op);
+
+#define replay_hash_ptr(p)          fnv_one64((const char *)&(p), sizeof(p))
+
+MAKE_HASH_MAP_TYPE(replay_ptr, uint64_t, uint32_t, replay_hash_ptr, CMP);
+
+struct replay_trace
+{
+    vector_t(replay_op) ops;
+    uint32_t slot_count;
+    size_t max_size;
+    size_t max_align;
+    size_t skipped;
+    size_t overlaps;
+};
+
+struct replay_result
+{
+    uint64_t total_ns;
+    uint32_t *latencies;
+    size_t failures;
+    size_t peak_live;
+    size_t baseline_rss;
+    size_t peak_rss;
+};
+
+struct replay_allocator
+{
+    const char *name;
+    memory_allocator_handle_t (*create)(const struct replay_trace *trace);
+};
+
+static arena_allocator_t replay_arena;
+static pool_allocator_t replay_pool;
+static size_class_allocator_t replay_size_class;
+static thread_cache_allocator_t replay_thread_cache;
+static vm_reserve_allocator_t replay_vm_reserve;
+
+static memory_allocator_handle_t create_heap(_unused_ const struct replay_trace *trace)
+{
+    return heap_allocator_handle();
+}
+
+static memory_allocator_handle_t create_arena(_unused_ const struct replay_trace *trace)
+{
+    arena_allocator_init(&replay_arena, heap_allocator_handle(), REPLAY_ARENA_BLOCK_SIZE);
+    return arena_allocator_handle(&replay_arena);
+}
+
+static memory_allocator_handle_t create_pool(const struct replay_trace *trace)
+{
+    /* A pool only serves one size, so it must be able to hold the biggest block of the trace */
+    pool_allocator_init(&replay_pool, heap_allocator_handle(), MAX(trace->max_size, (size_t)1), trace->max_align);
+    return pool_allocator_handle(&replay_pool);
+}
+
+static memory_allocator_handle_t create_size_class(_unused_ const struct replay_trace *trace)
+{
+    size_class_allocator_init(&replay_size_class);
+    return size_class_allocator_handle(&replay_size_class);
+}
+
+static memory_allocator_handle_t create_thread_cache(_unused_ const struct replay_trace *trace)
+{
+    if (thread_cache_allocator_init(&replay_thread_cache, heap_allocator_handle()) != 0) {
+        return NULL;
+    }
+    return thread_cache_allocator_handle(&replay_thread_cache);
+}
+
+static memory_allocator_handle_t create_mmap(_unused_ const struct replay_trace *trace)
+{
+    return mmap_allocator_handle();
+}
+
+static memory_allocator_handle_t create_vm_reserve(const struct replay_trace *trace)
+{
+    vm_reserve_allocator_init(&replay_vm_reserve, 2 * MAX(trace->max_size, (size_t)1));
+    return vm_reserve_allocator_handle(&replay_vm_reserve);
+}
+
+static const struct replay_allocator allocators[] = {
+    {"heap", &create_heap},
+    {"arena", &create_arena},
+    {"pool", &create_pool},
+    {"size_class", &create_size_class},
+    {"thread_cache", &create_thread_cache},
+    {"mmap", &create_mmap},
+    {"vm_reserve", &create_vm_reserve},
+};
+
+static int record_cmp(const void *a, const void *b)
+{
+    const struct replay_record *ra = a;
+    const struct replay_record *rb = b;
+
+    return CMP(ra->order, rb->order);
+}
+
+static int latency_cmp(const void *a, const void *b)
+{
+    return CMP(*(const uint32_t *)a, *(const uint32_t *)b);
+}
+
+static int trace_read(FILE *file, vector_t(replay_record) *records)
+{
+    char magic[ALLOC_TRACE_MAGIC_SIZE];
+    struct replay_record record;
+
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, ALLOC_TRACE_MAGIC, ALLOC_TRACE_MAGIC_SIZE) != 0) {
+        return -1;
+    }
+    while (fread(&record.rec, sizeof(record.rec), 1, file) == 1) {
+        if (record.rec.op == ALLOC_TRACE_REALLOCATE && record.rec.old_ptr != 0) {
+            record.order = record.rec.old_seq;
+            record.release = true;
+            vector_push_back(records, record);
+        }
+        record.order = record.rec.seq;
+        record.release = false;
+        vector_push_back(records, record);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+/**
+ * Get the slot currently holding a traced pointer, or REPLAY_NO_SLOT if it is not live
+ */
+static uint32_t slot_get(hash_map_t(replay_ptr) *live, uint64_t ptr)
+{
+    size_t pos = hash_map_find(replay_ptr, live, ptr);
+
+    return pos == hash_map_npos ? REPLAY_NO_SLOT : live->values[pos];
+}
+
+static void slot_set(hash_map_t(replay_ptr) *live, uint64_t ptr, uint32_t slot)
+{
+    size_t pos = hash_map_find(replay_ptr, live, ptr);
+
+    /* Dead pointers are marked rather than erased, as addresses are very likely to be reused */
+    if (pos == hash_map_npos) {
+        hash_map_insert(replay_ptr, live, ptr, slot);
+    } else {
+        live->values[pos] = slot;
+    }
+}
+
+/**
+ * Map a pointer which was just handed out to its slot
+ *
+ * A pointer which is still live was given back without being traced (e.g. straight to the backing allocator):
+ * its previous block is released first, so that it does not stay live forever.
+ */
+static void slot_claim(hash_map_t(replay_ptr) *live, struct replay_trace *trace, uint64_t ptr, uint32_t slot)
+{
+    uint32_t stale = slot_get(live, ptr);
+
+    if (stale != REPLAY_NO_SLOT) {
+        struct replay_op op = {.slot = stale, .op = ALLOC_TRACE_DEALLOCATE};
+
+        vector_push_back(&trace->ops, op);
+        trace->overlaps += 1;
+    }
+    slot_set(live, ptr, slot);
+}
+
+/**
+ * Turn trace records into operations on slots, so that replaying does not need to look pointers up
+ */
+static void trace_compile(vector_t(replay_record) *records, struct replay_trace *trace)
+{
+    hash_map_t(replay_ptr) live = hash_map_empty(heap_allocator_handle());
+    /* Slots of reallocations whose old pointer was released, by sequence number */
+    hash_map_t(replay_ptr) released = hash_map_empty(heap_allocator_handle());
+
+    qsort(records->data, records->size, sizeof(records->data[0]), &record_cmp);
+    for (size_t i = 0; i < records->size; ++i) {
+        const struct alloc_trace_record *rec = &records->data[i].rec;
+        struct replay_op op = {.size = rec->size, .op = rec->op, .align_log2 = rec->align_log2};
+        uint32_t slot;
+
+        if (records->data[i].release) {
+            if ((slot = slot_get(&live, rec->old_ptr)) != REPLAY_NO_SLOT) {
+                slot_set(&live, rec->old_ptr, REPLAY_NO_SLOT);
+                slot_set(&released, rec->seq, slot);
+            }
+            continue;
+        }
+        switch (rec->op) {
+            case ALLOC_TRACE_ALLOCATE:
+            case ALLOC_TRACE_ZERO_ALLOCATE:
+                op.slot = trace->slot_count++;
+                slot_claim(&live, trace, rec->ptr, op.slot);
+                break;
+            case ALLOC_TRACE_DEALLOCATE:
+                if ((op.slot = slot_get(&live, rec->ptr)) == REPLAY_NO_SLOT) {
+                    /* Allocated before the trace started */
+                    trace->skipped += 1;
+                    continue;
+                }
+                slot_set(&live, rec->ptr, REPLAY_NO_SLOT);
+                break;
+            case ALLOC_TRACE_REALLOCATE:
+                slot = rec->old_ptr != 0 ? slot_get(&released, rec->seq) : REPLAY_NO_SLOT;
+                if (slot == REPLAY_NO_SLOT) {
+                    /* Allocated before the trace started */
+                    op.op = ALLOC_TRACE_ALLOCATE;
+                    slot = trace->slot_count++;
+                }
+                op.slot = slot;
+                if (rec->size > 0) {
+                    slot_claim(&live, trace, rec->ptr, slot);
+                }
+                break;
+            default:
+                trace->skipped += 1;
+                continue;
+        }
+        trace->max_size = MAX(trace->max_size, (size_t)rec->size);
+        trace->max_align = MAX(trace->max_align, (size_t)1 << rec->align_log2);
+        vector_push_back(&trace->ops, op);
+    }
+    hash_map_destroy(replay_ptr, &live);
+    hash_map_destroy(replay_ptr, &released);
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Read a field of /proc/self/status, in KiB
+ */
+static size_t proc_status_kib(const char *field)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    size_t field_len = strlen(field);
+    char line[256];
+    size_t value = 0;
+
+    if (status == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            value = strtoull(line + field_len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return value;
+}
+
+static void reset_peak_rss(void)
+{
+    FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+
+    if (clear_refs != NULL) {
+        fputs("5", clear_refs);
+        fclose(clear_refs);
+    }
+}
+
+static void replay(memory_allocator_handle_t alloc, const struct replay_trace *trace, struct replay_result *res)
+{
+    struct replay_slot *slots = allocator_znew_array(heap_allocator_handle(), struct replay_slot, trace->slot_count);
+    size_t live = 0;
+
+    res->latencies = allocator_new_array(heap_allocator_handle(), uint32_t, trace->ops.size);
+    /* Fault the bookkeeping in before measuring the baseline */
+    memset(res->latencies, 0, trace->ops.size * sizeof(uint32_t));
+#ifdef __GLIBC__
+    /* Give the pages freed while loading the trace back, or the heap would reuse them without faulting */
+    malloc_trim(0);
+#endif
+    res->baseline_rss = proc_status_kib("VmRSS");
+    reset_peak_rss();
+    for (size_t i = 0; i < trace->ops.size; ++i) {
+        const struct replay_op *op = &trace->ops.data[i];
+        struct replay_slot *slot = &slots[op->slot];
+        size_t align = (size_t)1 << op->align_log2;
+        size_t old_size = slot->size;
+        uint64_t start = now_ns();
+
+        switch (op->op) {
+            case ALLOC_TRACE_ALLOCATE:
+                slot->ptr = alloc->allocate(alloc, op->size, align);
+                break;
+            case ALLOC_TRACE_ZERO_ALLOCATE:
+                slot->ptr = alloc->zero_allocate(alloc, op->size, align);
+                break;
+            case ALLOC_TRACE_DEALLOCATE:
+                if (slot->ptr != NULL) {
+                    allocator_sized_deallocate(alloc, slot->ptr, slot->size);
+                }
+                break;
+            case ALLOC_TRACE_REALLOCATE:
+                slot->ptr = alloc->reallocate(alloc, slot->ptr, slot->size, op->size, align);
+                break;
+        }
+        res->latencies[i] = (uint32_t)MIN(now_ns() - start, (uint64_t)UINT32_MAX);
+
+        if (op->op == ALLOC_TRACE_DEALLOCATE) {
+            live -= slot->size;
+            slot->ptr = NULL;
+            slot->size = 0;
+            continue;
+        }
+        if unlikely(slot->ptr == NULL && op->size > 0) {
+            res->failures += 1;
+            live -= old_size;
+            slot->size = 0;
+            continue;
+        }
+        slot->size = op->size;
+        live = live - old_size + op->size;
+        res->peak_live = MAX(res->peak_live, live);
+        if (op->size > old_size && op->op != ALLOC_TRACE_ZERO_ALLOCATE) {
+            memset((char *)slot->ptr + old_size, 0xa5, op->size - old_size);
+        }
+    }
+    res->peak_rss = proc_status_kib("VmHWM");
+    for (size_t i = 0; i < trace->ops.size; ++i) {
+        res->total_ns += res->latencies[i];
+    }
+    allocator_delete_array(heap_allocator_handle(), slots, struct replay_slot, trace->slot_count);
+}
+
+static void report_header(void)
+{
+    printf("%-14s %12s %8s %8s %8s %8s %10s %15s %15s %8s\n", "allocator", "ops/s", "p50", "p90", "p99", "p99.9",
+           "max (ns)", "peak RSS (KiB)", "peak live (KiB)", "frag");
+}
+
+static void report(const char *name, const struct replay_trace *trace, struct replay_result *res)
+{
+    size_t n = trace->ops.size;
+    uint32_t *lat = res->latencies;
+    size_t rss = res->peak_rss > res->baseline_rss ? res->peak_rss - res->baseline_rss : 0;
+    double live_kib = (double)res->peak_live / 1024;
+    double frag = rss > 0 && rss > live_kib ? 1 - live_kib / (double)rss : 0;
+
+    qsort(lat, n, sizeof(*lat), &latency_cmp);
+    printf("%-14s %12.0f %8u %8u %8u %8u %10u %15zu %15.0f %7.1f%%", name,
+           res->total_ns > 0 ? (double)n * 1e9 / (double)res->total_ns : 0,
+           lat[n / 2], lat[n * 90 / 100], lat[n * 99 / 100], lat[n * 999 / 1000], lat[n - 1],
+           rss, live_kib, frag * 100);
+    if (res->failures > 0) {
+        printf("  (%zu failed)", res->failures);
+    }
+    printf("\n");
+}
+
+/**
+ * Replay a trace against an allocator, in a child process
+ */
+static int run(const struct replay_allocator *allocator, const struct replay_trace *trace)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        struct replay_result res = {0};
+        memory_allocator_handle_t alloc = allocator->create(trace);
+
+        if (alloc == NULL) {
+            fprintf(stderr, "%s: unable to create allocator\n", allocator->name);
+            _exit(1);
+        }
+        replay(alloc, trace, &res);
+        report(allocator->name, trace, &res);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s: replay failed\n", allocator->name);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-a allocator]... trace-file\n\nallocators:", prog);
+    for (size_t i = 0; i < array_length(allocators); ++i) {
+        fprintf(stderr, " %s", allocators[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int ac, char **av)
+{
+    bool selected[array_length(allocators)] = {false};
+    bool any_selected = false;
+    vector_t(replay_record) records = vector_empty(heap_allocator_handle());
+    struct replay_trace trace = {.ops = vector_empty(heap_allocator_handle()), .max_align = 1};
+    FILE *file;
+    int opt;
+    int ret = 0;
+
+    while ((opt = getopt(ac, av, "a:h")) != -1) {
+        size_t i = 0;
+
+        if (opt != 'a') {
+            usage(av[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+        while (i < array_length(allocators) && strcmp(allocators[i].name, optarg) != 0) {
+            ++i;
+        }
+        if (i == array_length(allocators)) {
+            fprintf(stderr, "%s: unknown allocator '%s'\n", av[0], optarg);
+            usage(av[0]);
+            return 1;
+        }
+        selected[i] = any_selected = true;
+    }
+    if (optind + 1 != ac) {
+        usage(av[0]);
+        return 1;
+    }
+
+    if ((file = fopen(av[optind], "rb")) == NULL) {
+        perror(av[optind]);
+        return 1;
+    }
+    if (trace_read(file, &records) != 0) {
+        fprintf(stderr, "%s: not a valid allocation trace\n", av[optind]);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+    trace_compile(&records, &trace);
+    vector_destroy(&records);
+    if (trace.ops.size == 0) {
+        fprintf(stderr, "%s: empty trace\n", av[optind]);
+        return 1;
+    }
+
+    printf("%zu operations, %zu skipped, largest block of %zu bytes\n", trace.ops.size, trace.skipped,
+           trace.max_size);
+    if (trace.overlaps > 0) {
+        printf("%zu pointers handed out while still live, their untraced frees were added\n", trace.overlaps);
+    }
+    printf("\n");
+    report_header();
+    for (size_t i = 0; i < array_length(allocators); ++i) {
+        if (!any_selected || selected[i]) {
+            ret |= run(&allocators[i], &trace);
+        }
+    }
+    vector_destroy(&trace.ops);
+    return ret != 0;
+}